@@ -0,0 +1,23 @@
+#ifndef TRIK_V4L2_DSP_FB_INTERNAL_BLIT_H_
+#define TRIK_V4L2_DSP_FB_INTERNAL_BLIT_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+void blitCopy(void* _dst, const void* _src, size_t _bytes);
+
+// row by row copy between buffers of different line lengths, rows run together when both are packed
+void blitRows(void* _dst, size_t _dstLineLength,
+              const void* _src, size_t _srcLineLength,
+              size_t _rowBytes, size_t _rows);
+
+
+#ifdef __cplusplus
+} // extern "C"
+#endif // __cplusplus
+
+#endif // !TRIK_V4L2_DSP_FB_INTERNAL_BLIT_H_
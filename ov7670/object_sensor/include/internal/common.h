@@ -9,6 +9,7 @@ extern "C" {
 #endif // __cplusplus
 
 #define MAX_OBJECTS_N 8
+#define MAX_ALGORITHMS_N 4 // codec instances run on each frame besides the main one
 
 typedef struct ImageDescription
 {
@@ -19,6 +20,13 @@ typedef struct ImageDescription
   uint32_t m_format;
 } ImageDescription;
 
+typedef struct FrameInfo
+{
+  uint32_t  m_sequence;
+  long long m_timestampUs; // capture time, CLOCK_MONOTONIC
+  uint32_t  m_camera;
+} FrameInfo;
+
 typedef struct TargetDetectParams
 {
   int m_detectHue;
@@ -35,6 +43,14 @@ typedef struct TargetDetectCommand
   int m_cmd;
 } TargetDetectCommand;
 
+typedef struct VideoFormatCommand // capture format change, nothing to do while m_width is 0
+{
+  size_t   m_camera;
+  size_t   m_width;
+  size_t   m_height;
+  uint32_t m_format; // 0 to pick cheapest native format
+} VideoFormatCommand;
+
 typedef struct Target
 {
   int8_t x;
@@ -47,6 +63,26 @@ typedef struct TargetLocation
   Target target[MAX_OBJECTS_N];
 } TargetLocation;
 
+typedef struct LineLocation // line sensor codec output
+{
+  int m_lineX;
+  int m_lineY;
+  int m_lineSize;
+} LineLocation;
+
+typedef enum AlgorithmResultType
+{
+  ALGORITHM_RESULT_TARGETS = 0, // object sensor codec, m_targetLocation
+  ALGORITHM_RESULT_LINE,        // line sensor codec, m_lineLocation
+} AlgorithmResultType;
+
+typedef struct AlgorithmResult // extra codec output, member is picked by m_type
+{
+  AlgorithmResultType m_type;
+  TargetLocation      m_targetLocation;
+  LineLocation        m_lineLocation;
+} AlgorithmResult;
+
 
 #ifdef __cplusplus
 } // extern "C"
@@ -2,6 +2,7 @@
 #define TRIK_V4L2_DSP_FB_INTERNAL_MODULE_CE_H_
 
 #include <stdbool.h>
+#include <pthread.h>
 
 #include <xdc/std.h>
 #include <ti/xdais/xdas.h>
@@ -10,32 +11,168 @@
 #include <ti/sdo/ce/vidtranscode/vidtranscode.h>
 
 #include "internal/common.h"
+#include "internal/module_ce_adapter.h"
+#include "internal/module_ce_cpu.h"
+#include "internal/timing.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
 
 
+typedef enum CodecEngineCacheMode
+{
+  CODEC_ENGINE_CACHE_RANGE = 0, // cached, maintain only bytes actually written or read by ARM
+  CODEC_ENGINE_CACHE_WHOLE,     // cached, maintain whole buffer every frame
+  CODEC_ENGINE_CACHE_NONE       // non-cached allocation, no maintenance, slow ARM access
+} CodecEngineCacheMode;
+
+typedef enum CodecEngineTimingStage // per frame, accounted only when stage actually runs
+{
+  CODEC_ENGINE_TIMING_COPY_IN = 0, // frame memcpy into codec buffer
+  CODEC_ENGINE_TIMING_CACHE,       // cache maintenance of both buffers
+  CODEC_ENGINE_TIMING_PROCESS,     // VIDTRANSCODE_process round trip, IPC included
+  CODEC_ENGINE_TIMING_COPY_OUT,    // preview memcpy out of codec buffer
+  CODEC_ENGINE_TIMING_STAGES
+} CodecEngineTimingStage;
+
 typedef struct CodecEngineConfig // what user wants to set
 {
   const char* m_serverPath;
-  const char* m_codecName;
+  const char* m_codecName;     // CODEC_ENGINE_CPU_CODEC for ARM detection without DSP
+  size_t      m_pipelineDepth; // frames in flight, 1 for serial processing
+  CodecEngineCacheMode m_srcCacheMode;
+  CodecEngineCacheMode m_dstCacheMode;
+  bool        m_cacheBenchmark; // time every strategy on start, account cache time per frame
+  size_t      m_splitArmPercent; // initial ARM share of rows in split DSP/ARM mode, 0 disables
+  size_t      m_poolSize; // CMEM arena for codec buffers reserved on first open, 0 allocates each buffer separately
+  bool        m_timingReport; // print timing histograms with load report
+  const char* m_timingFile;   // rewritten with timing histograms on every load report, NULL disables
+  size_t      m_algorithms;   // extra codecs fed with the same frame, serial processing only
+  const char* m_algorithmCodec[MAX_ALGORITHMS_N];
+  bool        m_cpuFallback;  // run CPU detector when DSP engine cannot be opened, otherwise fail
 } CodecEngineConfig;
 
+#define CODEC_ENGINE_CPU_CODEC "cpu"
+
+#define CODEC_ENGINE_MAX_SRC_IMPORTS 8
+#define CODEC_ENGINE_MAX_PIPELINE    4
+#define CODEC_ENGINE_SPLIT_STRIPE    16 // split granularity, rows
+
+typedef struct CodecEngineSlot // one frame in flight in pipelined mode
+{
+  void*      m_srcBuffer;
+  void*      m_dstBuffer;
+
+  size_t     m_srcFrameSize;
+  void*      m_dstFramePtr;
+  size_t     m_dstFrameSize;
+  size_t     m_dstFrameUsed;
+  long long  m_cacheUs; // submit side, completed on collect
+  bool       m_dstDirect;
+  bool       m_videoOutEnable;
+
+  TargetDetectParams  m_targetDetectParams;
+  TargetDetectCommand m_targetDetectCommand;
+  FrameInfo           m_frameInfo;
+
+  TargetLocation      m_targetLocation;
+  TargetDetectParams  m_targetDetectParamsResult;
+  int                 m_result;
+} CodecEngineSlot;
+
+typedef struct CodecEngineAlgorithm // extra codec instance on the same engine, no video output
+{
+  const char*               m_codecName;
+  const CodecEngineAdapter* m_adapter; // args layout of the codec, picked by name
+  VIDTRANSCODE_Handle       m_vidtranscodeHandle;
+  bool                      m_fresh; // result belongs to last transcoded frame
+  AlgorithmResult           m_result;
+} CodecEngineAlgorithm;
+
 typedef struct CodecEngine
 {
   Engine_Handle m_handle;
 
-  Memory_AllocParams m_allocParams;
+  // frames are processed on ARM, either requested or DSP server failed to load
+  bool           m_cpu;
+  CodecEngineCpu m_cpuDetector;
+
+  Memory_AllocParams m_srcAllocParams;
+  Memory_AllocParams m_dstAllocParams;
+  CodecEngineCacheMode m_srcCacheMode;
+  CodecEngineCacheMode m_dstCacheMode;
+  bool       m_cacheBenchmark;
+  long long  m_cacheFrames; // since last report, with m_cacheBenchmark
+  long long  m_cacheSrcUs;
+  long long  m_cacheDstUs;
+
+  TimingHistogram m_timing[CODEC_ENGINE_TIMING_STAGES]; // since start or reset, readable from any thread
+  bool       m_timingReport;
+
   size_t     m_srcBufferSize;
   void*      m_srcBuffer;
 
+  // dmabuf source frames mapped by codec engine, looked up by fd
+  int        m_srcImportFd[CODEC_ENGINE_MAX_SRC_IMPORTS];
+  void*      m_srcImportPtr[CODEC_ENGINE_MAX_SRC_IMPORTS];
+  size_t     m_srcImportSize[CODEC_ENGINE_MAX_SRC_IMPORTS];
+  bool       m_srcImportContiguous[CODEC_ENGINE_MAX_SRC_IMPORTS];
+
   size_t     m_dstBufferSize;
   void*      m_dstBuffer;
 
   VIDTRANSCODE_Handle m_vidtranscodeHandle;
+  ImageDescription    m_codecSrcImageDesc; // as codec instance was created
+  ImageDescription    m_codecDstImageDesc;
+
+  size_t               m_algorithms;
+  CodecEngineAlgorithm m_algorithm[MAX_ALGORITHMS_N];
+  void*                m_algorithmDstBuffer; // shared scratch output, never read by ARM
 
   bool m_videoOutEnable;
+
+  // pipelined mode: ARM prepares frame N+1 while DSP thread processes frame N
+  size_t          m_pipelineDepth;
+  CodecEngineSlot m_pipeSlots[CODEC_ENGINE_MAX_PIPELINE];
+  pthread_t       m_pipeThread;
+  pthread_mutex_t m_pipeMutex;
+  pthread_cond_t  m_pipeCond;
+  bool            m_pipeThreadRunning;
+  bool            m_pipeTerminate;
+  size_t          m_pipeHead; // submitted
+  size_t          m_pipeDone; // processed by DSP
+  size_t          m_pipeTail; // collected
+  long long       m_pipeFrames; // since last report
+  long long       m_pipeDspUs;
+  long long       m_pipeArmUs;
+
+  // split mode: DSP processes top stripes while ARM thread detects in the rest of the frame
+  bool             m_split;
+  ImageDescription m_srcImageDesc;
+  ImageDescription m_dstImageDesc;
+  size_t           m_splitRows;      // wanted DSP rows, adapted from timings
+  size_t           m_splitDspRows;   // DSP rows codec is currently configured for
+  long long        m_splitDspRowNs;  // smoothed per-row costs
+  long long        m_splitArmRowNs;
+  TargetDetectParams m_splitRange;   // last range sent to DSP, ARM follows it
+  bool             m_splitRangeSet;
+  pthread_t        m_splitThread;
+  pthread_mutex_t  m_splitMutex;
+  pthread_cond_t   m_splitCond;
+  bool             m_splitThreadRunning;
+  bool             m_splitTerminate;
+  bool             m_splitJobPending;
+  const void*      m_splitJobSrc;
+  size_t           m_splitJobSrcSize;
+  size_t           m_splitJobRowFirst;
+  TargetLocation   m_splitJobLocation;
+  int              m_splitJobResult;
+  long long        m_splitJobUs;
+  long long        m_splitFrames; // since last report
+  long long        m_splitDspUs;
+  long long        m_splitArmUs;
+  long long        m_splitFrameUs;
 } CodecEngine;
 
 
@@ -50,17 +187,48 @@ int codecEngineStart(CodecEngine* _ce, const CodecEngineConfig* _config,
                      const ImageDescription* _srcImageDesc,
                      const ImageDescription* _dstImageDesc);
 int codecEngineStop(CodecEngine* _ce);
+int codecEngineReconfigure(CodecEngine* _ce, const CodecEngineConfig* _config,
+                           const ImageDescription* _srcImageDesc,
+                           const ImageDescription* _dstImageDesc);
 
 int codecEngineTranscodeFrame(CodecEngine* _ce,
                               const void* _srcFramePtr, size_t _srcFrameSize,
+                              bool _srcFrameContiguous, int _srcFrameFd,
                               void* _dstFramePtr, size_t _dstFrameSize, size_t* _dstFrameUsed,
+                              bool _dstFrameContiguous,
                               const TargetDetectParams* _targetDetectParams,
                               const TargetDetectCommand* _targetDetectCommand,
                               TargetLocation* _targetLocation,
                               TargetDetectParams* _targetDetectParamsResult);
 
 
-int codecEngineReportLoad(const CodecEngine* _ce, long long _ms);
+bool codecEnginePipelined(const CodecEngine* _ce);
+int codecEngineSubmitFrame(CodecEngine* _ce,
+                           const void* _srcFramePtr, size_t _srcFrameSize,
+                           void* _dstFramePtr, size_t _dstFrameSize,
+                           bool _dstFrameContiguous,
+                           const TargetDetectParams* _targetDetectParams,
+                           const TargetDetectCommand* _targetDetectCommand,
+                           const FrameInfo* _frameInfo);
+int codecEngineCollectFrame(CodecEngine* _ce,
+                            void* _dstFramePtr, size_t _dstFrameSize, size_t* _dstFrameUsed,
+                            TargetDetectCommand* _targetDetectCommand,
+                            TargetLocation* _targetLocation,
+                            TargetDetectParams* _targetDetectParamsResult,
+                            FrameInfo* _frameInfo);
+
+
+int codecEngineReportLoad(CodecEngine* _ce, long long _ms, const char* _prefix); // this instance only
+int codecEngineReportServerLoad(CodecEngine* _ce, long long _ms); // DSP server and CMEM pool, shared by all instances
+int codecEngineGetLoad(CodecEngine* _ce, int* _percent); // DSP server CPU load, ENOTSUP in ARM mode
+
+size_t      codecEngineAlgorithms(const CodecEngine* _ce);
+const char* codecEngineAlgorithmName(const CodecEngine* _ce, size_t _algorithm);
+int         codecEngineGetAlgorithmResult(const CodecEngine* _ce, size_t _algorithm, AlgorithmResult* _result);
+
+const char* codecEngineTimingStageName(CodecEngineTimingStage _stage);
+int codecEngineGetTiming(const CodecEngine* _ce, CodecEngineTimingStage _stage, TimingSummary* _summary);
+int codecEngineResetTiming(CodecEngine* _ce);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,42 @@
+#ifndef TRIK_V4L2_DSP_FB_INTERNAL_MODULE_CE_ADAPTER_H_
+#define TRIK_V4L2_DSP_FB_INTERNAL_MODULE_CE_ADAPTER_H_
+
+#include <stddef.h>
+
+#include "internal/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+#define CODEC_ENGINE_ADAPTER_ARGS_SIZE 256 // bytes reserved for InArgs or OutArgs of any adapter
+
+// InArgs/OutArgs layout of one DSP codec. Every sensor header names its args TRIK_VIDTRANSCODE_CV_*,
+// so each adapter is built in own translation unit against its sensor header only.
+typedef struct CodecEngineAdapter
+{
+  const char*         m_codecName;
+  AlgorithmResultType m_resultType;
+  size_t              m_inArgsSize;
+  size_t              m_outArgsSize;
+
+  // args are zeroed and base is filled by caller, adapters handle alg part only
+  void (*m_fillInArgs)(void* _inArgs, const TargetDetectParams* _targetDetectParams);
+  void (*m_readOutArgs)(const void* _outArgs, AlgorithmResult* _result);
+} CodecEngineAdapter;
+
+
+const CodecEngineAdapter* codecEngineAdapterObject();
+const CodecEngineAdapter* codecEngineAdapterLine();
+
+size_t                    codecEngineAdapters();
+const CodecEngineAdapter* codecEngineAdapter(size_t _index);
+const CodecEngineAdapter* codecEngineAdapterFind(const char* _codecName); // NULL when codec args are unknown
+
+
+#ifdef __cplusplus
+} // extern "C"
+#endif // __cplusplus
+
+#endif // !TRIK_V4L2_DSP_FB_INTERNAL_MODULE_CE_ADAPTER_H_
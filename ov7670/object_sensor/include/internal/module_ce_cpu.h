@@ -0,0 +1,69 @@
+#ifndef TRIK_V4L2_DSP_FB_INTERNAL_MODULE_CE_CPU_H_
+#define TRIK_V4L2_DSP_FB_INTERNAL_MODULE_CE_CPU_H_
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "internal/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+#define CODEC_ENGINE_CPU_BLOCKS_X 16
+#define CODEC_ENGINE_CPU_BLOCKS_Y 12
+#define CODEC_ENGINE_CPU_BLOCKS   (CODEC_ENGINE_CPU_BLOCKS_X*CODEC_ENGINE_CPU_BLOCKS_Y)
+
+// ARM implementation of vidtranscode_cv object detection, used when DSP is not available
+typedef struct CodecEngineCpu
+{
+  ImageDescription   m_srcImageDesc;
+  ImageDescription   m_dstImageDesc;
+
+  // pixels are reduced to 16 bit keys (RGB565 or YUV655), classified by lookup
+  bool               m_keyYuv;
+  uint16_t*          m_rowKeys;
+  uint32_t*          m_keyRgb;    // key -> 0x00rrggbb, for preview and auto detection
+  uint8_t*           m_keyMatch;  // key -> in current HSV range
+  TargetDetectParams m_range;
+  bool               m_rangeValid;
+
+  uint32_t           m_blockCount[CODEC_ENGINE_CPU_BLOCKS];
+  uint32_t           m_blockSumX[CODEC_ENGINE_CPU_BLOCKS];
+  uint32_t           m_blockSumY[CODEC_ENGINE_CPU_BLOCKS];
+
+  long long          m_frames; // since last report
+  long long          m_processUs;
+} CodecEngineCpu;
+
+
+int codecEngineCpuStart(CodecEngineCpu* _cpu,
+                        const ImageDescription* _srcImageDesc,
+                        const ImageDescription* _dstImageDesc);
+int codecEngineCpuStop(CodecEngineCpu* _cpu);
+
+int codecEngineCpuProcess(CodecEngineCpu* _cpu,
+                          const void* _srcFramePtr, size_t _srcFrameSize,
+                          void* _dstFramePtr, size_t _dstFrameSize, size_t* _dstFrameUsed,
+                          bool _render,
+                          const TargetDetectParams* _targetDetectParams,
+                          const TargetDetectCommand* _targetDetectCommand,
+                          TargetLocation* _targetLocation,
+                          TargetDetectParams* _targetDetectParamsResult);
+
+// detection only, for a horizontal stripe of the frame; results are relative to whole frame
+int codecEngineCpuDetectRows(CodecEngineCpu* _cpu,
+                             const void* _srcFramePtr, size_t _srcFrameSize,
+                             size_t _rowFirst, size_t _rows,
+                             const TargetDetectParams* _targetDetectParams,
+                             TargetLocation* _targetLocation);
+
+int codecEngineCpuReportLoad(CodecEngineCpu* _cpu, long long _ms, const char* _prefix);
+
+
+#ifdef __cplusplus
+} // extern "C"
+#endif // __cplusplus
+
+#endif // !TRIK_V4L2_DSP_FB_INTERNAL_MODULE_CE_CPU_H_
@@ -2,9 +2,13 @@
 #define TRIK_V4L2_DSP_FB_INTERNAL_MODULE_FB_H_
 
 #include <stdbool.h>
+#include <inttypes.h>
 
 #include <linux/fb.h>
 
+#include <xdc/std.h>
+#include <ti/sdo/ce/osal/Memory.h>
+
 #include "internal/common.h"
 
 #ifdef __cplusplus
@@ -15,15 +19,89 @@ extern "C" {
 typedef struct FBConfig // what user wants to set
 {
   const char* m_path;
+  bool        m_direct; // let DSP render into framebuffer memory if possible
+  bool        m_pageFlip; // render into hidden half of double height virtual screen and pan to it
+  bool        m_vsync;    // wait for vertical sync after each flip
+  bool        m_overlay;  // draw target markers on screen while video out is disabled
+  bool        m_sync;     // open device with O_SYNC
+  bool        m_blitBenchmark; // compare memcpy and blit into framebuffer memory on open
+
+  const char* m_shmPath;  // publish preview into shared memory ring file instead of framebuffer device
+  size_t      m_shmSlots;
+  size_t      m_shmWidth;
+  size_t      m_shmHeight;
 } FBConfig;
 
+// Shared memory preview ring: header, then m_slots slots of m_slotSize bytes starting at m_slotOffset,
+// each slot is FBShmSlot followed by frame at m_frameOffset from slot start.
+// Readers take m_latest slot and use frame in place; slot is valid if its m_sequence was even
+// and did not change while frame was used (writer makes it odd before touching the frame).
+#define FB_SHM_MAGIC   0x4d485346u // "FSHM"
+#define FB_SHM_VERSION 1
+#define FB_SHM_NO_SLOT 0xffffffffu
+
+typedef struct FBShmHeader
+{
+  volatile uint32_t m_magic; // written last on open
+  uint32_t          m_version;
+  uint32_t          m_slots;
+  uint32_t          m_slotOffset;
+  uint32_t          m_slotSize;
+  uint32_t          m_frameOffset;
+  uint32_t          m_width;
+  uint32_t          m_height;
+  uint32_t          m_lineLength;
+  uint32_t          m_format;  // V4L2 fourcc
+  volatile uint32_t m_latest;  // newest complete slot, FB_SHM_NO_SLOT before first frame
+} FBShmHeader;
+
+typedef struct FBShmSlot
+{
+  volatile uint32_t m_sequence;    // odd while being written
+  uint32_t          m_frameSize;
+  int64_t           m_timestampUs; // publish time, CLOCK_MONOTONIC
+  uint64_t          m_frameNumber;
+} FBShmSlot;
+
+#define FB_OVERLAY_TARGET_RECTS 6 // crosshair lines and size box edges
+#define FB_OVERLAY_MAX_RECTS    (MAX_OBJECTS_N*FB_OVERLAY_TARGET_RECTS)
+
+typedef struct FBOverlayRect
+{
+  size_t m_x;
+  size_t m_y;
+  size_t m_width;
+  size_t m_height;
+} FBOverlayRect;
+
 typedef struct FBOutput
 {
   int                      m_fd;
   struct fb_fix_screeninfo m_fbFixInfo;
   struct fb_var_screeninfo m_fbVarInfo;
+  struct fb_var_screeninfo m_fbVarInfoOrig; // restored on close when virtual resolution was changed
   void*                    m_fbPtr;
   size_t                   m_fbSize;
+  bool                     m_fbContiguous; // mapping registered with codec engine memory
+
+  size_t                   m_fbPages;     // 2 when page flipping works, 1 otherwise
+  size_t                   m_fbPageSize;
+  size_t                   m_fbBackPage;  // rendered into, shown on next put
+  bool                     m_fbVsync;
+
+  ImageDescription         m_fbImageDesc;     // format detected from screen info bitfields
+  ImageDescription         m_renderImageDesc; // what codec renders, differs when framebuffer format is not a codec output
+  void*                    m_renderBuffer;    // converted into back page on put, NULL when codec renders framebuffer format
+
+  bool                     m_overlay;
+  bool                     m_overlayActive;   // screen was cleared and holds only rects below
+  TargetLocation           m_overlayTargets;
+  FBOverlayRect            m_overlayRects[FB_OVERLAY_MAX_RECTS];
+  size_t                   m_overlayRectsN;
+
+  FBShmHeader*             m_shmHeader;   // NULL for framebuffer device
+  size_t                   m_shmSlot;     // written into, published on next put
+  uint64_t                 m_shmFrames;
 } FBOutput;
 
 
@@ -36,8 +114,11 @@ int fbOutputStart(FBOutput* _fb);
 int fbOutputStop(FBOutput* _fb);
 int fbOutputGetFrame(FBOutput* _fb, void** _framePtr, size_t* _frameSize);
 int fbOutputPutFrame(FBOutput* _fb);
+int fbOutputDrawTargets(FBOutput* _fb, const TargetLocation* _targetLocation); // ENOTSUP unless overlay enabled
 
 int fbOutputGetFormat(FBOutput* _fb, ImageDescription* _imageDesc);
+bool fbOutputFrameContiguous(const FBOutput* _fb);
+bool fbOutputPageFlipping(const FBOutput* _fb);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,28 @@
+#ifndef TRIK_V4L2_DSP_FB_INTERNAL_MODULE_FB_CONVERT_H_
+#define TRIK_V4L2_DSP_FB_INTERNAL_MODULE_FB_CONVERT_H_
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "internal/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+// preview format codec renders into when framebuffer format is not one of its outputs, 0 if none fits
+uint32_t fbConvertRenderFormat(uint32_t _fbFormat);
+
+bool fbConvertSupported(uint32_t _srcFormat, uint32_t _dstFormat);
+
+// images of same size, rows are converted one by one so line lengths may differ
+int fbConvertFrame(const ImageDescription* _srcImageDesc, const void* _srcFramePtr,
+                   const ImageDescription* _dstImageDesc, void* _dstFramePtr);
+
+
+#ifdef __cplusplus
+} // extern "C"
+#endif // __cplusplus
+
+#endif // !TRIK_V4L2_DSP_FB_INTERNAL_MODULE_FB_CONVERT_H_
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 
 #include "internal/common.h"
+#include "internal/timing.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -16,6 +17,8 @@ typedef struct RCConfig // what user wants to set
   const char* m_fifoOutput;
   bool m_videoOutEnable;
   int m_objectsN;
+  bool m_reportTimestamp;
+  const char* m_fifoAlgorithmOutput[MAX_ALGORITHMS_N]; // NULL reports extra algorithm to main output
 } RCConfig;
 
 typedef struct RCInput
@@ -29,6 +32,9 @@ typedef struct RCInput
   int                      m_fifoOutputFd;
   char*                    m_fifoOutputName;
 
+  int                      m_fifoAlgorithmOutputFd[MAX_ALGORITHMS_N];
+  char*                    m_fifoAlgorithmOutputName[MAX_ALGORITHMS_N];
+
   bool                     m_targetDetectParamsUpdated;
   int                      m_targetDetectHue;
   int                      m_targetDetectHueTolerance;
@@ -40,9 +46,20 @@ typedef struct RCInput
   bool                     m_targetDetectCommandUpdated;
   int                      m_targetDetectCommand;
 
+  bool                     m_videoFormatCommandUpdated;
+  VideoFormatCommand       m_videoFormatCommand;
+
+  bool                     m_timingCommandUpdated;
+  int                      m_timingCommand; // 1 report, 2 reset
+
   bool                     m_videoOutParamsUpdated;
   bool                     m_videoOutEnable;
   int                      m_objectsN;
+
+  bool                     m_reportTimestamp;
+  long long                m_latencyCount; // capture to report, since last stats report
+  long long                m_latencySumUs;
+  long long                m_latencyMaxUs;
 } RCInput;
 
 
@@ -62,9 +79,14 @@ int rcInputGetTargetDetectParams(RCInput* _rc, TargetDetectParams* _targetDetect
 int rcInputGetTargetDetectCommand(RCInput* _rc, TargetDetectCommand* _targetDetectCommand);
 
 int rcInputGetVideoOutParams(RCInput* _rc, bool *_videoOutEnable);
-
-int rcInputUnsafeReportTargetLocation(RCInput* _rc, const TargetLocation* _targetLocation);
-int rcInputUnsafeReportTargetDetectParams(RCInput* _rc, const TargetDetectParams* _targetDetectParams);
+int rcInputGetVideoFormatCommand(RCInput* _rc, VideoFormatCommand* _videoFormatCommand);
+int rcInputGetTimingCommand(RCInput* _rc, int* _timingCommand);
+
+int rcInputUnsafeReportTargetLocation(RCInput* _rc, const TargetLocation* _targetLocation, const FrameInfo* _frameInfo);
+int rcInputUnsafeReportAlgorithmResult(RCInput* _rc, size_t _algorithm, const AlgorithmResult* _result, const FrameInfo* _frameInfo);
+int rcInputUnsafeReportTargetDetectParams(RCInput* _rc, const TargetDetectParams* _targetDetectParams, const FrameInfo* _frameInfo);
+int rcInputUnsafeReportLatency(RCInput* _rc, long long _ms);
+int rcInputUnsafeReportTiming(RCInput* _rc, uint32_t _camera, const char* _stage, const TimingSummary* _summary);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,72 @@
+#ifndef TRIK_V4L2_DSP_FB_INTERNAL_MODULE_RECORDER_H_
+#define TRIK_V4L2_DSP_FB_INTERNAL_MODULE_RECORDER_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <linux/videodev2.h>
+
+#include "internal/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+#define RECORDER_MAX_QUEUE 16
+
+typedef struct RecorderConfig // what user wants to set
+{
+  const char* m_path;       // ring file in replay format, recording disabled if not set
+  size_t      m_fileFrames; // ring length
+  size_t      m_queueFrames;
+  size_t      m_camera;     // only frames of this camera are recorded
+} RecorderConfig;
+
+typedef struct Recorder
+{
+  int                      m_fd;
+  bool                     m_direct; // O_DIRECT accepted by file system
+
+  size_t                   m_frameSize;
+  size_t                   m_frameOffset;
+  size_t                   m_frameStride;
+  size_t                   m_fileHeaderSize;
+  size_t                   m_fileFrames;
+  size_t                   m_fileFrameIndex; // total slots written, ring position is modulo m_fileFrames
+
+  // single producer (video thread), single consumer (writer thread)
+  pthread_t                m_thread;
+  pthread_mutex_t          m_mutex;
+  pthread_cond_t           m_cond;
+  bool                     m_threadRunning;
+  bool                     m_threadTerminate;
+  void*                    m_queue[RECORDER_MAX_QUEUE];
+  size_t                   m_queueFrames;
+  size_t                   m_queueHead;
+  size_t                   m_queueTail;
+  int                      m_writeError;
+
+  size_t                   m_frameRecorded;
+  size_t                   m_frameDropped; // writer lagging behind, since last report
+} Recorder;
+
+
+
+
+int recorderInit(bool _verbose);
+int recorderFini();
+
+int recorderOpen(Recorder* _rec, const RecorderConfig* _config, const struct v4l2_format* _format);
+int recorderClose(Recorder* _rec);
+int recorderStart(Recorder* _rec);
+int recorderStop(Recorder* _rec);
+
+int recorderPushFrame(Recorder* _rec, const void* _framePtr, size_t _frameSize, const FrameInfo* _frameInfo);
+
+int recorderReportStats(Recorder* _rec, long long _ms);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif // __cplusplus
+
+#endif // !TRIK_V4L2_DSP_FB_INTERNAL_MODULE_RECORDER_H_
@@ -4,6 +4,9 @@
 #include <stdbool.h>
 #include <linux/videodev2.h>
 
+#include <xdc/std.h>
+#include <ti/sdo/ce/osal/Memory.h>
+
 #include "internal/common.h"
 
 #ifdef __cplusplus
@@ -11,26 +14,62 @@ extern "C" {
 #endif // __cplusplus
 
 
+#define V4L2_INPUT_MAX_BUFFERS 8
+
 typedef struct V4L2Config // what user wants to set
 {
   const char* m_path;
   size_t      m_width;
   size_t      m_height;
-  uint32_t    m_format;
+  uint32_t    m_format; // 0 to pick cheapest native format
+  uint32_t    m_memory; // V4L2_MEMORY_DMABUF (exported mmap), V4L2_MEMORY_USERPTR, V4L2_MEMORY_MMAP or 0 to negotiate in that order
+  size_t      m_buffers;
+  bool        m_lowLatency; // only the freshest of ready frames is returned, stale ones are requeued
+  const char* m_replayPath; // recorded frames file used instead of m_path, if set
+  size_t      m_replayFps;  // 0 to replay as fast as possible
+  struct v4l2_rect m_crop;  // sensor window, full frame if width or height is 0; format size follows it
+  size_t      m_fps;        // 0 to keep driver default
 } V4L2Config;
 
 typedef struct V4L2Input
 {
   int                    m_fd;
   long long              m_frameCounter;
+  long long              m_frameSkipped;
+  long long              m_frameDropped; // sequence gaps, frames lost by driver
+  bool                   m_sequenceValid;
+  uint32_t               m_sequenceLast;
+  bool                   m_lowLatency;
   struct v4l2_format     m_imageFormat;
-
-  void*                  m_buffers[3];
-  size_t                 m_bufferSize[3];
+  struct v4l2_rect       m_crop; // from config, applied again on every format change
+  size_t                 m_fps;
+
+  enum v4l2_memory       m_memory;
+  Memory_AllocParams     m_allocParams; // userptr buffers only
+
+  size_t                 m_bufferCount; // requested, driver may return less
+  void*                  m_buffers[V4L2_INPUT_MAX_BUFFERS];
+  size_t                 m_bufferSize[V4L2_INPUT_MAX_BUFFERS];
+  int                    m_bufferFd[V4L2_INPUT_MAX_BUFFERS]; // dmabuf exported with VIDIOC_EXPBUF, or -1
+
+  bool                   m_replay; // frames come from recorded file, m_fd is pacing timer
+  int                    m_replayFileFd;
+  const uint8_t*         m_replayPtr;
+  size_t                 m_replaySize;
+  size_t                 m_replayFrameOffset;
+  size_t                 m_replayFrameStride;
+  size_t                 m_replayFrameCount;
+  size_t                 m_replayFrameIndex;
+  size_t                 m_replayFrameFirst; // oldest frame of a wrapped ring recording
+  bool                   m_replayFrameHeaders;
+  uint32_t               m_replaySequence; // frames served since start, sequence of files without frame headers
+  size_t                 m_replayFps;
 } V4L2Input;
 
 
 
+bool v4l2InputFormatByName(const char* _name, uint32_t* _format);
+
 int v4l2InputInit(bool _verbose);
 int v4l2InputFini();
 
@@ -38,10 +77,14 @@ int v4l2InputOpen(V4L2Input* _v4l2, const V4L2Config* _config);
 int v4l2InputClose(V4L2Input* _v4l2);
 int v4l2InputStart(V4L2Input* _v4l2);
 int v4l2InputStop(V4L2Input* _v4l2);
-int v4l2InputGetFrame(V4L2Input* _v4l2, const void** _framePtr, size_t* _frameSize, size_t* _frameIndex);
+int v4l2InputGetFrame(V4L2Input* _v4l2, const void** _framePtr, size_t* _frameSize, size_t* _frameIndex,
+                      FrameInfo* _frameInfo);
 int v4l2InputPutFrame(V4L2Input* _v4l2, size_t _frameIndex);
 
 int v4l2InputGetFormat(V4L2Input* _v4l2, ImageDescription* _imageDesc);
+int v4l2InputSetFormat(V4L2Input* _v4l2, size_t _width, size_t _height, uint32_t _format); // stopped input only
+bool v4l2InputFramesContiguous(const V4L2Input* _v4l2);
+int  v4l2InputFrameFd(const V4L2Input* _v4l2, size_t _frameIndex);
 
 int v4l2InputReportFPS(V4L2Input* _v4l2, long long _ms);
 
@@ -0,0 +1,53 @@
+#ifndef TRIK_V4L2_DSP_FB_INTERNAL_MODULE_V4L2_REPLAY_H_
+#define TRIK_V4L2_DSP_FB_INTERNAL_MODULE_V4L2_REPLAY_H_
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "internal/common.h"
+#include "internal/module_v4l2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+#define V4L2_REPLAY_MAGIC "TRIKRAW"
+
+// recorded file layout: header, then frame slots of m_frameStride bytes each
+typedef struct V4L2ReplayFileHeader
+{
+  char     m_magic[8];
+  uint32_t m_headerSize;  // offset of the first frame slot
+  uint32_t m_width;
+  uint32_t m_height;
+  uint32_t m_format;      // V4L2 fourcc
+  uint32_t m_lineLength;
+  uint32_t m_frameSize;
+  uint32_t m_frameOffset; // pixel data offset within frame slot
+  uint32_t m_frameStride;
+} V4L2ReplayFileHeader;
+
+// optional, immediately precedes pixel data when m_frameOffset leaves room for it
+typedef struct V4L2ReplayFrameHeader
+{
+  uint32_t m_sequence;
+  uint32_t m_frameSize;   // 0 for a slot never written
+  int64_t  m_timestampUs; // capture time, CLOCK_MONOTONIC
+} V4L2ReplayFrameHeader;
+
+
+int v4l2ReplayOpen(V4L2Input* _v4l2, const V4L2Config* _config);
+int v4l2ReplayClose(V4L2Input* _v4l2);
+int v4l2ReplayStart(V4L2Input* _v4l2);
+int v4l2ReplayStop(V4L2Input* _v4l2);
+int v4l2ReplayGetFrame(V4L2Input* _v4l2, const void** _framePtr, size_t* _frameSize, size_t* _frameIndex,
+                       FrameInfo* _frameInfo);
+int v4l2ReplayPutFrame(V4L2Input* _v4l2, size_t _frameIndex);
+
+
+#ifdef __cplusplus
+} // extern "C"
+#endif // __cplusplus
+
+#endif // !TRIK_V4L2_DSP_FB_INTERNAL_MODULE_V4L2_REPLAY_H_
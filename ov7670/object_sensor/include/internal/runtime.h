@@ -8,6 +8,7 @@
 #include "internal/module_fb.h"
 #include "internal/module_v4l2.h"
 #include "internal/module_rc.h"
+#include "internal/module_recorder.h"
 
 
 #ifdef __cplusplus
@@ -15,22 +16,36 @@ extern "C" {
 #endif // __cplusplus
 
 
+#define RUNTIME_MAX_CAMERAS 4
+
+typedef enum RuntimeCameraSchedule
+{
+  RUNTIME_CAMERA_SCHEDULE_ROUND_ROBIN = 0, // next ready camera after the last served one
+  RUNTIME_CAMERA_SCHEDULE_PRIORITY         // lowest ready camera id first
+} RuntimeCameraSchedule;
+
 typedef struct RuntimeConfig
 {
   bool               m_verbose;
 
   CodecEngineConfig  m_codecEngineConfig;
-  V4L2Config         m_v4l2Config;
+  V4L2Config         m_v4l2Config[RUNTIME_MAX_CAMERAS];
+  size_t             m_cameras;
+  RuntimeCameraSchedule m_cameraSchedule;
+  size_t             m_previewCamera; // only this camera renders into framebuffer
+  size_t             m_latencyBoundMs; // capture to result, frames are decimated or skipped to keep it; 0 disables
   FBConfig           m_fbConfig;
   RCConfig           m_rcConfig;
+  RecorderConfig     m_recorderConfig;
 } RuntimeConfig;
 
 typedef struct RuntimeModules
 {
-  CodecEngine  m_codecEngine;
-  V4L2Input    m_v4l2Input;
+  CodecEngine  m_codecEngine[RUNTIME_MAX_CAMERAS]; // codec instance per camera, sharing one DSP server
+  V4L2Input    m_v4l2Input[RUNTIME_MAX_CAMERAS];
   FBOutput     m_fbOutput;
   RCInput      m_rcInput;
+  Recorder     m_recorder;
 } RuntimeModules;
 
 typedef struct RuntimeThreads
@@ -47,6 +62,8 @@ typedef struct RuntimeState
   TargetDetectParams      m_targetDetectParams;
   TargetDetectCommand     m_targetDetectCommand;
   bool                    m_videoOutEnable;
+  VideoFormatCommand      m_videoFormatCommand;
+  int                     m_timingCommand; // fifo "stats" 1, "stats reset" 2, 0 nothing to do
 } RuntimeState;
 
 typedef struct Runtime
@@ -71,14 +88,20 @@ int runtimeStop(Runtime* _runtime);
 
 bool                     runtimeCfgVerbose(const Runtime* _runtime);
 const CodecEngineConfig* runtimeCfgCodecEngine(const Runtime* _runtime);
-const V4L2Config*        runtimeCfgV4L2Input(const Runtime* _runtime);
+const V4L2Config*        runtimeCfgV4L2Input(const Runtime* _runtime, size_t _camera);
+size_t                   runtimeCfgCameras(const Runtime* _runtime);
+RuntimeCameraSchedule    runtimeCfgCameraSchedule(const Runtime* _runtime);
+size_t                   runtimeCfgPreviewCamera(const Runtime* _runtime);
+size_t                   runtimeCfgLatencyBoundMs(const Runtime* _runtime);
 const FBConfig*          runtimeCfgFBOutput(const Runtime* _runtime);
 const RCConfig*          runtimeCfgRCInput(const Runtime* _runtime);
+const RecorderConfig*    runtimeCfgRecorder(const Runtime* _runtime);
 
-CodecEngine*  runtimeModCodecEngine(Runtime* _runtime);
-V4L2Input*    runtimeModV4L2Input(Runtime* _runtime);
+CodecEngine*  runtimeModCodecEngine(Runtime* _runtime, size_t _camera);
+V4L2Input*    runtimeModV4L2Input(Runtime* _runtime, size_t _camera);
 FBOutput*     runtimeModFBOutput(Runtime* _runtime);
 RCInput*      runtimeModRCInput(Runtime* _runtime);
+Recorder*     runtimeModRecorder(Runtime* _runtime);
 
 
 bool runtimeGetTerminate(Runtime* _runtime);
@@ -88,11 +111,23 @@ int  runtimeSetTargetDetectParams(Runtime* _runtime, const TargetDetectParams* _
 int  runtimeFetchTargetDetectCommand(Runtime* _runtime, TargetDetectCommand* _targetDetectCommand);
 int  runtimeSetTargetDetectCommand(Runtime* _runtime, const TargetDetectCommand* _targetDetectCommand);
 
+int  runtimeFetchVideoFormatCommand(Runtime* _runtime, VideoFormatCommand* _videoFormatCommand);
+int  runtimeSetVideoFormatCommand(Runtime* _runtime, const VideoFormatCommand* _videoFormatCommand);
+
+int  runtimeFetchTimingCommand(Runtime* _runtime, int* _timingCommand);
+int  runtimeSetTimingCommand(Runtime* _runtime, const int* _timingCommand);
+
 int runtimeGetVideoOutParams(Runtime* _runtime, bool* _videoOutEnable);
 int runtimeSetVideoOutParams(Runtime* _runtime, const bool* _videoOutEnable);
 
-int  runtimeReportTargetLocation(Runtime* _runtime, const TargetLocation* _targetLocation);
-int  runtimeReportTargetDetectParams(Runtime* _runtime, const TargetDetectParams* _targetDetectParams);
+int  runtimeReportTargetLocation(Runtime* _runtime, const TargetLocation* _targetLocation, const FrameInfo* _frameInfo);
+int  runtimeReportTargetDetectParams(Runtime* _runtime, const TargetDetectParams* _targetDetectParams, const FrameInfo* _frameInfo);
+int  runtimeReportAlgorithmResult(Runtime* _runtime, size_t _algorithm, const AlgorithmResult* _result, const FrameInfo* _frameInfo);
+// reports write rc output and latency counters, call them from video thread only
+int  runtimeReportLatency(Runtime* _runtime, long long _ms);
+int  runtimeReportTiming(Runtime* _runtime);
+int  runtimeResetTiming(Runtime* _runtime);
+int  runtimeWriteTimingFile(Runtime* _runtime);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,50 @@
+#ifndef TRIK_V4L2_DSP_FB_INTERNAL_TIMING_H_
+#define TRIK_V4L2_DSP_FB_INTERNAL_TIMING_H_
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+// log-linear buckets: exact below 8us, then 8 buckets per power of two (~6% resolution)
+#define TIMING_HISTOGRAM_SUB_BUCKETS 8
+#define TIMING_HISTOGRAM_BUCKETS     240
+
+// writers and readers in different threads, no locking; a reader may see a sample half accounted
+typedef struct TimingHistogram
+{
+  volatile uint32_t m_buckets[TIMING_HISTOGRAM_BUCKETS];
+  volatile uint64_t m_count;
+  volatile uint64_t m_sumUs;
+  volatile uint32_t m_minUs;
+  volatile uint32_t m_maxUs;
+} TimingHistogram;
+
+typedef struct TimingSummary
+{
+  uint64_t m_count;
+  uint32_t m_minUs;
+  uint32_t m_meanUs;
+  uint32_t m_p50Us;
+  uint32_t m_p99Us;
+  uint32_t m_maxUs;
+} TimingSummary;
+
+
+void timingHistogramReset(TimingHistogram* _histogram);
+void timingHistogramAdd(TimingHistogram* _histogram, long long _us);
+void timingHistogramSummary(const TimingHistogram* _histogram, TimingSummary* _summary);
+
+// "<count> <min> <mean> <p50> <p99> <max>", microseconds
+int timingSummaryFormat(const TimingSummary* _summary, char* _buf, size_t _bufSize);
+
+
+#ifdef __cplusplus
+} // extern "C"
+#endif // __cplusplus
+
+#endif // !TRIK_V4L2_DSP_FB_INTERNAL_TIMING_H_
@@ -0,0 +1,76 @@
+#include "config.h"
+#include <string.h>
+#include <inttypes.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BLIT_NEON 1
+#endif
+
+#include "internal/blit.h"
+
+
+#define BLIT_PREFETCH_DISTANCE 256 // bytes ahead of loads, a few cache lines on Cortex-A8
+
+
+// framebuffer is uncached or write-combined, so stores go out in full 64 byte bursts
+static void do_blitRun(uint8_t* restrict _dst, const uint8_t* restrict _src, size_t _bytes)
+{
+#ifdef BLIT_NEON
+  while (_bytes >= 64)
+  {
+    __builtin_prefetch(_src + BLIT_PREFETCH_DISTANCE);
+    const uint8x16_t a = vld1q_u8(_src);
+    const uint8x16_t b = vld1q_u8(_src + 16);
+    const uint8x16_t c = vld1q_u8(_src + 32);
+    const uint8x16_t d = vld1q_u8(_src + 48);
+    vst1q_u8(_dst,      a);
+    vst1q_u8(_dst + 16, b);
+    vst1q_u8(_dst + 32, c);
+    vst1q_u8(_dst + 48, d);
+    _src   += 64;
+    _dst   += 64;
+    _bytes -= 64;
+  }
+#endif
+
+  memcpy(_dst, _src, _bytes);
+}
+
+
+
+
+void blitCopy(void* _dst, const void* _src, size_t _bytes)
+{
+  if (_dst == NULL || _src == NULL)
+    return;
+
+  do_blitRun((uint8_t*)_dst, (const uint8_t*)_src, _bytes);
+}
+
+void blitRows(void* _dst, size_t _dstLineLength,
+              const void* _src, size_t _srcLineLength,
+              size_t _rowBytes, size_t _rows)
+{
+  uint8_t* dst = (uint8_t*)_dst;
+  const uint8_t* src = (const uint8_t*)_src;
+  size_t row;
+
+  if (_dst == NULL || _src == NULL || _rowBytes == 0 || _rows == 0)
+    return;
+
+  if (_dstLineLength == _rowBytes && _srcLineLength == _rowBytes)
+  {
+    do_blitRun(dst, src, _rowBytes*_rows);
+    return;
+  }
+
+  for (row = 0; row < _rows; ++row)
+  {
+    __builtin_prefetch(src + _srcLineLength);
+    do_blitRun(dst, src, _rowBytes);
+    dst += _dstLineLength;
+    src += _srcLineLength;
+  }
+}
+
@@ -1,7 +1,11 @@
 #include "config.h"
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include <xdc/std.h>
 #include <xdc/runtime/Diags.h>
@@ -13,6 +17,7 @@
 #include "trik_vidtranscode_cv.h"
 
 #include "internal/module_ce.h"
+#include "internal/blit.h"
 
 
 #warning Check BUFALIGN usage!
@@ -24,18 +29,267 @@
 
 
 static bool s_verbose = false;
+static bool s_engineAdded = false; // one "dsp-server" registration shared by all cameras, removed in fini
 
 
+static long long do_nowUs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec*1000000 + now.tv_nsec/1000;
+}
+
+static const char* do_cacheModeName(CodecEngineCacheMode _mode)
+{
+  switch (_mode)
+  {
+    case CODEC_ENGINE_CACHE_RANGE: return "range";
+    case CODEC_ENGINE_CACHE_WHOLE: return "whole";
+    case CODEC_ENGINE_CACHE_NONE:  return "none";
+    default:                       return "unknown";
+  }
+}
+
+static void do_cacheAllocParams(Memory_AllocParams* _allocParams, CodecEngineCacheMode _mode)
+{
+  memset(_allocParams, 0, sizeof(*_allocParams));
+  _allocParams->type = Memory_CONTIGPOOL;
+  _allocParams->flags = _mode == CODEC_ENGINE_CACHE_NONE ? Memory_NONCACHED : Memory_CACHED;
+  _allocParams->align = BUFALIGN;
+  _allocParams->seg = 0;
+}
+
+// buffers are BUFALIGN aligned and sized, so rounding up never touches a neighbour
+static size_t do_cacheRange(size_t _used, size_t _bufferSize)
+{
+  _used = ALIGN_UP(_used, BUFALIGN);
+  return _used < _bufferSize ? _used : _bufferSize;
+}
+
+// ARM wrote [0, _written) of a buffer DSP is about to read
+static void do_cacheArmToDsp(CodecEngineCacheMode _mode, void* _buffer, size_t _bufferSize, size_t _written)
+{
+  switch (_mode)
+  {
+    case CODEC_ENGINE_CACHE_RANGE: Memory_cacheWb(_buffer, do_cacheRange(_written, _bufferSize)); break;
+    case CODEC_ENGINE_CACHE_WHOLE: Memory_cacheWbInv(_buffer, _bufferSize); break;
+    case CODEC_ENGINE_CACHE_NONE:  break;
+  }
+}
+
+// DSP is about to write a buffer ARM never writes; it was cleaned on allocation, so only whole mode has work here
+static void do_cacheDspWriteBegin(CodecEngineCacheMode _mode, void* _buffer, size_t _bufferSize)
+{
+  if (_mode == CODEC_ENGINE_CACHE_WHOLE)
+    Memory_cacheInv(_buffer, _bufferSize);
+}
+
+// ARM is about to read [0, _read) written by DSP; drops lines speculatively fetched meanwhile
+static void do_cacheDspToArm(CodecEngineCacheMode _mode, void* _buffer, size_t _bufferSize, size_t _read)
+{
+  if (_mode == CODEC_ENGINE_CACHE_RANGE)
+    Memory_cacheInv(_buffer, do_cacheRange(_read, _bufferSize));
+}
+
+// Codec buffers come from one CMEM arena reserved when the first engine opens, so codec restarts
+// and format changes recycle the same memory instead of fragmenting CMEM pool.
+// Used from video thread only.
+#define POOL_MAX_BLOCKS 64
+
+typedef struct PoolBlock
+{
+  size_t m_offset;
+  size_t m_size;
+  bool   m_used;
+} PoolBlock;
+
+static struct
+{
+  uint8_t*           m_arena;
+  size_t             m_size;
+  Memory_AllocParams m_allocParams;
+  PoolBlock          m_blocks[POOL_MAX_BLOCKS]; // sorted by offset, covering whole arena
+  size_t             m_blockCount;
+  size_t             m_used;
+  size_t             m_usedPeak;
+  size_t             m_fallbacks; // served by Memory_alloc, arena full or buffer not cached
+} s_pool;
+
+static int do_poolReserve(size_t _size)
+{
+  if (s_pool.m_arena != NULL || _size == 0)
+    return 0;
+
+  do_cacheAllocParams(&s_pool.m_allocParams, CODEC_ENGINE_CACHE_RANGE);
+  s_pool.m_size = ALIGN_UP(_size, BUFALIGN);
+  if ((s_pool.m_arena = Memory_alloc(s_pool.m_size, &s_pool.m_allocParams)) == NULL)
+  {
+    fprintf(stderr, "Memory_alloc(pool, %zu) failed, codec buffers are allocated one by one\n", s_pool.m_size);
+    s_pool.m_size = 0;
+    return ENOMEM;
+  }
+
+  s_pool.m_blocks[0].m_offset = 0;
+  s_pool.m_blocks[0].m_size   = s_pool.m_size;
+  s_pool.m_blocks[0].m_used   = false;
+  s_pool.m_blockCount = 1;
+  s_pool.m_used       = 0;
+  s_pool.m_usedPeak   = 0;
+  s_pool.m_fallbacks  = 0;
+
+  return 0;
+}
+
+static void do_poolRelease()
+{
+  if (s_pool.m_arena == NULL)
+    return;
+
+  if (s_pool.m_used != 0)
+    fprintf(stderr, "Pool released with %zu bytes still in use\n", s_pool.m_used);
+  Memory_free(s_pool.m_arena, s_pool.m_size, &s_pool.m_allocParams);
+  memset(&s_pool, 0, sizeof(s_pool));
+}
+
+static bool do_poolOwns(const void* _buffer)
+{
+  return    s_pool.m_arena != NULL
+         && (const uint8_t*)_buffer >= s_pool.m_arena
+         && (const uint8_t*)_buffer <  s_pool.m_arena + s_pool.m_size;
+}
+
+// best fit, so large frame sized holes are not nibbled away by small buffers
+static void* do_poolAlloc(size_t _size)
+{
+  const size_t size = ALIGN_UP(_size, BUFALIGN);
+  size_t best = s_pool.m_blockCount;
+  size_t idx;
+
+  for (idx = 0; idx < s_pool.m_blockCount; ++idx)
+  {
+    const PoolBlock* block = &s_pool.m_blocks[idx];
+    if (!block->m_used && block->m_size >= size && (best == s_pool.m_blockCount || block->m_size < s_pool.m_blocks[best].m_size))
+      best = idx;
+  }
+  if (best == s_pool.m_blockCount)
+    return NULL;
+
+  PoolBlock* block = &s_pool.m_blocks[best];
+  if (block->m_size > size && s_pool.m_blockCount < POOL_MAX_BLOCKS)
+  {
+    memmove(block+2, block+1, (s_pool.m_blockCount-best-1)*sizeof(*block));
+    block[1].m_offset = block->m_offset + size;
+    block[1].m_size   = block->m_size - size;
+    block[1].m_used   = false;
+    block->m_size = size;
+    ++s_pool.m_blockCount;
+  }
+  block->m_used = true;
+
+  s_pool.m_used += block->m_size;
+  if (s_pool.m_usedPeak < s_pool.m_used)
+    s_pool.m_usedPeak = s_pool.m_used;
+
+  return s_pool.m_arena + block->m_offset;
+}
+
+static void do_poolFree(void* _buffer)
+{
+  const size_t offset = (uint8_t*)_buffer - s_pool.m_arena;
+  size_t idx;
+
+  for (idx = 0; idx < s_pool.m_blockCount; ++idx)
+    if (s_pool.m_blocks[idx].m_offset == offset && s_pool.m_blocks[idx].m_used)
+      break;
+  if (idx == s_pool.m_blockCount)
+  {
+    fprintf(stderr, "Pool free of unknown buffer %p\n", _buffer);
+    return;
+  }
+
+  s_pool.m_blocks[idx].m_used = false;
+  s_pool.m_used -= s_pool.m_blocks[idx].m_size;
+
+  // coalesce with free neighbours
+  if (idx+1 < s_pool.m_blockCount && !s_pool.m_blocks[idx+1].m_used)
+  {
+    s_pool.m_blocks[idx].m_size += s_pool.m_blocks[idx+1].m_size;
+    memmove(&s_pool.m_blocks[idx+1], &s_pool.m_blocks[idx+2], (s_pool.m_blockCount-idx-2)*sizeof(PoolBlock));
+    --s_pool.m_blockCount;
+  }
+  if (idx > 0 && !s_pool.m_blocks[idx-1].m_used)
+  {
+    s_pool.m_blocks[idx-1].m_size += s_pool.m_blocks[idx].m_size;
+    memmove(&s_pool.m_blocks[idx], &s_pool.m_blocks[idx+1], (s_pool.m_blockCount-idx-1)*sizeof(PoolBlock));
+    --s_pool.m_blockCount;
+  }
+}
+
+static void do_poolReport()
+{
+  if (s_pool.m_arena == NULL)
+    return;
+
+  size_t freeBytes = 0, freeBlocks = 0, largest = 0, idx;
+  for (idx = 0; idx < s_pool.m_blockCount; ++idx)
+  {
+    if (s_pool.m_blocks[idx].m_used)
+      continue;
+    freeBytes += s_pool.m_blocks[idx].m_size;
+    ++freeBlocks;
+    if (largest < s_pool.m_blocks[idx].m_size)
+      largest = s_pool.m_blocks[idx].m_size;
+  }
+
+  // share of free memory not usable for one largest allocation
+  const size_t fragmentation = freeBytes > 0 ? ((freeBytes - largest)*100)/freeBytes : 0;
+  fprintf(stderr, "Codec buffer pool %zu KiB: used %zu KiB (peak %zu KiB), free %zu KiB in %zu blocks, largest %zu KiB, "
+                  "fragmentation %zu%%, fallback allocations %zu\n",
+          s_pool.m_size/1024, s_pool.m_used/1024, s_pool.m_usedPeak/1024,
+          freeBytes/1024, freeBlocks, largest/1024, fragmentation, s_pool.m_fallbacks);
+}
+
+static void* do_bufferAlloc(size_t _size, Memory_AllocParams* _allocParams)
+{
+  if (s_pool.m_arena != NULL && _allocParams->flags == s_pool.m_allocParams.flags)
+  {
+    void* buffer = do_poolAlloc(_size);
+    if (buffer != NULL)
+      return buffer;
+  }
+  if (s_pool.m_arena != NULL)
+    ++s_pool.m_fallbacks;
+
+  return Memory_alloc(_size, _allocParams);
+}
+
+static void do_bufferFree(void* _buffer, size_t _size, Memory_AllocParams* _allocParams)
+{
+  if (do_poolOwns(_buffer))
+    do_poolFree(_buffer);
+  else
+    Memory_free(_buffer, _size, _allocParams);
+}
+
+static void* do_cacheAlloc(size_t _size, Memory_AllocParams* _allocParams, bool _clear)
+{
+  void* buffer = do_bufferAlloc(_size, _allocParams);
+  if (buffer != NULL && _clear)
+  {
+    memset(buffer, 0, _size);
+    if (_allocParams->flags == Memory_CACHED)
+      Memory_cacheWbInv(buffer, _size); // no dirty lines left to be evicted over DSP output
+  }
+  return buffer;
+}
+
 static int do_memoryAlloc(CodecEngine* _ce, size_t _srcBufferSize, size_t _dstBufferSize)
 {
-  memset(&_ce->m_allocParams, 0, sizeof(_ce->m_allocParams));
-  _ce->m_allocParams.type = Memory_CONTIGPOOL;
-  _ce->m_allocParams.flags = Memory_CACHED;
-  _ce->m_allocParams.align = BUFALIGN;
-  _ce->m_allocParams.seg = 0;
+  do_cacheAllocParams(&_ce->m_srcAllocParams, _ce->m_srcCacheMode);
+  do_cacheAllocParams(&_ce->m_dstAllocParams, _ce->m_dstCacheMode);
 
   _ce->m_srcBufferSize = ALIGN_UP(_srcBufferSize, BUFALIGN);
-  if ((_ce->m_srcBuffer = Memory_alloc(_ce->m_srcBufferSize, &_ce->m_allocParams)) == NULL)
+  if ((_ce->m_srcBuffer = do_cacheAlloc(_ce->m_srcBufferSize, &_ce->m_srcAllocParams, false)) == NULL)
   {
     fprintf(stderr, "Memory_alloc(src, %zu) failed\n", _ce->m_srcBufferSize);
     _ce->m_srcBufferSize = 0;
@@ -43,33 +297,90 @@ static int do_memoryAlloc(CodecEngine* _ce, size_t _srcBufferSize, size_t _dstBu
   }
 
   _ce->m_dstBufferSize = ALIGN_UP(_dstBufferSize, BUFALIGN);
-  if ((_ce->m_dstBuffer = Memory_alloc(_ce->m_dstBufferSize, &_ce->m_allocParams)) == NULL)
+  if ((_ce->m_dstBuffer = do_cacheAlloc(_ce->m_dstBufferSize, &_ce->m_dstAllocParams, true)) == NULL)
   {
     fprintf(stderr, "Memory_alloc(dst, %zu) failed\n", _ce->m_dstBufferSize);
     _ce->m_dstBufferSize = 0;
 
-    Memory_free(_ce->m_srcBuffer, _ce->m_srcBufferSize, &_ce->m_allocParams);
+    do_bufferFree(_ce->m_srcBuffer, _ce->m_srcBufferSize, &_ce->m_srcAllocParams);
     _ce->m_srcBuffer = NULL;
     _ce->m_srcBufferSize = 0;
     return ENOMEM;
   }
-  memset(_ce->m_dstBuffer, 0, _ce->m_dstBufferSize);
 
   return 0;
 }
 
+// ARM side of a frame under each strategy: fill source and hand it over, take destination back and read it
+static void do_cacheBenchmark(size_t _srcFrameSize, size_t _dstFrameSize)
+{
+  static const int s_iterations = 20;
+  static const CodecEngineCacheMode s_modes[] = { CODEC_ENGINE_CACHE_RANGE, CODEC_ENGINE_CACHE_WHOLE, CODEC_ENGINE_CACHE_NONE };
+  const size_t srcSize = ALIGN_UP(_srcFrameSize, BUFALIGN);
+  const size_t dstSize = ALIGN_UP(_dstFrameSize, BUFALIGN);
+
+  void* frame = malloc(srcSize > dstSize ? srcSize : dstSize);
+  if (frame == NULL)
+    return;
+  memset(frame, 0x80, srcSize > dstSize ? srcSize : dstSize);
+
+  size_t modeIdx;
+  for (modeIdx = 0; modeIdx < sizeof(s_modes)/sizeof(*s_modes); ++modeIdx)
+  {
+    const CodecEngineCacheMode mode = s_modes[modeIdx];
+    Memory_AllocParams allocParams;
+    do_cacheAllocParams(&allocParams, mode);
+
+    void* src = do_cacheAlloc(srcSize, &allocParams, false);
+    void* dst = do_cacheAlloc(dstSize, &allocParams, true);
+    if (src == NULL || dst == NULL)
+    {
+      fprintf(stderr, "Cache benchmark %s: allocation failed\n", do_cacheModeName(mode));
+      goto next_mode;
+    }
+
+    long long srcUs = 0;
+    long long dstUs = 0;
+    int iteration;
+    for (iteration = 0; iteration < s_iterations; ++iteration)
+    {
+      long long startUs = do_nowUs();
+      memcpy(src, frame, _srcFrameSize);
+      do_cacheArmToDsp(mode, src, srcSize, _srcFrameSize);
+      srcUs += do_nowUs() - startUs;
+
+      startUs = do_nowUs();
+      do_cacheDspWriteBegin(mode, dst, dstSize);
+      do_cacheDspToArm(mode, dst, dstSize, _dstFrameSize);
+      memcpy(frame, dst, _dstFrameSize);
+      dstUs += do_nowUs() - startUs;
+    }
+
+    fprintf(stderr, "Cache benchmark %s: src copy+maintenance %lld us/frame, dst maintenance+copy %lld us/frame\n",
+            do_cacheModeName(mode), srcUs/s_iterations, dstUs/s_iterations);
+
+   next_mode:
+    if (dst != NULL)
+      do_bufferFree(dst, dstSize, &allocParams);
+    if (src != NULL)
+      do_bufferFree(src, srcSize, &allocParams);
+  }
+
+  free(frame);
+}
+
 static int do_memoryFree(CodecEngine* _ce)
 {
   if (_ce->m_dstBuffer != NULL)
   {
-    Memory_free(_ce->m_dstBuffer, _ce->m_dstBufferSize, &_ce->m_allocParams);
+    do_bufferFree(_ce->m_dstBuffer, _ce->m_dstBufferSize, &_ce->m_dstAllocParams);
     _ce->m_dstBuffer = NULL;
     _ce->m_dstBufferSize = 0;
   }
 
   if (_ce->m_srcBuffer != NULL)
   {
-    Memory_free(_ce->m_srcBuffer, _ce->m_srcBufferSize, &_ce->m_allocParams);
+    do_bufferFree(_ce->m_srcBuffer, _ce->m_srcBufferSize, &_ce->m_srcAllocParams);
     _ce->m_srcBuffer = NULL;
     _ce->m_srcBufferSize = 0;
   }
@@ -77,6 +388,87 @@ static int do_memoryFree(CodecEngine* _ce)
   return 0;
 }
 
+static int do_srcImportReset(CodecEngine* _ce)
+{
+  size_t idx;
+  for (idx = 0; idx < CODEC_ENGINE_MAX_SRC_IMPORTS; ++idx)
+  {
+    _ce->m_srcImportFd[idx] = -1;
+    _ce->m_srcImportPtr[idx] = MAP_FAILED;
+    _ce->m_srcImportSize[idx] = 0;
+    _ce->m_srcImportContiguous[idx] = false;
+  }
+
+  return 0;
+}
+
+static int do_srcImportRelease(CodecEngine* _ce)
+{
+  size_t idx;
+  for (idx = 0; idx < CODEC_ENGINE_MAX_SRC_IMPORTS; ++idx)
+    if (   _ce->m_srcImportPtr[idx] != MAP_FAILED
+        && munmap(_ce->m_srcImportPtr[idx], _ce->m_srcImportSize[idx]) != 0)
+      fprintf(stderr, "munmap(dmabuf %d, %zu) failed: %d\n",
+              _ce->m_srcImportFd[idx], _ce->m_srcImportSize[idx], errno);
+
+  return do_srcImportReset(_ce);
+}
+
+// returns import slot for dmabuf, mapping it and checking DSP accessibility on first use
+static int do_srcImport(CodecEngine* _ce, int _fd, size_t* _importIndex)
+{
+  size_t idx;
+  for (idx = 0; idx < CODEC_ENGINE_MAX_SRC_IMPORTS; ++idx)
+    if (_ce->m_srcImportFd[idx] == _fd)
+    {
+      *_importIndex = idx;
+      return 0;
+    }
+
+  for (idx = 0; idx < CODEC_ENGINE_MAX_SRC_IMPORTS; ++idx)
+    if (_ce->m_srcImportFd[idx] == -1)
+      break;
+  if (idx >= CODEC_ENGINE_MAX_SRC_IMPORTS)
+    return ENOSPC;
+
+  // remember fd even if it cannot be mapped, so it is not retried every frame
+  _ce->m_srcImportFd[idx] = _fd;
+
+  off_t size = lseek(_fd, 0, SEEK_END);
+  if (size <= 0)
+  {
+    int res = errno;
+    fprintf(stderr, "lseek(dmabuf %d) failed: %d\n", _fd, res);
+    *_importIndex = idx;
+    return res;
+  }
+
+  void* ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, _fd, 0);
+  if (ptr == MAP_FAILED)
+  {
+    int res = errno;
+    fprintf(stderr, "mmap(dmabuf %d, %zu) failed: %d\n", _fd, (size_t)size, res);
+    *_importIndex = idx;
+    return res;
+  }
+
+  Bool contiguous = FALSE;
+  if (Memory_getBufferPhysicalAddress(ptr, size, &contiguous) == 0)
+    contiguous = FALSE;
+
+  _ce->m_srcImportPtr[idx] = ptr;
+  _ce->m_srcImportSize[idx] = size;
+  _ce->m_srcImportContiguous[idx] = contiguous;
+
+  if (!contiguous)
+    fprintf(stderr, "Imported dmabuf %d is not physically contiguous, frames will be copied\n", _fd);
+  else if (s_verbose)
+    fprintf(stderr, "Imported dmabuf %d[%zu] at %p\n", _fd, (size_t)size, ptr);
+
+  *_importIndex = idx;
+  return 0;
+}
+
 static XDAS_Int32 do_convertPixelFormat(CodecEngine* _ce, uint32_t _format)
 {
   (void)_ce;
@@ -96,47 +488,24 @@ static XDAS_Int32 do_convertPixelFormat(CodecEngine* _ce, uint32_t _format)
   }
 }
 
-static int do_setupCodec(CodecEngine* _ce, const char* _codecName,
-                         const ImageDescription* _srcImageDesc,
-                         const ImageDescription* _dstImageDesc)
+// Panel with r11/g5/b0 16 bit pixels (V4L2 RGB565 on this little endian board) has always been
+// driven with codec RGB565X output and shows correct colours that way, so codec names are not
+// V4L2 byte order here. Keep that mapping for output rather than trusting the names.
+static XDAS_Int32 do_convertOutputPixelFormat(CodecEngine* _ce, uint32_t _format)
 {
-  if (_codecName == NULL || _srcImageDesc == NULL || _dstImageDesc == NULL)
-    return EINVAL;
-
-  if (s_verbose)
-    fprintf(stderr, "VIDTRANSCODE_control(%c%c%c%c@%zux%zu[%zu] -> %c%c%c%c@%zux%zu[%zu])\n",
-            (_srcImageDesc->m_format    )&0xff,
-            (_srcImageDesc->m_format>> 8)&0xff,
-            (_srcImageDesc->m_format>>16)&0xff,
-            (_srcImageDesc->m_format>>24)&0xff,
-            _srcImageDesc->m_width, _srcImageDesc->m_height, _srcImageDesc->m_lineLength,
-            (_dstImageDesc->m_format    )&0xff,
-            (_dstImageDesc->m_format>> 8)&0xff,
-            (_dstImageDesc->m_format>>16)&0xff,
-            (_dstImageDesc->m_format>>24)&0xff,
-            _dstImageDesc->m_width, _dstImageDesc->m_height, _dstImageDesc->m_lineLength);
+  if (_format == V4L2_PIX_FMT_RGB565)
+    return TRIK_VIDTRANSCODE_CV_VIDEO_FORMAT_RGB565X;
 
-  TRIK_VIDTRANSCODE_CV_Params ceParams;
-  memset(&ceParams, 0, sizeof(ceParams));
-  ceParams.base.size = sizeof(ceParams);
-  ceParams.base.numOutputStreams = 1;
-  ceParams.base.formatInput = do_convertPixelFormat(_ce, _srcImageDesc->m_format);
-  ceParams.base.formatOutput[0] = do_convertPixelFormat(_ce, _dstImageDesc->m_format);
-  #define max(x, y) x > y ? x : y;
-  ceParams.base.maxHeightInput = max(_srcImageDesc->m_height,_srcImageDesc->m_width);
-  ceParams.base.maxWidthInput = max(_srcImageDesc->m_height,_srcImageDesc->m_width);
-  ceParams.base.maxHeightOutput[0] = max(_dstImageDesc->m_height,_dstImageDesc->m_width);
-  ceParams.base.maxWidthOutput[0] = max(_dstImageDesc->m_height,_dstImageDesc->m_width);
-  ceParams.base.dataEndianness = XDM_BYTE;
+  return do_convertPixelFormat(_ce, _format);
+}
 
-  char* codec = strdup(_codecName);
-  if ((_ce->m_vidtranscodeHandle = VIDTRANSCODE_create(_ce->m_handle, codec, &ceParams.base)) == NULL)
-  {
-    free(codec);
-    fprintf(stderr, "VIDTRANSCODE_create(%s) failed\n", _codecName);
-    return EBADRQC;
-  }
-  free(codec);
+// codec can be told to process only top _inputHeight rows of the frame
+static int do_controlCodec(CodecEngine* _ce, VIDTRANSCODE_Handle _handle,
+                           const ImageDescription* _srcImageDesc,
+                           const ImageDescription* _dstImageDesc,
+                           size_t _inputHeight)
+{
+  (void)_ce;
 
   TRIK_VIDTRANSCODE_CV_DynamicParams ceDynamicParams;
   memset(&ceDynamicParams, 0, sizeof(ceDynamicParams));
@@ -145,7 +514,7 @@ static int do_setupCodec(CodecEngine* _ce, const char* _codecName,
   ceDynamicParams.base.outputHeight[0] = _dstImageDesc->m_height;
   ceDynamicParams.base.outputWidth[0] = _dstImageDesc->m_width;
   ceDynamicParams.base.keepInputFrameRateFlag[0] = XDAS_TRUE;
-  ceDynamicParams.inputHeight = _srcImageDesc->m_height;
+  ceDynamicParams.inputHeight = _inputHeight;
   ceDynamicParams.inputWidth = _srcImageDesc->m_width;
   ceDynamicParams.inputLineLength = _srcImageDesc->m_lineLength;
   ceDynamicParams.outputLineLength[0] = _dstImageDesc->m_lineLength;
@@ -153,7 +522,7 @@ static int do_setupCodec(CodecEngine* _ce, const char* _codecName,
   IVIDTRANSCODE_Status ceStatus;
   memset(&ceStatus, 0, sizeof(ceStatus));
   ceStatus.size = sizeof(ceStatus);
-  XDAS_Int32 controlResult = VIDTRANSCODE_control(_ce->m_vidtranscodeHandle, XDM_SETPARAMS, &ceDynamicParams.base, &ceStatus);
+  XDAS_Int32 controlResult = VIDTRANSCODE_control(_handle, XDM_SETPARAMS, &ceDynamicParams.base, &ceStatus);
   if (controlResult != IVIDTRANSCODE_EOK)
   {
     fprintf(stderr, "VIDTRANSCODE_control() failed: %"PRIi32"/%"PRIi32"\n", controlResult, ceStatus.extendedError);
@@ -163,6 +532,65 @@ static int do_setupCodec(CodecEngine* _ce, const char* _codecName,
   return 0;
 }
 
+static size_t do_maxSide(const ImageDescription* _imageDesc)
+{
+  return _imageDesc->m_width > _imageDesc->m_height ? _imageDesc->m_width : _imageDesc->m_height;
+}
+
+static VIDTRANSCODE_Handle do_createCodec(CodecEngine* _ce, const char* _codecName,
+                                          const ImageDescription* _srcImageDesc,
+                                          const ImageDescription* _dstImageDesc)
+{
+  TRIK_VIDTRANSCODE_CV_Params ceParams;
+  memset(&ceParams, 0, sizeof(ceParams));
+  ceParams.base.size = sizeof(ceParams);
+  ceParams.base.numOutputStreams = 1;
+  ceParams.base.formatInput = do_convertPixelFormat(_ce, _srcImageDesc->m_format);
+  ceParams.base.formatOutput[0] = do_convertOutputPixelFormat(_ce, _dstImageDesc->m_format);
+  #define max(x, y) x > y ? x : y;
+  ceParams.base.maxHeightInput = max(_srcImageDesc->m_height,_srcImageDesc->m_width);
+  ceParams.base.maxWidthInput = max(_srcImageDesc->m_height,_srcImageDesc->m_width);
+  ceParams.base.maxHeightOutput[0] = max(_dstImageDesc->m_height,_dstImageDesc->m_width);
+  ceParams.base.maxWidthOutput[0] = max(_dstImageDesc->m_height,_dstImageDesc->m_width);
+  ceParams.base.dataEndianness = XDM_BYTE;
+
+  char* codec = strdup(_codecName);
+  VIDTRANSCODE_Handle handle = VIDTRANSCODE_create(_ce->m_handle, codec, &ceParams.base);
+  free(codec);
+  if (handle == NULL)
+    fprintf(stderr, "VIDTRANSCODE_create(%s) failed\n", _codecName);
+
+  return handle;
+}
+
+static int do_setupCodec(CodecEngine* _ce, const char* _codecName,
+                         const ImageDescription* _srcImageDesc,
+                         const ImageDescription* _dstImageDesc)
+{
+  if (_codecName == NULL || _srcImageDesc == NULL || _dstImageDesc == NULL)
+    return EINVAL;
+
+  if (s_verbose)
+    fprintf(stderr, "VIDTRANSCODE_control(%c%c%c%c@%zux%zu[%zu] -> %c%c%c%c@%zux%zu[%zu])\n",
+            (_srcImageDesc->m_format    )&0xff,
+            (_srcImageDesc->m_format>> 8)&0xff,
+            (_srcImageDesc->m_format>>16)&0xff,
+            (_srcImageDesc->m_format>>24)&0xff,
+            _srcImageDesc->m_width, _srcImageDesc->m_height, _srcImageDesc->m_lineLength,
+            (_dstImageDesc->m_format    )&0xff,
+            (_dstImageDesc->m_format>> 8)&0xff,
+            (_dstImageDesc->m_format>>16)&0xff,
+            (_dstImageDesc->m_format>>24)&0xff,
+            _dstImageDesc->m_width, _dstImageDesc->m_height, _dstImageDesc->m_lineLength);
+
+  if ((_ce->m_vidtranscodeHandle = do_createCodec(_ce, _codecName, _srcImageDesc, _dstImageDesc)) == NULL)
+    return EBADRQC;
+  _ce->m_codecSrcImageDesc = *_srcImageDesc;
+  _ce->m_codecDstImageDesc = *_dstImageDesc;
+
+  return do_controlCodec(_ce, _ce->m_vidtranscodeHandle, _srcImageDesc, _dstImageDesc, _srcImageDesc->m_height);
+}
+
 static int do_releaseCodec(CodecEngine* _ce)
 {
   if (_ce->m_vidtranscodeHandle != NULL)
@@ -172,6 +600,75 @@ static int do_releaseCodec(CodecEngine* _ce)
   return 0;
 }
 
+static void do_releaseAlgorithms(CodecEngine* _ce)
+{
+  size_t idx;
+  for (idx = 0; idx < _ce->m_algorithms; ++idx)
+  {
+    CodecEngineAlgorithm* algorithm = &_ce->m_algorithm[idx];
+    if (algorithm->m_vidtranscodeHandle != NULL)
+      VIDTRANSCODE_delete(algorithm->m_vidtranscodeHandle);
+  }
+  memset(_ce->m_algorithm, 0, sizeof(_ce->m_algorithm));
+  _ce->m_algorithms = 0;
+
+  if (_ce->m_algorithmDstBuffer != NULL)
+    do_bufferFree(_ce->m_algorithmDstBuffer, _ce->m_dstBufferSize, &_ce->m_dstAllocParams);
+  _ce->m_algorithmDstBuffer = NULL;
+}
+
+// extra instances on the same engine; they read main codec input buffer, so frame is copied to DSP memory once
+static int do_setupAlgorithms(CodecEngine* _ce, const CodecEngineConfig* _config,
+                              const ImageDescription* _srcImageDesc,
+                              const ImageDescription* _dstImageDesc)
+{
+  int res;
+  const size_t algorithms = _config->m_algorithms < MAX_ALGORITHMS_N ? _config->m_algorithms : MAX_ALGORITHMS_N;
+
+  if (algorithms == 0)
+    return 0;
+
+  // cleared and never read back, so no cache maintenance is needed per frame
+  if ((_ce->m_algorithmDstBuffer = do_cacheAlloc(_ce->m_dstBufferSize, &_ce->m_dstAllocParams, true)) == NULL)
+  {
+    fprintf(stderr, "Memory_alloc(algorithm dst, %zu) failed\n", _ce->m_dstBufferSize);
+    return ENOMEM;
+  }
+
+  for (_ce->m_algorithms = 0; _ce->m_algorithms < algorithms; ++_ce->m_algorithms)
+  {
+    CodecEngineAlgorithm* algorithm = &_ce->m_algorithm[_ce->m_algorithms];
+    algorithm->m_codecName = _config->m_algorithmCodec[_ce->m_algorithms];
+    algorithm->m_fresh = false;
+
+    if (   (algorithm->m_adapter = codecEngineAdapterFind(algorithm->m_codecName)) == NULL
+        || algorithm->m_adapter->m_inArgsSize  > CODEC_ENGINE_ADAPTER_ARGS_SIZE
+        || algorithm->m_adapter->m_outArgsSize > CODEC_ENGINE_ADAPTER_ARGS_SIZE)
+    {
+      fprintf(stderr, "No args adapter for algorithm codec %s\n", algorithm->m_codecName ? algorithm->m_codecName : "(null)");
+      res = EBADRQC;
+      goto exit_release;
+    }
+    if ((algorithm->m_vidtranscodeHandle = do_createCodec(_ce, algorithm->m_codecName, _srcImageDesc, _dstImageDesc)) == NULL)
+    {
+      res = EBADRQC;
+      goto exit_release;
+    }
+    if ((res = do_controlCodec(_ce, algorithm->m_vidtranscodeHandle, _srcImageDesc, _dstImageDesc, _srcImageDesc->m_height)) != 0)
+    {
+      ++_ce->m_algorithms; // so its instance is deleted too
+      goto exit_release;
+    }
+  }
+
+  return 0;
+
+
+ exit_release:
+  do_releaseAlgorithms(_ce);
+  return res;
+}
+
 static int makeValueRange(int _val, int _adj, int _min, int _max)
 {
   _val += _adj;
@@ -191,109 +688,928 @@ static int makeValueWrap(int _val, int _adj, int _min, int _max)
   while (_val < _min)
     _val += (_max-_min+1);
 
-  return _val;
+  return _val;
+}
+
+// DSP side of a frame: buffers must be DSP accessible and cache maintenance already done
+static int do_processFrame(CodecEngine* _ce, VIDTRANSCODE_Handle _handle,
+                           void* _srcBuffer, size_t _srcFrameSize,
+                           void* _dstBuffer, size_t _dstFrameSize, size_t* _dstFrameUsed,
+                           const TargetDetectParams* _targetDetectParams,
+                           const TargetDetectCommand* _targetDetectCommand,
+                           TargetLocation* _targetLocation,
+                           TargetDetectParams* _targetDetectParamsResult)
+{
+  TRIK_VIDTRANSCODE_CV_InArgs tcInArgs;
+  memset(&tcInArgs, 0, sizeof(tcInArgs));
+  tcInArgs.base.size = sizeof(tcInArgs);
+  tcInArgs.base.numBytes = _srcFrameSize;
+  tcInArgs.base.inputID = 1; // must be non-zero, otherwise caching issues appear
+  tcInArgs.alg.setHsvRange = _targetDetectParams->m_setHsvRange;
+  tcInArgs.alg.detectHue       = _targetDetectParams->m_detectHue;
+  tcInArgs.alg.detectHueTol   = _targetDetectParams->m_detectHueTolerance;
+  tcInArgs.alg.detectSat       = _targetDetectParams->m_detectSat;
+  tcInArgs.alg.detectSatTol   = _targetDetectParams->m_detectSatTolerance;
+  tcInArgs.alg.detectVal       = _targetDetectParams->m_detectVal;
+  tcInArgs.alg.detectValTol   = _targetDetectParams->m_detectValTolerance;
+  tcInArgs.alg.autoDetectHsv = _targetDetectCommand->m_cmd;
+
+  TRIK_VIDTRANSCODE_CV_OutArgs tcOutArgs;
+  memset(&tcOutArgs,    0, sizeof(tcOutArgs));
+  tcOutArgs.base.size = sizeof(tcOutArgs);
+
+  XDM1_BufDesc tcInBufDesc;
+  memset(&tcInBufDesc,  0, sizeof(tcInBufDesc));
+  tcInBufDesc.numBufs = 1;
+  tcInBufDesc.descs[0].buf = (XDAS_Int8*)_srcBuffer;
+  tcInBufDesc.descs[0].bufSize = _srcFrameSize;
+
+  XDM_BufDesc tcOutBufDesc;
+  memset(&tcOutBufDesc, 0, sizeof(tcOutBufDesc));
+  XDAS_Int8* tcOutBufDesc_bufs[1];
+  XDAS_Int32 tcOutBufDesc_bufSizes[1];
+  tcOutBufDesc.numBufs = 1;
+  tcOutBufDesc.bufs = tcOutBufDesc_bufs;
+  tcOutBufDesc.bufs[0] = (XDAS_Int8*)_dstBuffer;
+  tcOutBufDesc.bufSizes = tcOutBufDesc_bufSizes;
+  tcOutBufDesc.bufSizes[0] = _dstFrameSize;
+
+  const long long processStartUs = do_nowUs();
+  XDAS_Int32 processResult = VIDTRANSCODE_process(_handle, &tcInBufDesc, &tcOutBufDesc, &tcInArgs.base, &tcOutArgs.base);
+  timingHistogramAdd(&_ce->m_timing[CODEC_ENGINE_TIMING_PROCESS], do_nowUs() - processStartUs);
+  if (processResult != IVIDTRANSCODE_EOK)
+  {
+    fprintf(stderr, "VIDTRANSCODE_process(%zu -> %zu) failed: %"PRIi32"/%"PRIi32"\n",
+            _srcFrameSize, _dstFrameSize, processResult, tcOutArgs.base.extendedError);
+    return EILSEQ;
+  }
+
+  if (tcOutArgs.base.encodedBuf[0].bufSize < 0)
+  {
+    *_dstFrameUsed = 0;
+    fprintf(stderr, "VIDTRANSCODE_process(%zu -> %zu) returned negative buffer size\n",
+            _srcFrameSize, _dstFrameSize);
+  }
+  else if ((size_t)(tcOutArgs.base.encodedBuf[0].bufSize) > _dstFrameSize)
+  {
+    *_dstFrameUsed = _dstFrameSize;
+    fprintf(stderr, "VIDTRANSCODE_process(%zu -> %zu) returned too large buffer %zu, truncated\n",
+            _srcFrameSize, _dstFrameSize, *_dstFrameUsed);
+  }
+  else
+    *_dstFrameUsed = tcOutArgs.base.encodedBuf[0].bufSize;
+
+
+  memcpy(_targetLocation->target, tcOutArgs.alg.target, MAX_OBJECTS_N*sizeof(Target));
+/*
+  _targetLocation->m_targetX    = tcOutArgs.alg.target[0].x;
+  _targetLocation->m_targetY    = tcOutArgs.alg.target[0].y;
+  _targetLocation->m_targetSize = tcOutArgs.alg.target[0].size;
+*/
+  _targetDetectParamsResult->m_detectHue          = tcOutArgs.alg.detectHue;
+  _targetDetectParamsResult->m_detectHueTolerance = tcOutArgs.alg.detectHueTolerance;
+  _targetDetectParamsResult->m_detectSat          = tcOutArgs.alg.detectSat;
+  _targetDetectParamsResult->m_detectSatTolerance = tcOutArgs.alg.detectSatTolerance;
+  _targetDetectParamsResult->m_detectVal          = tcOutArgs.alg.detectVal;
+  _targetDetectParamsResult->m_detectValTolerance = tcOutArgs.alg.detectValTolerance;
+
+  return 0;
+}
+
+// args are laid out by algorithm adapter, output buffer is scratch
+static int do_processAlgorithm(CodecEngine* _ce, CodecEngineAlgorithm* _algorithm,
+                               void* _srcBuffer, size_t _srcFrameSize, size_t _dstFrameSize,
+                               const TargetDetectParams* _targetDetectParams)
+{
+  const CodecEngineAdapter* adapter = _algorithm->m_adapter;
+
+  union
+  {
+    IVIDTRANSCODE_InArgs base;
+    char                 raw[CODEC_ENGINE_ADAPTER_ARGS_SIZE];
+  } tcInArgs;
+  memset(&tcInArgs, 0, sizeof(tcInArgs));
+  tcInArgs.base.size = adapter->m_inArgsSize;
+  tcInArgs.base.numBytes = _srcFrameSize;
+  tcInArgs.base.inputID = 1; // must be non-zero, otherwise caching issues appear
+  adapter->m_fillInArgs(&tcInArgs, _targetDetectParams);
+
+  union
+  {
+    IVIDTRANSCODE_OutArgs base;
+    char                  raw[CODEC_ENGINE_ADAPTER_ARGS_SIZE];
+  } tcOutArgs;
+  memset(&tcOutArgs, 0, sizeof(tcOutArgs));
+  tcOutArgs.base.size = adapter->m_outArgsSize;
+
+  XDM1_BufDesc tcInBufDesc;
+  memset(&tcInBufDesc,  0, sizeof(tcInBufDesc));
+  tcInBufDesc.numBufs = 1;
+  tcInBufDesc.descs[0].buf = (XDAS_Int8*)_srcBuffer;
+  tcInBufDesc.descs[0].bufSize = _srcFrameSize;
+
+  XDM_BufDesc tcOutBufDesc;
+  memset(&tcOutBufDesc, 0, sizeof(tcOutBufDesc));
+  XDAS_Int8* tcOutBufDesc_bufs[1];
+  XDAS_Int32 tcOutBufDesc_bufSizes[1];
+  tcOutBufDesc.numBufs = 1;
+  tcOutBufDesc.bufs = tcOutBufDesc_bufs;
+  tcOutBufDesc.bufs[0] = (XDAS_Int8*)_ce->m_algorithmDstBuffer;
+  tcOutBufDesc.bufSizes = tcOutBufDesc_bufSizes;
+  tcOutBufDesc.bufSizes[0] = _dstFrameSize;
+
+  const long long processStartUs = do_nowUs();
+  XDAS_Int32 processResult = VIDTRANSCODE_process(_algorithm->m_vidtranscodeHandle, &tcInBufDesc, &tcOutBufDesc, &tcInArgs.base, &tcOutArgs.base);
+  timingHistogramAdd(&_ce->m_timing[CODEC_ENGINE_TIMING_PROCESS], do_nowUs() - processStartUs);
+  if (processResult != IVIDTRANSCODE_EOK)
+  {
+    fprintf(stderr, "VIDTRANSCODE_process(%s, %zu -> %zu) failed: %"PRIi32"/%"PRIi32"\n",
+            _algorithm->m_codecName, _srcFrameSize, _dstFrameSize, processResult, tcOutArgs.base.extendedError);
+    return EILSEQ;
+  }
+
+  adapter->m_readOutArgs(&tcOutArgs, &_algorithm->m_result);
+
+  return 0;
+}
+
+// failed algorithm only loses its own result for this frame
+static void do_processAlgorithms(CodecEngine* _ce,
+                                 void* _srcBuffer, size_t _srcFrameSize, size_t _dstFrameSize,
+                                 const TargetDetectParams* _targetDetectParams)
+{
+  size_t idx;
+  for (idx = 0; idx < _ce->m_algorithms; ++idx)
+  {
+    CodecEngineAlgorithm* algorithm = &_ce->m_algorithm[idx];
+    algorithm->m_fresh = do_processAlgorithm(_ce, algorithm, _srcBuffer, _srcFrameSize, _dstFrameSize,
+                                             _targetDetectParams) == 0;
+  }
+}
+
+static int do_transcodeFrame(CodecEngine* _ce,
+                             const void* _srcFramePtr, size_t _srcFrameSize,
+                             bool _srcFrameContiguous, int _srcFrameFd,
+                             void* _dstFramePtr, size_t _dstFrameSize, size_t* _dstFrameUsed,
+                             bool _dstFrameContiguous,
+                             const TargetDetectParams* _targetDetectParams,
+                             const TargetDetectCommand* _targetDetectCommand,
+                             TargetLocation* _targetLocation,
+                             TargetDetectParams* _targetDetectParamsResult)
+{
+  int res;
+
+  if (_ce->m_srcBuffer == NULL || _ce->m_dstBuffer == NULL)
+    return ENOTCONN;
+  if (   _srcFramePtr == NULL || _dstFramePtr == NULL
+      || _targetDetectParams == NULL || _targetDetectCommand == NULL
+      || _targetLocation == NULL || _targetDetectParamsResult == NULL)
+    return EINVAL;
+  if (_srcFrameSize > _ce->m_srcBufferSize || _dstFrameSize > _ce->m_dstBufferSize)
+    return ENOSPC;
+
+  if (_srcFrameFd != -1)
+  {
+    size_t importIndex;
+    if (do_srcImport(_ce, _srcFrameFd, &importIndex) == 0 && _ce->m_srcImportContiguous[importIndex])
+    {
+      _srcFramePtr = _ce->m_srcImportPtr[importIndex];
+      _srcFrameContiguous = true;
+    }
+  }
+
+  // DSP renders preview straight into output frame when it is contiguous memory
+  const bool dstDirect = _ce->m_videoOutEnable && _dstFrameContiguous;
+
+  long long cacheSrcUs = 0;
+
+  // contiguous frame (userptr or dmabuf) was captured by DMA and never written by ARM, DSP reads it in place
+  if (!_srcFrameContiguous)
+  {
+    const long long copyStartUs = do_nowUs();
+#warning This memcpy is blocking high fps
+    memcpy(_ce->m_srcBuffer, _srcFramePtr, _srcFrameSize);
+
+    const long long copiedUs = do_nowUs();
+    do_cacheArmToDsp(_ce->m_srcCacheMode, _ce->m_srcBuffer, _ce->m_srcBufferSize, _srcFrameSize);
+    cacheSrcUs = do_nowUs() - copiedUs;
+    timingHistogramAdd(&_ce->m_timing[CODEC_ENGINE_TIMING_COPY_IN], copiedUs - copyStartUs);
+  }
+  const long long dstStartUs = do_nowUs();
+  if (!dstDirect)
+    do_cacheDspWriteBegin(_ce->m_dstCacheMode, _ce->m_dstBuffer, _ce->m_dstBufferSize);
+  long long cacheDstUs = do_nowUs() - dstStartUs;
+
+  if ((res = do_processFrame(_ce, _ce->m_vidtranscodeHandle,
+                             _srcFrameContiguous ? (void*)_srcFramePtr : _ce->m_srcBuffer, _srcFrameSize,
+                             dstDirect ? _dstFramePtr : _ce->m_dstBuffer, _dstFrameSize, _dstFrameUsed,
+                             _targetDetectParams, _targetDetectCommand,
+                             _targetLocation, _targetDetectParamsResult)) != 0)
+    return res;
+
+  do_processAlgorithms(_ce, _srcFrameContiguous ? (void*)_srcFramePtr : _ce->m_srcBuffer, _srcFrameSize,
+                       _dstFrameSize, _targetDetectParams);
+
+#warning This memcpy is blocking high fps
+  if(_ce->m_videoOutEnable && !dstDirect)
+  {
+    const long long readStartUs = do_nowUs();
+    do_cacheDspToArm(_ce->m_dstCacheMode, _ce->m_dstBuffer, _ce->m_dstBufferSize, *_dstFrameUsed);
+    const long long readUs = do_nowUs();
+    cacheDstUs += readUs - readStartUs;
+
+    blitCopy(_dstFramePtr, _ce->m_dstBuffer, *_dstFrameUsed); // codec is configured with frame line length
+    timingHistogramAdd(&_ce->m_timing[CODEC_ENGINE_TIMING_COPY_OUT], do_nowUs() - readUs);
+  }
+
+  timingHistogramAdd(&_ce->m_timing[CODEC_ENGINE_TIMING_CACHE], cacheSrcUs + cacheDstUs);
+  if (_ce->m_cacheBenchmark)
+  {
+    ++_ce->m_cacheFrames;
+    _ce->m_cacheSrcUs += cacheSrcUs;
+    _ce->m_cacheDstUs += cacheDstUs;
+  }
+
+  return 0;
+}
+
+static void* do_pipeThread(void* _arg)
+{
+  CodecEngine* ce = (CodecEngine*)_arg;
+
+  pthread_mutex_lock(&ce->m_pipeMutex);
+  while (true)
+  {
+    while (ce->m_pipeDone == ce->m_pipeHead && !ce->m_pipeTerminate)
+      pthread_cond_wait(&ce->m_pipeCond, &ce->m_pipeMutex);
+
+    if (ce->m_pipeDone == ce->m_pipeHead) // terminating and drained
+      break;
+
+    CodecEngineSlot* slot = &ce->m_pipeSlots[ce->m_pipeDone % ce->m_pipelineDepth];
+    pthread_mutex_unlock(&ce->m_pipeMutex);
+
+    // slot is owned by DSP thread until done is advanced
+    const long long startUs = do_nowUs();
+    slot->m_result = do_processFrame(ce, ce->m_vidtranscodeHandle,
+                                     slot->m_srcBuffer, slot->m_srcFrameSize,
+                                     slot->m_dstDirect ? slot->m_dstFramePtr : slot->m_dstBuffer,
+                                     slot->m_dstFrameSize, &slot->m_dstFrameUsed,
+                                     &slot->m_targetDetectParams, &slot->m_targetDetectCommand,
+                                     &slot->m_targetLocation, &slot->m_targetDetectParamsResult);
+    const long long dspUs = do_nowUs() - startUs;
+
+    pthread_mutex_lock(&ce->m_pipeMutex);
+    ce->m_pipeDspUs += dspUs;
+    ++ce->m_pipeDone;
+    pthread_cond_broadcast(&ce->m_pipeCond);
+  }
+  pthread_mutex_unlock(&ce->m_pipeMutex);
+
+  return NULL;
+}
+
+static void do_pipeFreeSlots(CodecEngine* _ce)
+{
+  // slot 0 buffers are the serial ones
+  size_t slotIdx;
+  for (slotIdx = 1; slotIdx < CODEC_ENGINE_MAX_PIPELINE; ++slotIdx)
+  {
+    CodecEngineSlot* slot = &_ce->m_pipeSlots[slotIdx];
+    if (slot->m_srcBuffer != NULL)
+      do_bufferFree(slot->m_srcBuffer, _ce->m_srcBufferSize, &_ce->m_srcAllocParams);
+    if (slot->m_dstBuffer != NULL)
+      do_bufferFree(slot->m_dstBuffer, _ce->m_dstBufferSize, &_ce->m_dstAllocParams);
+  }
+  memset(_ce->m_pipeSlots, 0, sizeof(_ce->m_pipeSlots));
+}
+
+static int do_pipeStop(CodecEngine* _ce)
+{
+  if (!_ce->m_pipeThreadRunning)
+    return 0;
+
+  pthread_mutex_lock(&_ce->m_pipeMutex);
+  _ce->m_pipeTerminate = true;
+  pthread_cond_broadcast(&_ce->m_pipeCond);
+  pthread_mutex_unlock(&_ce->m_pipeMutex);
+
+  pthread_join(_ce->m_pipeThread, NULL);
+  _ce->m_pipeThreadRunning = false;
+
+  pthread_cond_destroy(&_ce->m_pipeCond);
+  pthread_mutex_destroy(&_ce->m_pipeMutex);
+
+  do_pipeFreeSlots(_ce);
+
+  return 0;
+}
+
+static int do_pipeStart(CodecEngine* _ce)
+{
+  int res;
+
+  memset(_ce->m_pipeSlots, 0, sizeof(_ce->m_pipeSlots));
+  _ce->m_pipeSlots[0].m_srcBuffer = _ce->m_srcBuffer;
+  _ce->m_pipeSlots[0].m_dstBuffer = _ce->m_dstBuffer;
+
+  size_t slotIdx;
+  for (slotIdx = 1; slotIdx < _ce->m_pipelineDepth; ++slotIdx)
+  {
+    CodecEngineSlot* slot = &_ce->m_pipeSlots[slotIdx];
+    if (   (slot->m_srcBuffer = do_cacheAlloc(_ce->m_srcBufferSize, &_ce->m_srcAllocParams, false)) == NULL
+        || (slot->m_dstBuffer = do_cacheAlloc(_ce->m_dstBufferSize, &_ce->m_dstAllocParams, true)) == NULL)
+    {
+      fprintf(stderr, "Memory_alloc(pipeline slot %zu) failed\n", slotIdx);
+      res = ENOMEM;
+      goto exit_free;
+    }
+  }
+
+  _ce->m_pipeHead = 0;
+  _ce->m_pipeDone = 0;
+  _ce->m_pipeTail = 0;
+  _ce->m_pipeFrames = 0;
+  _ce->m_pipeDspUs = 0;
+  _ce->m_pipeArmUs = 0;
+  _ce->m_pipeTerminate = false;
+  pthread_mutex_init(&_ce->m_pipeMutex, NULL);
+  pthread_cond_init(&_ce->m_pipeCond, NULL);
+
+  if ((res = pthread_create(&_ce->m_pipeThread, NULL, &do_pipeThread, _ce)) != 0)
+  {
+    fprintf(stderr, "pthread_create(codec pipeline) failed: %d\n", res);
+    pthread_cond_destroy(&_ce->m_pipeCond);
+    pthread_mutex_destroy(&_ce->m_pipeMutex);
+    goto exit_free;
+  }
+  _ce->m_pipeThreadRunning = true;
+
+  return 0;
+
+
+ exit_free:
+  do_pipeFreeSlots(_ce);
+  return res;
+}
+
+// source is always copied: capture buffer is requeued before DSP gets to it
+static int do_submitFrame(CodecEngine* _ce,
+                          const void* _srcFramePtr, size_t _srcFrameSize,
+                          void* _dstFramePtr, size_t _dstFrameSize,
+                          bool _dstFrameContiguous,
+                          const TargetDetectParams* _targetDetectParams,
+                          const TargetDetectCommand* _targetDetectCommand,
+                          const FrameInfo* _frameInfo)
+{
+  if (_srcFrameSize > _ce->m_srcBufferSize || _dstFrameSize > _ce->m_dstBufferSize)
+    return ENOSPC;
+
+  pthread_mutex_lock(&_ce->m_pipeMutex);
+  const bool full = _ce->m_pipeHead - _ce->m_pipeTail >= _ce->m_pipelineDepth;
+  CodecEngineSlot* slot = &_ce->m_pipeSlots[_ce->m_pipeHead % _ce->m_pipelineDepth];
+  pthread_mutex_unlock(&_ce->m_pipeMutex);
+  if (full)
+    return EBUSY; // collect first
+
+  const long long startUs = do_nowUs();
+
+  slot->m_srcFrameSize   = _srcFrameSize;
+  slot->m_dstFramePtr    = _dstFramePtr;
+  slot->m_dstFrameSize   = _dstFrameSize;
+  slot->m_dstFrameUsed   = 0;
+  slot->m_videoOutEnable = _ce->m_videoOutEnable;
+  slot->m_dstDirect      = _ce->m_videoOutEnable && _dstFrameContiguous; // frames are processed in order, so no overtaking
+  slot->m_targetDetectParams  = *_targetDetectParams;
+  slot->m_targetDetectCommand = *_targetDetectCommand;
+  slot->m_frameInfo           = *_frameInfo;
+
+  // each slot owns its input buffer, so capture frame is copied in; COPY_IN timing shows the cost
+  memcpy(slot->m_srcBuffer, _srcFramePtr, _srcFrameSize);
+  const long long copiedUs = do_nowUs();
+  timingHistogramAdd(&_ce->m_timing[CODEC_ENGINE_TIMING_COPY_IN], copiedUs - startUs);
+
+  do_cacheArmToDsp(_ce->m_srcCacheMode, slot->m_srcBuffer, _ce->m_srcBufferSize, _srcFrameSize);
+  if (!slot->m_dstDirect)
+    do_cacheDspWriteBegin(_ce->m_dstCacheMode, slot->m_dstBuffer, _ce->m_dstBufferSize);
+  slot->m_cacheUs = do_nowUs() - copiedUs;
+
+  pthread_mutex_lock(&_ce->m_pipeMutex);
+  _ce->m_pipeArmUs += do_nowUs() - startUs;
+  ++_ce->m_pipeHead;
+  pthread_cond_broadcast(&_ce->m_pipeCond);
+  pthread_mutex_unlock(&_ce->m_pipeMutex);
+
+  return 0;
+}
+
+// oldest frame results, once pipeline is full; EAGAIN while it is filling up
+// copied output goes to frame given here, framebuffer page submitted with the frame may be on screen by now
+static int do_collectFrame(CodecEngine* _ce,
+                           void* _dstFramePtr, size_t _dstFrameSize, size_t* _dstFrameUsed,
+                           TargetDetectCommand* _targetDetectCommand,
+                           TargetLocation* _targetLocation,
+                           TargetDetectParams* _targetDetectParamsResult,
+                           FrameInfo* _frameInfo)
+{
+  pthread_mutex_lock(&_ce->m_pipeMutex);
+  if (_ce->m_pipeHead - _ce->m_pipeTail < _ce->m_pipelineDepth)
+  {
+    pthread_mutex_unlock(&_ce->m_pipeMutex);
+    return EAGAIN;
+  }
+  while (_ce->m_pipeDone == _ce->m_pipeTail)
+    pthread_cond_wait(&_ce->m_pipeCond, &_ce->m_pipeMutex);
+  CodecEngineSlot* slot = &_ce->m_pipeSlots[_ce->m_pipeTail % _ce->m_pipelineDepth];
+  pthread_mutex_unlock(&_ce->m_pipeMutex);
+
+  const long long startUs = do_nowUs();
+  const int res = slot->m_result;
+
+  // copy out only when codec could not write straight into output frame
+  if (res == 0 && slot->m_videoOutEnable && !slot->m_dstDirect)
+  {
+    if (slot->m_dstFrameUsed > _dstFrameSize)
+      slot->m_dstFrameUsed = _dstFrameSize;
+
+    do_cacheDspToArm(_ce->m_dstCacheMode, slot->m_dstBuffer, _ce->m_dstBufferSize, slot->m_dstFrameUsed);
+    const long long readUs = do_nowUs();
+    slot->m_cacheUs += readUs - startUs;
+
+    blitCopy(_dstFramePtr, slot->m_dstBuffer, slot->m_dstFrameUsed);
+    timingHistogramAdd(&_ce->m_timing[CODEC_ENGINE_TIMING_COPY_OUT], do_nowUs() - readUs);
+  }
+  timingHistogramAdd(&_ce->m_timing[CODEC_ENGINE_TIMING_CACHE], slot->m_cacheUs);
+
+  *_dstFrameUsed            = slot->m_dstFrameUsed;
+  *_targetDetectCommand     = slot->m_targetDetectCommand;
+  *_targetLocation          = slot->m_targetLocation;
+  *_targetDetectParamsResult = slot->m_targetDetectParamsResult;
+  *_frameInfo               = slot->m_frameInfo;
+
+  pthread_mutex_lock(&_ce->m_pipeMutex);
+  _ce->m_pipeArmUs += do_nowUs() - startUs;
+  ++_ce->m_pipeFrames;
+  ++_ce->m_pipeTail;
+  pthread_mutex_unlock(&_ce->m_pipeMutex);
+
+  return res;
+}
+
+static void do_reportPipeline(CodecEngine* _ce, long long _ms, const char* _prefix)
+{
+  pthread_mutex_lock(&_ce->m_pipeMutex);
+  const long long frames = _ce->m_pipeFrames;
+  const long long dspUs  = _ce->m_pipeDspUs;
+  const long long armUs  = _ce->m_pipeArmUs;
+  _ce->m_pipeFrames = 0;
+  _ce->m_pipeDspUs  = 0;
+  _ce->m_pipeArmUs  = 0;
+  pthread_mutex_unlock(&_ce->m_pipeMutex);
+
+  if (frames == 0 || _ms <= 0)
+    return;
+
+  // serial processing would take arm+dsp per frame, overlapped one takes the longer of the two
+  const long long busyUs = armUs > dspUs ? armUs : dspUs;
+  const long long gain100 = busyUs > 0 ? ((armUs + dspUs) * 100) / busyUs : 100;
+  fprintf(stderr, "%sDSP pipeline depth %zu: ARM %lld us/frame, DSP %lld us/frame, throughput gain %lld.%02lldx\n",
+          _prefix, _ce->m_pipelineDepth, armUs/frames, dspUs/frames, gain100/100, gain100%100);
+}
+
+static void* do_splitThread(void* _arg)
+{
+  CodecEngine* ce = (CodecEngine*)_arg;
+
+  pthread_mutex_lock(&ce->m_splitMutex);
+  while (true)
+  {
+    while (!ce->m_splitJobPending && !ce->m_splitTerminate)
+      pthread_cond_wait(&ce->m_splitCond, &ce->m_splitMutex);
+    if (ce->m_splitTerminate)
+      break;
+    pthread_mutex_unlock(&ce->m_splitMutex);
+
+    // job fields are owned by ARM thread until pending is cleared
+    const long long startUs = do_nowUs();
+    const int res = codecEngineCpuDetectRows(&ce->m_cpuDetector,
+                                             ce->m_splitJobSrc, ce->m_splitJobSrcSize,
+                                             ce->m_splitJobRowFirst, ce->m_srcImageDesc.m_height - ce->m_splitJobRowFirst,
+                                             &ce->m_splitRange,
+                                             &ce->m_splitJobLocation);
+    const long long armUs = do_nowUs() - startUs;
+
+    pthread_mutex_lock(&ce->m_splitMutex);
+    ce->m_splitJobResult = res;
+    ce->m_splitJobUs = armUs;
+    ce->m_splitJobPending = false;
+    pthread_cond_broadcast(&ce->m_splitCond);
+  }
+  pthread_mutex_unlock(&ce->m_splitMutex);
+
+  return NULL;
+}
+
+static int do_splitStop(CodecEngine* _ce)
+{
+  if (!_ce->m_splitThreadRunning)
+    return 0;
+
+  pthread_mutex_lock(&_ce->m_splitMutex);
+  _ce->m_splitTerminate = true;
+  pthread_cond_broadcast(&_ce->m_splitCond);
+  pthread_mutex_unlock(&_ce->m_splitMutex);
+
+  pthread_join(_ce->m_splitThread, NULL);
+  _ce->m_splitThreadRunning = false;
+
+  pthread_cond_destroy(&_ce->m_splitCond);
+  pthread_mutex_destroy(&_ce->m_splitMutex);
+
+  codecEngineCpuStop(&_ce->m_cpuDetector);
+
+  return 0;
+}
+
+static size_t do_splitClampRows(size_t _rows, size_t _height)
+{
+  _rows = (_rows / CODEC_ENGINE_SPLIT_STRIPE) * CODEC_ENGINE_SPLIT_STRIPE;
+  if (_rows < CODEC_ENGINE_SPLIT_STRIPE)
+    return CODEC_ENGINE_SPLIT_STRIPE;
+  if (_rows > _height - CODEC_ENGINE_SPLIT_STRIPE)
+    return _height - CODEC_ENGINE_SPLIT_STRIPE;
+  return _rows;
+}
+
+static int do_splitStart(CodecEngine* _ce, size_t _armPercent)
+{
+  int res;
+  const size_t height = _ce->m_srcImageDesc.m_height;
+
+  // codec finds chroma planes after inputHeight rows, so planar frames cannot be cut
+  if (_ce->m_srcImageDesc.m_format == V4L2_PIX_FMT_YUV422P)
+  {
+    fprintf(stderr, "Split DSP/ARM mode is not supported for planar input, disabled\n");
+    return 0;
+  }
+  if (height < 2*CODEC_ENGINE_SPLIT_STRIPE || _armPercent >= 100)
+  {
+    fprintf(stderr, "Split DSP/ARM mode needs frame of at least %d rows and ARM share below 100%%, disabled\n",
+            2*CODEC_ENGINE_SPLIT_STRIPE);
+    return 0;
+  }
+
+  if ((res = codecEngineCpuStart(&_ce->m_cpuDetector, &_ce->m_srcImageDesc, &_ce->m_dstImageDesc)) != 0)
+    return res;
+
+  _ce->m_splitRows      = do_splitClampRows(height - (height*_armPercent)/100, height);
+  _ce->m_splitDspRows   = height;
+  _ce->m_splitDspRowNs  = 0;
+  _ce->m_splitArmRowNs  = 0;
+  _ce->m_splitJobPending = false;
+  _ce->m_splitTerminate  = false;
+  _ce->m_splitFrames  = 0;
+  _ce->m_splitDspUs   = 0;
+  _ce->m_splitArmUs   = 0;
+  _ce->m_splitFrameUs = 0;
+  memset(&_ce->m_splitRange, 0, sizeof(_ce->m_splitRange));
+  _ce->m_splitRangeSet = false;
+  pthread_mutex_init(&_ce->m_splitMutex, NULL);
+  pthread_cond_init(&_ce->m_splitCond, NULL);
+
+  if ((res = pthread_create(&_ce->m_splitThread, NULL, &do_splitThread, _ce)) != 0)
+  {
+    fprintf(stderr, "pthread_create(split detector) failed: %d\n", res);
+    pthread_cond_destroy(&_ce->m_splitCond);
+    pthread_mutex_destroy(&_ce->m_splitMutex);
+    codecEngineCpuStop(&_ce->m_cpuDetector);
+    return res;
+  }
+  _ce->m_splitThreadRunning = true;
+  _ce->m_split = true;
+
+  return 0;
+}
+
+static int do_splitSetDspRows(CodecEngine* _ce, size_t _rows)
+{
+  int res;
+
+  if (_ce->m_splitDspRows == _rows)
+    return 0;
+
+  if ((res = do_controlCodec(_ce, _ce->m_vidtranscodeHandle, &_ce->m_srcImageDesc, &_ce->m_dstImageDesc, _rows)) != 0)
+    return res;
+
+  _ce->m_splitDspRows = _rows;
+  return 0;
+}
+
+static long do_isqrt(long _val)
+{
+  long root = 0;
+  while ((root+1)*(root+1) <= _val)
+    ++root;
+  return root;
+}
+
+// DSP targets are relative to its stripe, ARM ones to whole frame; blobs cut by split line are joined
+static void do_splitMerge(const CodecEngine* _ce,
+                          const TargetLocation* _dspLocation,
+                          const TargetLocation* _armLocation,
+                          TargetLocation* _targetLocation)
+{
+  typedef struct Blob { long m_x; long m_y; long m_pixels; long m_radius; } Blob;
+
+  const long width  = _ce->m_srcImageDesc.m_width;
+  const long height = _ce->m_srcImageDesc.m_height;
+  const long split  = _ce->m_splitDspRows;
+  Blob blobs[2*MAX_OBJECTS_N];
+  size_t blobsN = 0;
+  size_t idx, other;
+
+  for (idx = 0; idx < MAX_OBJECTS_N; ++idx)
+  {
+    const Target* target = &_dspLocation->target[idx];
+    if (target->size == 0)
+      continue;
+    Blob* blob = &blobs[blobsN++];
+    blob->m_x      = ((target->x + 100)*width)/200;
+    blob->m_y      = ((target->y + 100)*split)/200;
+    blob->m_pixels = (target->size*width*split)/100;
+  }
+  const size_t dspBlobsN = blobsN;
+  for (idx = 0; idx < MAX_OBJECTS_N; ++idx)
+  {
+    const Target* target = &_armLocation->target[idx];
+    if (target->size == 0)
+      continue;
+    Blob* blob = &blobs[blobsN++];
+    blob->m_x      = ((target->x + 100)*width)/200;
+    blob->m_y      = ((target->y + 100)*height)/200;
+    blob->m_pixels = (target->size*width*height)/100;
+  }
+  for (idx = 0; idx < blobsN; ++idx)
+    blobs[idx].m_radius = do_isqrt((blobs[idx].m_pixels*100)/314) + CODEC_ENGINE_SPLIT_STRIPE/2;
+
+  for (idx = 0; idx < dspBlobsN; ++idx)
+  {
+    Blob* dsp = &blobs[idx];
+    if (dsp->m_y + dsp->m_radius < split)
+      continue;
+    for (other = dspBlobsN; other < blobsN; ++other)
+    {
+      Blob* arm = &blobs[other];
+      const long radius = dsp->m_radius > arm->m_radius ? dsp->m_radius : arm->m_radius;
+      if (   arm->m_pixels == 0
+          || arm->m_y - arm->m_radius > split
+          || labs(arm->m_x - dsp->m_x) > radius)
+        continue;
+
+      const long pixels = dsp->m_pixels + arm->m_pixels;
+      dsp->m_x = (dsp->m_x*dsp->m_pixels + arm->m_x*arm->m_pixels)/pixels;
+      dsp->m_y = (dsp->m_y*dsp->m_pixels + arm->m_y*arm->m_pixels)/pixels;
+      dsp->m_pixels = pixels;
+      arm->m_pixels = 0;
+      break;
+    }
+  }
+
+  // largest first, as single frame detection reports them
+  memset(_targetLocation, 0, sizeof(*_targetLocation));
+  size_t targetIdx;
+  for (targetIdx = 0; targetIdx < MAX_OBJECTS_N; ++targetIdx)
+  {
+    size_t best = blobsN;
+    for (idx = 0; idx < blobsN; ++idx)
+      if (blobs[idx].m_pixels > 0 && (best == blobsN || blobs[idx].m_pixels > blobs[best].m_pixels))
+        best = idx;
+    if (best == blobsN)
+      break;
+
+    const long size = (blobs[best].m_pixels*100)/(width*height);
+    Target* target = &_targetLocation->target[targetIdx];
+    target->x    = (blobs[best].m_x*200)/width - 100;
+    target->y    = (blobs[best].m_y*200)/height - 100;
+    target->size = size < 1 ? 1 : (size > 100 ? 100 : size);
+    blobs[best].m_pixels = 0;
+  }
+}
+
+// split line moves to where DSP and ARM finish together
+static void do_splitAdapt(CodecEngine* _ce, long long _dspUs, long long _armUs)
+{
+  const size_t height  = _ce->m_srcImageDesc.m_height;
+  const size_t dspRows = _ce->m_splitDspRows;
+  const long long dspRowNs = (_dspUs*1000)/dspRows;
+  const long long armRowNs = (_armUs*1000)/(height - dspRows);
+
+  if (_ce->m_splitDspRowNs == 0 || _ce->m_splitArmRowNs == 0)
+  {
+    _ce->m_splitDspRowNs = dspRowNs;
+    _ce->m_splitArmRowNs = armRowNs;
+  }
+  else
+  {
+    _ce->m_splitDspRowNs += (dspRowNs - _ce->m_splitDspRowNs)/8;
+    _ce->m_splitArmRowNs += (armRowNs - _ce->m_splitArmRowNs)/8;
+  }
+
+  const long long rowNs = _ce->m_splitDspRowNs + _ce->m_splitArmRowNs;
+  if (rowNs > 0)
+    _ce->m_splitRows = do_splitClampRows((height*_ce->m_splitArmRowNs)/rowNs, height);
+}
+
+static int do_splitFrame(CodecEngine* _ce,
+                         const void* _srcFramePtr, size_t _srcFrameSize,
+                         bool _srcFrameContiguous, int _srcFrameFd,
+                         void* _dstFramePtr, size_t _dstFrameSize, size_t* _dstFrameUsed,
+                         bool _dstFrameContiguous,
+                         const TargetDetectParams* _targetDetectParams,
+                         const TargetDetectCommand* _targetDetectCommand,
+                         TargetLocation* _targetLocation,
+                         TargetDetectParams* _targetDetectParamsResult)
+{
+  int res;
+
+  if (_targetDetectParams->m_setHsvRange)
+  {
+    _ce->m_splitRange = *_targetDetectParams;
+    _ce->m_splitRangeSet = true;
+  }
+
+  // preview and auto detection need whole frame on DSP, ARM cannot detect before it knows the range
+  if (_ce->m_videoOutEnable || _targetDetectCommand->m_cmd != 0 || !_ce->m_splitRangeSet)
+  {
+    if ((res = do_splitSetDspRows(_ce, _ce->m_srcImageDesc.m_height)) != 0)
+      return res;
+    return do_transcodeFrame(_ce,
+                             _srcFramePtr, _srcFrameSize, _srcFrameContiguous, _srcFrameFd,
+                             _dstFramePtr, _dstFrameSize, _dstFrameUsed,
+                             _dstFrameContiguous,
+                             _targetDetectParams, _targetDetectCommand,
+                             _targetLocation, _targetDetectParamsResult);
+  }
+
+  if ((res = do_splitSetDspRows(_ce, _ce->m_splitRows)) != 0)
+    return res;
+  const size_t dspRows = _ce->m_splitDspRows;
+  const long long startUs = do_nowUs();
+
+  pthread_mutex_lock(&_ce->m_splitMutex);
+  _ce->m_splitJobSrc      = _srcFramePtr;
+  _ce->m_splitJobSrcSize  = _srcFrameSize;
+  _ce->m_splitJobRowFirst = dspRows;
+  _ce->m_splitJobPending  = true;
+  pthread_cond_broadcast(&_ce->m_splitCond);
+  pthread_mutex_unlock(&_ce->m_splitMutex);
+
+  // only DSP stripe is copied and handed over
+  TargetLocation dspLocation;
+  const int dspRes = do_transcodeFrame(_ce,
+                                       _srcFramePtr, dspRows*_ce->m_srcImageDesc.m_lineLength,
+                                       _srcFrameContiguous, _srcFrameFd,
+                                       _dstFramePtr, _dstFrameSize, _dstFrameUsed,
+                                       _dstFrameContiguous,
+                                       _targetDetectParams, _targetDetectCommand,
+                                       &dspLocation, _targetDetectParamsResult);
+  const long long dspUs = do_nowUs() - startUs;
+
+  // source frame must not be released while ARM thread still reads it
+  pthread_mutex_lock(&_ce->m_splitMutex);
+  while (_ce->m_splitJobPending)
+    pthread_cond_wait(&_ce->m_splitCond, &_ce->m_splitMutex);
+  const int armRes = _ce->m_splitJobResult;
+  const long long armUs = _ce->m_splitJobUs;
+  pthread_mutex_unlock(&_ce->m_splitMutex);
+
+  if (dspRes != 0)
+    return dspRes;
+  if (armRes != 0)
+  {
+    fprintf(stderr, "codecEngineCpuDetectRows(%zu) failed: %d\n", dspRows, armRes);
+    return armRes;
+  }
+
+  do_splitMerge(_ce, &dspLocation, &_ce->m_splitJobLocation, _targetLocation);
+  do_splitAdapt(_ce, dspUs, armUs);
+
+  ++_ce->m_splitFrames;
+  _ce->m_splitDspUs   += dspUs;
+  _ce->m_splitArmUs   += armUs;
+  _ce->m_splitFrameUs += do_nowUs() - startUs;
+
+  return 0;
 }
 
-static int do_transcodeFrame(CodecEngine* _ce,
-                             const void* _srcFramePtr, size_t _srcFrameSize,
-                             void* _dstFramePtr, size_t _dstFrameSize, size_t* _dstFrameUsed,
-                             const TargetDetectParams* _targetDetectParams,
-                             const TargetDetectCommand* _targetDetectCommand,
-                             TargetLocation* _targetLocation,
-                             TargetDetectParams* _targetDetectParamsResult)
+static void do_reportSplit(CodecEngine* _ce, long long _ms, const char* _prefix)
 {
-  if (_ce->m_srcBuffer == NULL || _ce->m_dstBuffer == NULL)
-    return ENOTCONN;
-  if (   _srcFramePtr == NULL || _dstFramePtr == NULL
-      || _targetDetectParams == NULL || _targetDetectCommand == NULL
-      || _targetLocation == NULL || _targetDetectParamsResult == NULL)
-    return EINVAL;
-  if (_srcFrameSize > _ce->m_srcBufferSize || _dstFrameSize > _ce->m_dstBufferSize)
-    return ENOSPC;
+  if (_ce->m_splitFrames > 0 && _ms > 0)
+    fprintf(stderr, "%sSplit DSP/ARM: next split at row %zu of %zu, DSP %lld us/frame, ARM %lld us/frame, total %lld us/frame\n",
+            _prefix, _ce->m_splitRows, _ce->m_srcImageDesc.m_height,
+            _ce->m_splitDspUs/_ce->m_splitFrames, _ce->m_splitArmUs/_ce->m_splitFrames,
+            _ce->m_splitFrameUs/_ce->m_splitFrames);
+
+  _ce->m_splitFrames  = 0;
+  _ce->m_splitDspUs   = 0;
+  _ce->m_splitArmUs   = 0;
+  _ce->m_splitFrameUs = 0;
+}
 
+// pipeline or split thread, as configured; image descriptions must be set
+static int do_workersStart(CodecEngine* _ce, const CodecEngineConfig* _config)
+{
+  int res;
 
-  TRIK_VIDTRANSCODE_CV_InArgs tcInArgs;
-  memset(&tcInArgs, 0, sizeof(tcInArgs));
-  tcInArgs.base.size = sizeof(tcInArgs);
-  tcInArgs.base.numBytes = _srcFrameSize;
-  tcInArgs.base.inputID = 1; // must be non-zero, otherwise caching issues appear
-  tcInArgs.alg.setHsvRange = _targetDetectParams->m_setHsvRange;
-  tcInArgs.alg.detectHue       = _targetDetectParams->m_detectHue;
-  tcInArgs.alg.detectHueTol   = _targetDetectParams->m_detectHueTolerance;
-  tcInArgs.alg.detectSat       = _targetDetectParams->m_detectSat;
-  tcInArgs.alg.detectSatTol   = _targetDetectParams->m_detectSatTolerance;
-  tcInArgs.alg.detectVal       = _targetDetectParams->m_detectVal;
-  tcInArgs.alg.detectValTol   = _targetDetectParams->m_detectValTolerance;
-  tcInArgs.alg.autoDetectHsv = _targetDetectCommand->m_cmd;
+  _ce->m_pipelineDepth = _config->m_pipelineDepth;
+  if (_ce->m_pipelineDepth < 1)
+    _ce->m_pipelineDepth = 1;
+  else if (_ce->m_pipelineDepth > CODEC_ENGINE_MAX_PIPELINE)
+    _ce->m_pipelineDepth = CODEC_ENGINE_MAX_PIPELINE;
 
-  TRIK_VIDTRANSCODE_CV_OutArgs tcOutArgs;
-  memset(&tcOutArgs,    0, sizeof(tcOutArgs));
-  tcOutArgs.base.size = sizeof(tcOutArgs);
+  _ce->m_split = false;
+  if (_ce->m_algorithms > 0 && (_ce->m_pipelineDepth > 1 || _config->m_splitArmPercent > 0))
+  {
+    fprintf(stderr, "Extra algorithms share serially processed frames, pipeline and split DSP/ARM mode disabled\n");
+    _ce->m_pipelineDepth = 1;
+  }
+  else if (_config->m_splitArmPercent > 0)
+  {
+    if (_ce->m_pipelineDepth > 1)
+    {
+      fprintf(stderr, "Split DSP/ARM mode processes frames serially, pipeline depth %zu ignored\n", _ce->m_pipelineDepth);
+      _ce->m_pipelineDepth = 1;
+    }
 
-  XDM1_BufDesc tcInBufDesc;
-  memset(&tcInBufDesc,  0, sizeof(tcInBufDesc));
-  tcInBufDesc.numBufs = 1;
-  tcInBufDesc.descs[0].buf = _ce->m_srcBuffer;
-  tcInBufDesc.descs[0].bufSize = _srcFrameSize;
+    if ((res = do_splitStart(_ce, _config->m_splitArmPercent)) != 0)
+      return res;
+  }
 
-  XDM_BufDesc tcOutBufDesc;
-  memset(&tcOutBufDesc, 0, sizeof(tcOutBufDesc));
-  XDAS_Int8* tcOutBufDesc_bufs[1];
-  XDAS_Int32 tcOutBufDesc_bufSizes[1];
-  tcOutBufDesc.numBufs = 1;
-  tcOutBufDesc.bufs = tcOutBufDesc_bufs;
-  tcOutBufDesc.bufs[0] = _ce->m_dstBuffer;
-  tcOutBufDesc.bufSizes = tcOutBufDesc_bufSizes;
-  tcOutBufDesc.bufSizes[0] = _dstFrameSize;
+  if (_ce->m_pipelineDepth > 1 && (res = do_pipeStart(_ce)) != 0)
+    return res;
 
-#warning This memcpy is blocking high fps
-  memcpy(_ce->m_srcBuffer, _srcFramePtr, _srcFrameSize);
+  return 0;
+}
 
-  Memory_cacheWbInv(_ce->m_srcBuffer, _ce->m_srcBufferSize); // invalidate and flush *whole* cache, not only written portion, just in case
-  Memory_cacheInv(_ce->m_dstBuffer, _ce->m_dstBufferSize); // invalidate *whole* cache, not only expected portion, just in case
+// frames in flight are finished and dropped
+static void do_workersStop(CodecEngine* _ce)
+{
+  do_pipeStop(_ce);
+  do_splitStop(_ce);
+  _ce->m_split = false;
+}
 
-  XDAS_Int32 processResult = VIDTRANSCODE_process(_ce->m_vidtranscodeHandle, &tcInBufDesc, &tcOutBufDesc, &tcInArgs.base, &tcOutArgs.base);
-  if (processResult != IVIDTRANSCODE_EOK)
-  {
-    fprintf(stderr, "VIDTRANSCODE_process(%zu -> %zu) failed: %"PRIi32"/%"PRIi32"\n",
-            _srcFrameSize, _dstFrameSize, processResult, tcOutArgs.base.extendedError);
-    return EILSEQ;
-  }
+// buffers are reused when new frames fit; codec instance is recreated only if its create time params do not fit
+static int do_reconfigure(CodecEngine* _ce, const CodecEngineConfig* _config,
+                          const ImageDescription* _srcImageDesc,
+                          const ImageDescription* _dstImageDesc)
+{
+  int res;
 
-  if (tcOutArgs.base.encodedBuf[0].bufSize < 0)
-  {
-    *_dstFrameUsed = 0;
-    fprintf(stderr, "VIDTRANSCODE_process(%zu -> %zu) returned negative buffer size\n",
-            _srcFrameSize, _dstFrameSize);
-  }
-  else if ((size_t)(tcOutArgs.base.encodedBuf[0].bufSize) > _dstFrameSize)
+  if (   ALIGN_UP(_srcImageDesc->m_imageSize, BUFALIGN) > _ce->m_srcBufferSize
+      || ALIGN_UP(_dstImageDesc->m_imageSize, BUFALIGN) > _ce->m_dstBufferSize)
   {
-    *_dstFrameUsed = _dstFrameSize;
-    fprintf(stderr, "VIDTRANSCODE_process(%zu -> %zu) returned too large buffer %zu, truncated\n",
-            _srcFrameSize, _dstFrameSize, *_dstFrameUsed);
+    do_memoryFree(_ce);
+    if ((res = do_memoryAlloc(_ce, _srcImageDesc->m_imageSize, _dstImageDesc->m_imageSize)) != 0)
+      return res;
   }
-  else
-    *_dstFrameUsed = tcOutArgs.base.encodedBuf[0].bufSize;
 
-#warning This memcpy is blocking high fps
-  if(_ce->m_videoOutEnable)
-    memcpy(_dstFramePtr, _ce->m_dstBuffer, *_dstFrameUsed);
+  const ImageDescription* codecSrc = &_ce->m_codecSrcImageDesc;
+  const ImageDescription* codecDst = &_ce->m_codecDstImageDesc;
+  if (   _ce->m_vidtranscodeHandle != NULL
+      && _srcImageDesc->m_format == codecSrc->m_format
+      && _dstImageDesc->m_format == codecDst->m_format
+      && do_maxSide(_srcImageDesc) <= do_maxSide(codecSrc)
+      && do_maxSide(_dstImageDesc) <= do_maxSide(codecDst))
+    return do_controlCodec(_ce, _ce->m_vidtranscodeHandle, _srcImageDesc, _dstImageDesc, _srcImageDesc->m_height);
 
+  do_releaseCodec(_ce);
+  return do_setupCodec(_ce, _config->m_codecName, _srcImageDesc, _dstImageDesc);
+}
 
-  memcpy(_targetLocation->target, tcOutArgs.alg.target, MAX_OBJECTS_N*sizeof(Target));
-/*
-  _targetLocation->m_targetX    = tcOutArgs.alg.target[0].x;
-  _targetLocation->m_targetY    = tcOutArgs.alg.target[0].y;
-  _targetLocation->m_targetSize = tcOutArgs.alg.target[0].size;
-*/
-  _targetDetectParamsResult->m_detectHue          = tcOutArgs.alg.detectHue;
-  _targetDetectParamsResult->m_detectHueTolerance = tcOutArgs.alg.detectHueTolerance;
-  _targetDetectParamsResult->m_detectSat          = tcOutArgs.alg.detectSat;
-  _targetDetectParamsResult->m_detectSatTolerance = tcOutArgs.alg.detectSatTolerance;
-  _targetDetectParamsResult->m_detectVal          = tcOutArgs.alg.detectVal;
-  _targetDetectParamsResult->m_detectValTolerance = tcOutArgs.alg.detectValTolerance;
+static const char* const s_timingStageNames[CODEC_ENGINE_TIMING_STAGES] = { "copy_in", "cache", "process", "copy_out" };
 
-  return 0;
+static void do_timingReset(CodecEngine* _ce)
+{
+  size_t stage;
+  for (stage = 0; stage < CODEC_ENGINE_TIMING_STAGES; ++stage)
+    timingHistogramReset(&_ce->m_timing[stage]);
+}
+
+static void do_reportTiming(const CodecEngine* _ce, const char* _prefix)
+{
+  size_t stage;
+  for (stage = 0; stage < CODEC_ENGINE_TIMING_STAGES; ++stage)
+  {
+    TimingSummary summary;
+    timingHistogramSummary(&_ce->m_timing[stage], &summary);
+    if (summary.m_count == 0)
+      continue;
+
+    fprintf(stderr, "%sCodec %-8s %"PRIu64" frames: min %"PRIu32", mean %"PRIu32", p50 %"PRIu32", p99 %"PRIu32", max %"PRIu32" us\n",
+            _prefix, s_timingStageNames[stage], summary.m_count,
+            summary.m_minUs, summary.m_meanUs, summary.m_p50Us, summary.m_p99Us, summary.m_maxUs);
+  }
 }
 
 static int do_reportLoad(const CodecEngine* _ce, long long _ms)
@@ -354,38 +1670,69 @@ int codecEngineInit(bool _verbose)
 
 int codecEngineFini()
 {
+  if (s_engineAdded)
+  {
+    Engine_remove("dsp-server");
+    s_engineAdded = false;
+  }
+
+  do_poolRelease();
   return 0;
 }
 
 
+static int do_cpuFallback(CodecEngine* _ce, const CodecEngineConfig* _config)
+{
+  if (!_config->m_cpuFallback)
+    return ENOMEM;
+
+  fprintf(stderr, "DSP engine unavailable, falling back to CPU detector\n");
+  _ce->m_cpu = true;
+  return 0;
+}
+
 int codecEngineOpen(CodecEngine* _ce, const CodecEngineConfig* _config)
 {
   if (_ce == NULL || _config == NULL)
     return EINVAL;
 
-  if (_ce->m_handle != NULL)
+  if (_ce->m_handle != NULL || _ce->m_cpu)
     return EALREADY;
 
+  if (_config->m_codecName != NULL && strcmp(_config->m_codecName, CODEC_ENGINE_CPU_CODEC) == 0)
+  {
+    _ce->m_cpu = true;
+    return 0;
+  }
+
+  // before capture buffers take their share of CMEM
+  do_poolReserve(_config->m_poolSize);
+
   Engine_Error ceError;
-  Engine_Desc desc;
-  Engine_initDesc(&desc);
-  desc.name = "dsp-server";
-  desc.remoteName = strdup(_config->m_serverPath);
   errno = 0;
 
-  ceError = Engine_add(&desc);
-  if (ceError != Engine_EOK)
+  // cameras are opened one by one from video thread, each gets own handle to the same engine
+  if (!s_engineAdded)
   {
+    Engine_Desc desc;
+    Engine_initDesc(&desc);
+    desc.name = "dsp-server";
+    desc.remoteName = strdup(_config->m_serverPath);
+
+    ceError = Engine_add(&desc);
     free(desc.remoteName);
-    fprintf(stderr, "Engine_add(%s) failed: %d/%"PRIi32"\n", _config->m_serverPath, errno, ceError);
-    return ENOMEM;
+    if (ceError != Engine_EOK)
+    {
+      fprintf(stderr, "Engine_add(%s) failed: %d/%"PRIi32"\n", _config->m_serverPath, errno, ceError);
+      return do_cpuFallback(_ce, _config);
+    }
+    s_engineAdded = true;
   }
-  free(desc.remoteName);
 
   if ((_ce->m_handle = Engine_open("dsp-server", NULL, &ceError)) == NULL)
   {
     fprintf(stderr, "Engine_open(%s) failed: %d/%"PRIi32"\n", _config->m_serverPath, errno, ceError);
-    return ENOMEM;
+    return do_cpuFallback(_ce, _config);
   }
 
   return 0;
@@ -396,6 +1743,12 @@ int codecEngineClose(CodecEngine* _ce)
   if (_ce == NULL)
     return EINVAL;
 
+  if (_ce->m_cpu)
+  {
+    _ce->m_cpu = false;
+    return 0;
+  }
+
   if (_ce->m_handle == NULL)
     return EALREADY;
 
@@ -415,30 +1768,126 @@ int codecEngineStart(CodecEngine* _ce, const CodecEngineConfig* _config,
   if (_ce == NULL || _config == NULL || _srcImageDesc == NULL || _dstImageDesc == NULL)
     return EINVAL;
 
+  _ce->m_timingReport = _config->m_timingReport;
+  do_timingReset(_ce);
+
+  if (_ce->m_cpu)
+  {
+    if (_config->m_algorithms > 0)
+      fprintf(stderr, "Extra algorithms need DSP, ignored in ARM detection mode\n");
+    _ce->m_pipelineDepth = 1;
+    return codecEngineCpuStart(&_ce->m_cpuDetector, _srcImageDesc, _dstImageDesc);
+  }
+
   if (_ce->m_handle == NULL)
     return ENOTCONN;
 
+  _ce->m_srcCacheMode   = _config->m_srcCacheMode;
+  _ce->m_dstCacheMode   = _config->m_dstCacheMode;
+  _ce->m_cacheBenchmark = _config->m_cacheBenchmark;
+  _ce->m_cacheFrames = 0;
+  _ce->m_cacheSrcUs  = 0;
+  _ce->m_cacheDstUs  = 0;
+
+  if (_ce->m_cacheBenchmark)
+    do_cacheBenchmark(_srcImageDesc->m_imageSize, _dstImageDesc->m_imageSize);
+
   if ((res = do_memoryAlloc(_ce, _srcImageDesc->m_imageSize, _dstImageDesc->m_imageSize)) != 0)
     return res;
 
+  do_srcImportReset(_ce);
+
   if ((res = do_setupCodec(_ce, _config->m_codecName, _srcImageDesc, _dstImageDesc)) != 0)
   {
     do_memoryFree(_ce);
     return res;
   }
 
+  if ((res = do_setupAlgorithms(_ce, _config, _srcImageDesc, _dstImageDesc)) != 0)
+  {
+    do_releaseCodec(_ce);
+    do_memoryFree(_ce);
+    return res;
+  }
+
+  _ce->m_srcImageDesc = *_srcImageDesc;
+  _ce->m_dstImageDesc = *_dstImageDesc;
+  if ((res = do_workersStart(_ce, _config)) != 0)
+  {
+    do_releaseAlgorithms(_ce);
+    do_releaseCodec(_ce);
+    do_memoryFree(_ce);
+    return res;
+  }
+
   return 0;
 }
 
+int codecEngineReconfigure(CodecEngine* _ce, const CodecEngineConfig* _config,
+                           const ImageDescription* _srcImageDesc,
+                           const ImageDescription* _dstImageDesc)
+{
+  int res;
+
+  if (_ce == NULL || _config == NULL || _srcImageDesc == NULL || _dstImageDesc == NULL)
+    return EINVAL;
+
+  if (_ce->m_cpu)
+  {
+    const ImageDescription srcImageDescOld = _ce->m_cpuDetector.m_srcImageDesc;
+    const ImageDescription dstImageDescOld = _ce->m_cpuDetector.m_dstImageDesc;
+
+    codecEngineCpuStop(&_ce->m_cpuDetector);
+    if ((res = codecEngineCpuStart(&_ce->m_cpuDetector, _srcImageDesc, _dstImageDesc)) == 0)
+      return 0;
+
+    // keep detector running on previous format, caller restores capture
+    codecEngineCpuStop(&_ce->m_cpuDetector);
+    if (codecEngineCpuStart(&_ce->m_cpuDetector, &srcImageDescOld, &dstImageDescOld) != 0)
+      fprintf(stderr, "CPU detector: failed to restore previous format\n");
+    return res;
+  }
+
+  if (_ce->m_handle == NULL)
+    return ENOTCONN;
+
+  do_workersStop(_ce);
+  do_srcImportRelease(_ce); // capture buffers are new
+  do_releaseAlgorithms(_ce); // scratch buffer follows output size
+
+  if (   (res = do_reconfigure(_ce, _config, _srcImageDesc, _dstImageDesc)) != 0
+      || (res = do_setupAlgorithms(_ce, _config, _srcImageDesc, _dstImageDesc)) != 0)
+  {
+    // bring codec and workers back on previous format, caller restores capture
+    do_releaseAlgorithms(_ce);
+    int resRestore;
+    if (   (resRestore = do_reconfigure(_ce, _config, &_ce->m_srcImageDesc, &_ce->m_dstImageDesc)) != 0
+        || (resRestore = do_setupAlgorithms(_ce, _config, &_ce->m_srcImageDesc, &_ce->m_dstImageDesc)) != 0
+        || (resRestore = do_workersStart(_ce, _config)) != 0)
+      fprintf(stderr, "Codec engine failed to restore previous format: %d\n", resRestore);
+    return res;
+  }
+
+  _ce->m_srcImageDesc = *_srcImageDesc;
+  _ce->m_dstImageDesc = *_dstImageDesc;
+  return do_workersStart(_ce, _config);
+}
+
 int codecEngineStop(CodecEngine* _ce)
 {
   if (_ce == NULL)
     return EINVAL;
 
+  if (_ce->m_cpu)
+    return codecEngineCpuStop(&_ce->m_cpuDetector);
+
   if (_ce->m_handle == NULL)
     return ENOTCONN;
 
+  do_workersStop(_ce);
+  do_releaseAlgorithms(_ce);
   do_releaseCodec(_ce);
+  do_srcImportRelease(_ce);
   do_memoryFree(_ce);
 
   return 0;
@@ -446,7 +1895,9 @@ int codecEngineStop(CodecEngine* _ce)
 
 int codecEngineTranscodeFrame(CodecEngine* _ce,
                               const void* _srcFramePtr, size_t _srcFrameSize,
+                              bool _srcFrameContiguous, int _srcFrameFd,
                               void* _dstFramePtr, size_t _dstFrameSize, size_t* _dstFrameUsed,
+                              bool _dstFrameContiguous,
                               const TargetDetectParams* _targetDetectParams,
                               const TargetDetectCommand* _targetDetectCommand,
                               TargetLocation* _targetLocation,
@@ -457,16 +1908,39 @@ int codecEngineTranscodeFrame(CodecEngine* _ce,
   if (_ce == NULL || _targetDetectParams == NULL || _targetDetectCommand == NULL || _targetLocation == NULL || _targetDetectParamsResult == NULL)
     return EINVAL;
 
-  if (_ce->m_handle == NULL)
+  if (_ce->m_cpu)
+  {
+    const long long startUs = do_nowUs();
+    res = codecEngineCpuProcess(&_ce->m_cpuDetector,
+                                _srcFramePtr, _srcFrameSize,
+                                _dstFramePtr, _dstFrameSize, _dstFrameUsed,
+                                _ce->m_videoOutEnable,
+                                _targetDetectParams,
+                                _targetDetectCommand,
+                                _targetLocation,
+                                _targetDetectParamsResult);
+    timingHistogramAdd(&_ce->m_timing[CODEC_ENGINE_TIMING_PROCESS], do_nowUs() - startUs);
+  }
+  else if (_ce->m_handle == NULL)
     return ENOTCONN;
-
-  res = do_transcodeFrame(_ce,
-                          _srcFramePtr, _srcFrameSize,
-                          _dstFramePtr, _dstFrameSize, _dstFrameUsed,
-                          _targetDetectParams,
-                          _targetDetectCommand,
-                          _targetLocation,
-                          _targetDetectParamsResult);
+  else if (_ce->m_split)
+    res = do_splitFrame(_ce,
+                        _srcFramePtr, _srcFrameSize, _srcFrameContiguous, _srcFrameFd,
+                        _dstFramePtr, _dstFrameSize, _dstFrameUsed,
+                        _dstFrameContiguous,
+                        _targetDetectParams,
+                        _targetDetectCommand,
+                        _targetLocation,
+                        _targetDetectParamsResult);
+  else
+    res = do_transcodeFrame(_ce,
+                            _srcFramePtr, _srcFrameSize, _srcFrameContiguous, _srcFrameFd,
+                            _dstFramePtr, _dstFrameSize, _dstFrameUsed,
+                            _dstFrameContiguous,
+                            _targetDetectParams,
+                            _targetDetectCommand,
+                            _targetLocation,
+                            _targetDetectParamsResult);
 
   if (s_verbose)
   {
@@ -482,15 +1956,182 @@ int codecEngineTranscodeFrame(CodecEngine* _ce,
   return res;
 }
 
-int codecEngineReportLoad(const CodecEngine* _ce, long long _ms)
+bool codecEnginePipelined(const CodecEngine* _ce)
+{
+  if (_ce == NULL)
+    return false;
+
+  return _ce->m_pipeThreadRunning;
+}
+
+int codecEngineSubmitFrame(CodecEngine* _ce,
+                           const void* _srcFramePtr, size_t _srcFrameSize,
+                           void* _dstFramePtr, size_t _dstFrameSize,
+                           bool _dstFrameContiguous,
+                           const TargetDetectParams* _targetDetectParams,
+                           const TargetDetectCommand* _targetDetectCommand,
+                           const FrameInfo* _frameInfo)
+{
+  if (   _ce == NULL || _srcFramePtr == NULL || _dstFramePtr == NULL
+      || _targetDetectParams == NULL || _targetDetectCommand == NULL || _frameInfo == NULL)
+    return EINVAL;
+
+  if (_ce->m_handle == NULL || !_ce->m_pipeThreadRunning)
+    return ENOTCONN;
+
+  return do_submitFrame(_ce,
+                        _srcFramePtr, _srcFrameSize,
+                        _dstFramePtr, _dstFrameSize,
+                        _dstFrameContiguous,
+                        _targetDetectParams,
+                        _targetDetectCommand,
+                        _frameInfo);
+}
+
+int codecEngineCollectFrame(CodecEngine* _ce,
+                            void* _dstFramePtr, size_t _dstFrameSize, size_t* _dstFrameUsed,
+                            TargetDetectCommand* _targetDetectCommand,
+                            TargetLocation* _targetLocation,
+                            TargetDetectParams* _targetDetectParamsResult,
+                            FrameInfo* _frameInfo)
+{
+  if (   _ce == NULL || _dstFramePtr == NULL || _dstFrameUsed == NULL || _targetDetectCommand == NULL
+      || _targetLocation == NULL || _targetDetectParamsResult == NULL || _frameInfo == NULL)
+    return EINVAL;
+
+  if (_ce->m_handle == NULL || !_ce->m_pipeThreadRunning)
+    return ENOTCONN;
+
+  return do_collectFrame(_ce,
+                         _dstFramePtr, _dstFrameSize, _dstFrameUsed,
+                         _targetDetectCommand,
+                         _targetLocation,
+                         _targetDetectParamsResult,
+                         _frameInfo);
+}
+
+int codecEngineReportLoad(CodecEngine* _ce, long long _ms, const char* _prefix)
+{
+  if (_ce == NULL || _prefix == NULL)
+    return EINVAL;
+
+  if (_ce->m_timingReport)
+    do_reportTiming(_ce, _prefix);
+
+  if (_ce->m_cpu)
+    return codecEngineCpuReportLoad(&_ce->m_cpuDetector, _ms, _prefix);
+
+  if (_ce->m_handle == NULL)
+    return ENOTCONN;
+
+  if (_ce->m_pipeThreadRunning)
+    do_reportPipeline(_ce, _ms, _prefix);
+  if (_ce->m_split)
+    do_reportSplit(_ce, _ms, _prefix);
+
+  if (_ce->m_cacheBenchmark && _ce->m_cacheFrames > 0)
+  {
+    fprintf(stderr, "%sCache maintenance src %s %lld us/frame, dst %s %lld us/frame\n",
+            _prefix, do_cacheModeName(_ce->m_srcCacheMode), _ce->m_cacheSrcUs/_ce->m_cacheFrames,
+            do_cacheModeName(_ce->m_dstCacheMode), _ce->m_cacheDstUs/_ce->m_cacheFrames);
+    _ce->m_cacheFrames = 0;
+    _ce->m_cacheSrcUs  = 0;
+    _ce->m_cacheDstUs  = 0;
+  }
+
+  return 0;
+}
+
+int codecEngineReportServerLoad(CodecEngine* _ce, long long _ms)
 {
   if (_ce == NULL)
     return EINVAL;
 
+  do_poolReport();
+
+  if (_ce->m_cpu)
+    return 0;
+
   if (_ce->m_handle == NULL)
     return ENOTCONN;
 
   return do_reportLoad(_ce, _ms);
 }
 
+const char* codecEngineTimingStageName(CodecEngineTimingStage _stage)
+{
+  if ((size_t)_stage >= CODEC_ENGINE_TIMING_STAGES)
+    return "unknown";
+
+  return s_timingStageNames[_stage];
+}
+
+int codecEngineGetTiming(const CodecEngine* _ce, CodecEngineTimingStage _stage, TimingSummary* _summary)
+{
+  if (_ce == NULL || _summary == NULL || (size_t)_stage >= CODEC_ENGINE_TIMING_STAGES)
+    return EINVAL;
+
+  timingHistogramSummary(&_ce->m_timing[_stage], _summary);
+
+  return 0;
+}
+
+int codecEngineResetTiming(CodecEngine* _ce)
+{
+  if (_ce == NULL)
+    return EINVAL;
+
+  do_timingReset(_ce);
+
+  return 0;
+}
+
+int codecEngineGetLoad(CodecEngine* _ce, int* _percent)
+{
+  if (_ce == NULL || _percent == NULL)
+    return EINVAL;
+
+  if (_ce->m_cpu)
+    return ENOTSUP;
+
+  if (_ce->m_handle == NULL)
+    return ENOTCONN;
+
+  Server_Handle ceServerHandle = Engine_getServer(_ce->m_handle);
+  if (ceServerHandle == NULL)
+    return ENOTCONN;
+
+  *_percent = (int)Server_getCpuLoad(ceServerHandle);
+
+  return 0;
+}
+
+size_t codecEngineAlgorithms(const CodecEngine* _ce)
+{
+  if (_ce == NULL)
+    return 0;
+
+  return _ce->m_algorithms;
+}
+
+const char* codecEngineAlgorithmName(const CodecEngine* _ce, size_t _algorithm)
+{
+  if (_ce == NULL || _algorithm >= _ce->m_algorithms)
+    return NULL;
+
+  return _ce->m_algorithm[_algorithm].m_codecName;
+}
+
+// ENODATA when algorithm failed on last frame
+int codecEngineGetAlgorithmResult(const CodecEngine* _ce, size_t _algorithm, AlgorithmResult* _result)
+{
+  if (_ce == NULL || _result == NULL || _algorithm >= _ce->m_algorithms)
+    return EINVAL;
+
+  if (!_ce->m_algorithm[_algorithm].m_fresh)
+    return ENODATA;
+
+  *_result = _ce->m_algorithm[_algorithm].m_result;
 
+  return 0;
+}
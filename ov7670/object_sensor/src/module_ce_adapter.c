@@ -0,0 +1,43 @@
+#include "config.h"
+#include <string.h>
+
+#include "internal/module_ce_adapter.h"
+
+
+static const CodecEngineAdapter* do_adapter(size_t _index)
+{
+  switch (_index)
+  {
+    case 0:  return codecEngineAdapterObject();
+    case 1:  return codecEngineAdapterLine();
+    default: return NULL;
+  }
+}
+
+size_t codecEngineAdapters()
+{
+  size_t count = 0;
+  while (do_adapter(count) != NULL)
+    ++count;
+
+  return count;
+}
+
+const CodecEngineAdapter* codecEngineAdapter(size_t _index)
+{
+  return do_adapter(_index);
+}
+
+const CodecEngineAdapter* codecEngineAdapterFind(const char* _codecName)
+{
+  if (_codecName == NULL)
+    return NULL;
+
+  size_t idx;
+  const CodecEngineAdapter* adapter;
+  for (idx = 0; (adapter = do_adapter(idx)) != NULL; ++idx)
+    if (strcmp(adapter->m_codecName, _codecName) == 0)
+      return adapter;
+
+  return NULL;
+}
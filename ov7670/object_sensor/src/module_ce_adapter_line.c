@@ -0,0 +1,70 @@
+#include "config.h"
+
+#include <xdc/std.h>
+#include <ti/xdais/xdas.h>
+#include <ti/sdo/ce/vidtranscode/vidtranscode.h>
+
+// webcam line sensor args, they share names but not layout with this sensor header
+#include "webcam/line_sensor/trik_vidtranscode_cv.h"
+
+#include "internal/module_ce_adapter.h"
+
+
+static int makeValueRange(int _val, int _adj, int _min, int _max)
+{
+  _val += _adj;
+  if (_val > _max)
+    return _max;
+  else if (_val < _min)
+    return _min;
+  else
+    return _val;
+}
+
+static int makeValueWrap(int _val, int _adj, int _min, int _max)
+{
+  _val += _adj;
+  while (_val > _max)
+    _val -= (_max-_min+1);
+  while (_val < _min)
+    _val += (_max-_min+1);
+
+  return _val;
+}
+
+// line codec takes ranges instead of value and tolerance
+static void do_fillInArgs(void* _inArgs, const TargetDetectParams* _targetDetectParams)
+{
+  TRIK_VIDTRANSCODE_CV_InArgs* tcInArgs = (TRIK_VIDTRANSCODE_CV_InArgs*)_inArgs;
+  tcInArgs->alg.detectHueFrom = makeValueWrap( _targetDetectParams->m_detectHue, -_targetDetectParams->m_detectHueTolerance, 0, 359);
+  tcInArgs->alg.detectHueTo   = makeValueWrap( _targetDetectParams->m_detectHue, +_targetDetectParams->m_detectHueTolerance, 0, 359);
+  tcInArgs->alg.detectSatFrom = makeValueRange(_targetDetectParams->m_detectSat, -_targetDetectParams->m_detectSatTolerance, 0, 100);
+  tcInArgs->alg.detectSatTo   = makeValueRange(_targetDetectParams->m_detectSat, +_targetDetectParams->m_detectSatTolerance, 0, 100);
+  tcInArgs->alg.detectValFrom = makeValueRange(_targetDetectParams->m_detectVal, -_targetDetectParams->m_detectValTolerance, 0, 100);
+  tcInArgs->alg.detectValTo   = makeValueRange(_targetDetectParams->m_detectVal, +_targetDetectParams->m_detectValTolerance, 0, 100);
+  tcInArgs->alg.autoDetectHsv = 0;
+}
+
+static void do_readOutArgs(const void* _outArgs, AlgorithmResult* _result)
+{
+  const TRIK_VIDTRANSCODE_CV_OutArgs* tcOutArgs = (const TRIK_VIDTRANSCODE_CV_OutArgs*)_outArgs;
+
+  _result->m_type = ALGORITHM_RESULT_LINE;
+  _result->m_lineLocation.m_lineX    = tcOutArgs->alg.targetX;
+  _result->m_lineLocation.m_lineY    = tcOutArgs->alg.targetY;
+  _result->m_lineLocation.m_lineSize = tcOutArgs->alg.targetSize;
+}
+
+const CodecEngineAdapter* codecEngineAdapterLine()
+{
+  static const CodecEngineAdapter s_adapter = {
+    "vidtranscode_line",
+    ALGORITHM_RESULT_LINE,
+    sizeof(TRIK_VIDTRANSCODE_CV_InArgs),
+    sizeof(TRIK_VIDTRANSCODE_CV_OutArgs),
+    do_fillInArgs,
+    do_readOutArgs
+  };
+
+  return &s_adapter;
+}
@@ -0,0 +1,52 @@
+#include "config.h"
+
+#include <xdc/std.h>
+#include <ti/xdais/xdas.h>
+#include <ti/sdo/ce/vidtranscode/vidtranscode.h>
+
+#include "trik_vidtranscode_cv.h"
+
+#include "internal/module_ce_adapter.h"
+
+
+// same args as main codec, auto detection stays main codec business
+static void do_fillInArgs(void* _inArgs, const TargetDetectParams* _targetDetectParams)
+{
+  TRIK_VIDTRANSCODE_CV_InArgs* tcInArgs = (TRIK_VIDTRANSCODE_CV_InArgs*)_inArgs;
+  tcInArgs->alg.setHsvRange  = _targetDetectParams->m_setHsvRange;
+  tcInArgs->alg.detectHue    = _targetDetectParams->m_detectHue;
+  tcInArgs->alg.detectHueTol = _targetDetectParams->m_detectHueTolerance;
+  tcInArgs->alg.detectSat    = _targetDetectParams->m_detectSat;
+  tcInArgs->alg.detectSatTol = _targetDetectParams->m_detectSatTolerance;
+  tcInArgs->alg.detectVal    = _targetDetectParams->m_detectVal;
+  tcInArgs->alg.detectValTol = _targetDetectParams->m_detectValTolerance;
+  tcInArgs->alg.autoDetectHsv = 0;
+}
+
+static void do_readOutArgs(const void* _outArgs, AlgorithmResult* _result)
+{
+  const TRIK_VIDTRANSCODE_CV_OutArgs* tcOutArgs = (const TRIK_VIDTRANSCODE_CV_OutArgs*)_outArgs;
+  size_t idx;
+
+  _result->m_type = ALGORITHM_RESULT_TARGETS;
+  for (idx = 0; idx < MAX_OBJECTS_N; ++idx)
+  {
+    _result->m_targetLocation.target[idx].x    = tcOutArgs->alg.target[idx].x;
+    _result->m_targetLocation.target[idx].y    = tcOutArgs->alg.target[idx].y;
+    _result->m_targetLocation.target[idx].size = tcOutArgs->alg.target[idx].size;
+  }
+}
+
+const CodecEngineAdapter* codecEngineAdapterObject()
+{
+  static const CodecEngineAdapter s_adapter = {
+    "vidtranscode_cv",
+    ALGORITHM_RESULT_TARGETS,
+    sizeof(TRIK_VIDTRANSCODE_CV_InArgs),
+    sizeof(TRIK_VIDTRANSCODE_CV_OutArgs),
+    do_fillInArgs,
+    do_readOutArgs
+  };
+
+  return &s_adapter;
+}
@@ -0,0 +1,678 @@
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdio.h>
+
+#include <linux/videodev2.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CE_CPU_NEON 1
+#endif
+
+#include "internal/module_ce_cpu.h"
+
+
+#define CPU_KEYS (1u<<16)
+
+#define CPU_HIGHLIGHT_RGB 0x0000ff00u
+#define CPU_TARGET_RGB    0x00ff0000u
+#define CPU_TARGET_CROSS  6
+
+
+static long long do_cpuNowUs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec*1000000 + now.tv_nsec/1000;
+}
+
+static int do_clamp(int _val, int _min, int _max)
+{
+  return _val < _min ? _min : (_val > _max ? _max : _val);
+}
+
+static bool do_formatIsYuv(uint32_t _format)
+{
+  return _format == V4L2_PIX_FMT_YUV422P || _format == V4L2_PIX_FMT_YUYV || _format == V4L2_PIX_FMT_YUV32;
+}
+
+static bool do_formatSupported(uint32_t _format)
+{
+  switch (_format)
+  {
+    case V4L2_PIX_FMT_RGB24:
+    case V4L2_PIX_FMT_RGB565:
+    case V4L2_PIX_FMT_RGB565X:
+    case V4L2_PIX_FMT_YUV32:
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_YUV422P:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+// key is RGB565 for RGB sources, Y6U5V5 for YUV sources
+static uint32_t do_keyToRgb(bool _yuv, uint32_t _key)
+{
+  int r, g, b;
+  if (!_yuv)
+  {
+    r = ((_key>>11)&0x1f)<<3;
+    g = ((_key>> 5)&0x3f)<<2;
+    b = ((_key    )&0x1f)<<3;
+    r |= r>>5;
+    g |= g>>6;
+    b |= b>>5;
+  }
+  else
+  {
+    const int y = ((int)((_key>>10)&0x3f)<<2) + 2;
+    const int u = ((int)((_key>> 5)&0x1f)<<3) + 4 - 128;
+    const int v = ((int)((_key    )&0x1f)<<3) + 4 - 128;
+    r = do_clamp(y + ((359*v)>>8), 0, 255);
+    g = do_clamp(y - ((88*u + 183*v)>>8), 0, 255);
+    b = do_clamp(y + ((454*u)>>8), 0, 255);
+  }
+
+  return ((uint32_t)r<<16) | ((uint32_t)g<<8) | (uint32_t)b;
+}
+
+// hue 0..359, sat and val 0..100, same scale as vidtranscode_cv
+static void do_rgbToHsv(uint32_t _rgb, int* _hue, int* _sat, int* _val)
+{
+  const int r = (_rgb>>16)&0xff;
+  const int g = (_rgb>> 8)&0xff;
+  const int b = (_rgb    )&0xff;
+  const int max = r > g ? (r > b ? r : b) : (g > b ? g : b);
+  const int min = r < g ? (r < b ? r : b) : (g < b ? g : b);
+  const int delta = max - min;
+
+  *_val = (max*100)/255;
+  *_sat = max == 0 ? 0 : (delta*100)/max;
+
+  int hue;
+  if (delta == 0)
+    hue = 0;
+  else if (max == r)
+    hue = (60*(g-b))/delta;
+  else if (max == g)
+    hue = 120 + (60*(b-r))/delta;
+  else
+    hue = 240 + (60*(r-g))/delta;
+  if (hue < 0)
+    hue += 360;
+  *_hue = hue;
+}
+
+static int do_hueDistance(int _a, int _b)
+{
+  int d = _a > _b ? _a - _b : _b - _a;
+  return d > 180 ? 360 - d : d;
+}
+
+static void do_buildMatch(CodecEngineCpu* _cpu, const TargetDetectParams* _range)
+{
+  uint32_t key;
+  for (key = 0; key < CPU_KEYS; ++key)
+  {
+    int hue, sat, val;
+    do_rgbToHsv(_cpu->m_keyRgb[key], &hue, &sat, &val);
+    _cpu->m_keyMatch[key] =    do_hueDistance(hue, _range->m_detectHue) <= _range->m_detectHueTolerance
+                            && abs(sat - _range->m_detectSat) <= _range->m_detectSatTolerance
+                            && abs(val - _range->m_detectVal) <= _range->m_detectValTolerance;
+  }
+
+  _cpu->m_range = *_range;
+  _cpu->m_rangeValid = true;
+}
+
+
+#ifdef CE_CPU_NEON
+// 6 bits Y, 5 bits U, 5 bits V
+static inline uint16x8_t do_yuvKeysNeon(uint8x8_t _y, uint8x8_t _u, uint8x8_t _v)
+{
+  const uint16x8_t y = vshlq_n_u16(vmovl_u8(vshr_n_u8(_y, 2)), 10);
+  const uint16x8_t u = vshlq_n_u16(vmovl_u8(vshr_n_u8(_u, 3)), 5);
+  return vorrq_u16(vorrq_u16(y, u), vmovl_u8(vshr_n_u8(_v, 3)));
+}
+
+// RGB565 out of 8 bit channels
+static inline uint16x8_t do_rgbKeysNeon(uint8x8_t _r, uint8x8_t _g, uint8x8_t _b)
+{
+  uint16x8_t key = vshll_n_u8(_r, 8);
+  key = vsriq_n_u16(key, vshll_n_u8(_g, 8), 5);
+  return vsriq_n_u16(key, vshll_n_u8(_b, 8), 11);
+}
+#endif
+
+// Row to keys. NEON converts 16 pixels per step where available, scalar loops finish the tail.
+// Matching keys afterwards is a gather from 64K table and stays scalar.
+static void do_rowKeys(const CodecEngineCpu* _cpu, const uint8_t* _src, size_t _row, uint16_t* restrict _keys)
+{
+  const ImageDescription* desc = &_cpu->m_srcImageDesc;
+  const size_t width = desc->m_width;
+  size_t x = 0;
+
+  switch (desc->m_format)
+  {
+    case V4L2_PIX_FMT_YUV422P:
+    {
+      const size_t chromaLineLength = desc->m_lineLength/2;
+      const uint8_t* restrict y = _src + _row*desc->m_lineLength;
+      const uint8_t* restrict u = _src + desc->m_height*desc->m_lineLength + _row*chromaLineLength;
+      const uint8_t* restrict v = u + desc->m_height*chromaLineLength;
+#ifdef CE_CPU_NEON
+      for (; x+16 <= width; x += 16)
+      {
+        const uint8x16_t yy = vld1q_u8(y + x);
+        const uint8x8x2_t uu = vzip_u8(vld1_u8(u + x/2), vld1_u8(u + x/2)); // chroma is shared by pixel pairs
+        const uint8x8x2_t vv = vzip_u8(vld1_u8(v + x/2), vld1_u8(v + x/2));
+        vst1q_u16(_keys + x,   do_yuvKeysNeon(vget_low_u8(yy),  uu.val[0], vv.val[0]));
+        vst1q_u16(_keys + x+8, do_yuvKeysNeon(vget_high_u8(yy), uu.val[1], vv.val[1]));
+      }
+#endif
+      for (; x < width; ++x)
+        _keys[x] = ((y[x]>>2)<<10) | ((u[x/2]>>3)<<5) | (v[x/2]>>3);
+      break;
+    }
+
+    case V4L2_PIX_FMT_YUYV:
+    {
+      const uint8_t* restrict p = _src + _row*desc->m_lineLength;
+#ifdef CE_CPU_NEON
+      for (; x+16 <= width; x += 16)
+      {
+        const uint8x8x4_t yuyv = vld4_u8(p + x*2); // Y0, U, Y1, V of 8 pixel pairs
+        uint16x8x2_t keys;
+        keys.val[0] = do_yuvKeysNeon(yuyv.val[0], yuyv.val[1], yuyv.val[3]);
+        keys.val[1] = do_yuvKeysNeon(yuyv.val[2], yuyv.val[1], yuyv.val[3]);
+        vst2q_u16(_keys + x, keys);
+      }
+#endif
+      for (; x < width; ++x)
+        _keys[x] = ((p[x*2]>>2)<<10) | ((p[(x&~(size_t)1)*2+1]>>3)<<5) | (p[(x&~(size_t)1)*2+3]>>3);
+      break;
+    }
+
+    case V4L2_PIX_FMT_YUV32: // Y, U, V, unused
+    {
+      const uint8_t* restrict p = _src + _row*desc->m_lineLength;
+#ifdef CE_CPU_NEON
+      for (; x+16 <= width; x += 16)
+      {
+        const uint8x16x4_t yuvx = vld4q_u8(p + x*4);
+        vst1q_u16(_keys + x,   do_yuvKeysNeon(vget_low_u8(yuvx.val[0]),  vget_low_u8(yuvx.val[1]),  vget_low_u8(yuvx.val[2])));
+        vst1q_u16(_keys + x+8, do_yuvKeysNeon(vget_high_u8(yuvx.val[0]), vget_high_u8(yuvx.val[1]), vget_high_u8(yuvx.val[2])));
+      }
+#endif
+      for (; x < width; ++x)
+        _keys[x] = ((p[x*4]>>2)<<10) | ((p[x*4+1]>>3)<<5) | (p[x*4+2]>>3);
+      break;
+    }
+
+    case V4L2_PIX_FMT_RGB565:
+    {
+      const uint8_t* restrict p = _src + _row*desc->m_lineLength;
+#ifdef CE_CPU_NEON
+      for (; x+16 <= width; x += 16)
+      {
+        vst1q_u16(_keys + x,   vreinterpretq_u16_u8(vld1q_u8(p + x*2)));
+        vst1q_u16(_keys + x+8, vreinterpretq_u16_u8(vld1q_u8(p + x*2+16)));
+      }
+#endif
+      for (; x < width; ++x)
+        _keys[x] = p[x*2] | (p[x*2+1]<<8);
+      break;
+    }
+
+    case V4L2_PIX_FMT_RGB565X:
+    {
+      const uint8_t* restrict p = _src + _row*desc->m_lineLength;
+#ifdef CE_CPU_NEON
+      for (; x+16 <= width; x += 16)
+      {
+        vst1q_u16(_keys + x,   vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(p + x*2))));
+        vst1q_u16(_keys + x+8, vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(p + x*2+16))));
+      }
+#endif
+      for (; x < width; ++x)
+        _keys[x] = (p[x*2]<<8) | p[x*2+1];
+      break;
+    }
+
+    case V4L2_PIX_FMT_RGB24:
+    {
+      const uint8_t* restrict p = _src + _row*desc->m_lineLength;
+#ifdef CE_CPU_NEON
+      for (; x+16 <= width; x += 16)
+      {
+        const uint8x16x3_t rgb = vld3q_u8(p + x*3);
+        vst1q_u16(_keys + x,   do_rgbKeysNeon(vget_low_u8(rgb.val[0]),  vget_low_u8(rgb.val[1]),  vget_low_u8(rgb.val[2])));
+        vst1q_u16(_keys + x+8, do_rgbKeysNeon(vget_high_u8(rgb.val[0]), vget_high_u8(rgb.val[1]), vget_high_u8(rgb.val[2])));
+      }
+#endif
+      for (; x < width; ++x)
+        _keys[x] = ((p[x*3]>>3)<<11) | ((p[x*3+1]>>2)<<5) | (p[x*3+2]>>3);
+      break;
+    }
+  }
+}
+
+
+static void do_autoDetectHsv(CodecEngineCpu* _cpu, const uint8_t* _src, TargetDetectParams* _result)
+{
+  const size_t width  = _cpu->m_srcImageDesc.m_width;
+  const size_t height = _cpu->m_srcImageDesc.m_height;
+  const size_t winW = width/8  > 8 ? width/8  : (width  < 8 ? width  : 8);
+  const size_t winH = height/8 > 8 ? height/8 : (height < 8 ? height : 8);
+  const size_t winX = (width-winW)/2;
+  const size_t winY = (height-winH)/2;
+
+  unsigned hueHist[36];
+  memset(hueHist, 0, sizeof(hueHist));
+  long satSum = 0, valSum = 0, pixels = 0;
+
+  size_t row, x;
+  for (row = winY; row < winY+winH; ++row)
+  {
+    do_rowKeys(_cpu, _src, row, _cpu->m_rowKeys);
+    for (x = winX; x < winX+winW; ++x)
+    {
+      int hue, sat, val;
+      do_rgbToHsv(_cpu->m_keyRgb[_cpu->m_rowKeys[x]], &hue, &sat, &val);
+      if (sat >= 10) // hue of greyish pixels is noise
+        ++hueHist[hue/10];
+      satSum += sat;
+      valSum += val;
+      ++pixels;
+    }
+  }
+  if (pixels == 0)
+    return;
+
+  size_t peak = 0, bin;
+  for (bin = 1; bin < 36; ++bin)
+    if (hueHist[bin] > hueHist[peak])
+      peak = bin;
+  const int hue = peak*10 + 5;
+  const int sat = satSum/pixels;
+  const int val = valSum/pixels;
+
+  // tolerances from mean deviation around chosen center, taken over pixels near peak hue
+  long hueDev = 0, hueCnt = 0, satDev = 0, valDev = 0;
+  for (row = winY; row < winY+winH; ++row)
+  {
+    do_rowKeys(_cpu, _src, row, _cpu->m_rowKeys);
+    for (x = winX; x < winX+winW; ++x)
+    {
+      int h, s, v;
+      do_rgbToHsv(_cpu->m_keyRgb[_cpu->m_rowKeys[x]], &h, &s, &v);
+      const int d = do_hueDistance(h, hue);
+      if (s >= 10 && d <= 60)
+      {
+        hueDev += d;
+        ++hueCnt;
+      }
+      satDev += abs(s - sat);
+      valDev += abs(v - val);
+    }
+  }
+
+  _result->m_detectHue          = hue;
+  _result->m_detectHueTolerance = do_clamp(hueCnt > 0 ? (2*hueDev)/hueCnt : 60, 10, 60);
+  _result->m_detectSat          = sat;
+  _result->m_detectSatTolerance = do_clamp((2*satDev)/pixels, 10, 50);
+  _result->m_detectVal          = val;
+  _result->m_detectValTolerance = do_clamp((2*valDev)/pixels, 10, 50);
+}
+
+
+static size_t do_blockFind(size_t* _parent, size_t _block)
+{
+  while (_parent[_block] != _block)
+  {
+    _parent[_block] = _parent[_parent[_block]];
+    _block = _parent[_block];
+  }
+  return _block;
+}
+
+static void do_blockUnion(size_t* _parent, size_t _a, size_t _b)
+{
+  _a = do_blockFind(_parent, _a);
+  _b = do_blockFind(_parent, _b);
+  if (_a != _b)
+    _parent[_b] = _a;
+}
+
+static bool do_rangeEqual(const TargetDetectParams* _a, const TargetDetectParams* _b)
+{
+  return    _a->m_detectHue == _b->m_detectHue && _a->m_detectHueTolerance == _b->m_detectHueTolerance
+         && _a->m_detectSat == _b->m_detectSat && _a->m_detectSatTolerance == _b->m_detectSatTolerance
+         && _a->m_detectVal == _b->m_detectVal && _a->m_detectValTolerance == _b->m_detectValTolerance;
+}
+
+// targets in rows [_rowFirst, _rowFirst+_rows), coordinates and sizes relative to whole frame
+static void do_detectTargets(CodecEngineCpu* _cpu, const uint8_t* _src, size_t _rowFirst, size_t _rows,
+                             TargetLocation* _targetLocation)
+{
+  const size_t width  = _cpu->m_srcImageDesc.m_width;
+  const size_t height = _cpu->m_srcImageDesc.m_height;
+
+  memset(_cpu->m_blockCount, 0, sizeof(_cpu->m_blockCount));
+  memset(_cpu->m_blockSumX,  0, sizeof(_cpu->m_blockSumX));
+  memset(_cpu->m_blockSumY,  0, sizeof(_cpu->m_blockSumY));
+
+  size_t row, x;
+  for (row = _rowFirst; row < _rowFirst+_rows; ++row)
+  {
+    do_rowKeys(_cpu, _src, row, _cpu->m_rowKeys);
+
+    const size_t blockRow = ((row-_rowFirst)*CODEC_ENGINE_CPU_BLOCKS_Y/_rows)*CODEC_ENGINE_CPU_BLOCKS_X;
+    for (x = 0; x < width; ++x)
+    {
+      if (!_cpu->m_keyMatch[_cpu->m_rowKeys[x]])
+        continue;
+      const size_t block = blockRow + x*CODEC_ENGINE_CPU_BLOCKS_X/width;
+      ++_cpu->m_blockCount[block];
+      _cpu->m_blockSumX[block] += x;
+      _cpu->m_blockSumY[block] += row;
+    }
+  }
+
+  // blocks with enough hits are joined with 4-neighbours into objects
+  const uint32_t blockArea = (width*_rows)/CODEC_ENGINE_CPU_BLOCKS;
+  const uint32_t minHits = blockArea/32 > 0 ? blockArea/32 : 1;
+  size_t parent[CODEC_ENGINE_CPU_BLOCKS];
+  size_t block;
+  for (block = 0; block < CODEC_ENGINE_CPU_BLOCKS; ++block)
+    parent[block] = block;
+  for (block = 0; block < CODEC_ENGINE_CPU_BLOCKS; ++block)
+  {
+    if (_cpu->m_blockCount[block] < minHits)
+      continue;
+    if (block % CODEC_ENGINE_CPU_BLOCKS_X != 0 && _cpu->m_blockCount[block-1] >= minHits)
+      do_blockUnion(parent, block-1, block);
+    if (block >= CODEC_ENGINE_CPU_BLOCKS_X && _cpu->m_blockCount[block-CODEC_ENGINE_CPU_BLOCKS_X] >= minHits)
+      do_blockUnion(parent, block-CODEC_ENGINE_CPU_BLOCKS_X, block);
+  }
+
+  // objects accumulate at their root block
+  uint32_t objCount[CODEC_ENGINE_CPU_BLOCKS];
+  uint64_t objSumX[CODEC_ENGINE_CPU_BLOCKS];
+  uint64_t objSumY[CODEC_ENGINE_CPU_BLOCKS];
+  memset(objCount, 0, sizeof(objCount));
+  memset(objSumX,  0, sizeof(objSumX));
+  memset(objSumY,  0, sizeof(objSumY));
+  for (block = 0; block < CODEC_ENGINE_CPU_BLOCKS; ++block)
+  {
+    if (_cpu->m_blockCount[block] < minHits)
+      continue;
+    const size_t root = do_blockFind(parent, block);
+    objCount[root] += _cpu->m_blockCount[block];
+    objSumX[root]  += _cpu->m_blockSumX[block];
+    objSumY[root]  += _cpu->m_blockSumY[block];
+  }
+
+  // largest objects first
+  memset(_targetLocation, 0, sizeof(*_targetLocation));
+  size_t targetIdx;
+  for (targetIdx = 0; targetIdx < MAX_OBJECTS_N; ++targetIdx)
+  {
+    size_t best = CODEC_ENGINE_CPU_BLOCKS;
+    for (block = 0; block < CODEC_ENGINE_CPU_BLOCKS; ++block)
+      if (objCount[block] > 0 && (best == CODEC_ENGINE_CPU_BLOCKS || objCount[block] > objCount[best]))
+        best = block;
+    if (best == CODEC_ENGINE_CPU_BLOCKS)
+      break;
+
+    const long cx = objSumX[best]/objCount[best];
+    const long cy = objSumY[best]/objCount[best];
+    const long size = ((uint64_t)objCount[best]*100)/(width*height);
+    Target* target = &_targetLocation->target[targetIdx];
+    target->x    = do_clamp(((cx*2 - (long)width )*100)/(long)width,  -100, 100);
+    target->y    = do_clamp(((cy*2 - (long)height)*100)/(long)height, -100, 100);
+    target->size = do_clamp(size, 1, 100);
+
+    objCount[best] = 0;
+  }
+}
+
+
+static void do_putPixel(const ImageDescription* _desc, uint8_t* _row, size_t _x, uint32_t _rgb)
+{
+  const unsigned r = (_rgb>>16)&0xff;
+  const unsigned g = (_rgb>> 8)&0xff;
+  const unsigned b = (_rgb    )&0xff;
+  const unsigned rgb565 = ((r>>3)<<11) | ((g>>2)<<5) | (b>>3);
+
+  switch (_desc->m_format)
+  {
+    case V4L2_PIX_FMT_RGB565:
+      _row[_x*2]   = rgb565&0xff;
+      _row[_x*2+1] = rgb565>>8;
+      break;
+    case V4L2_PIX_FMT_RGB565X:
+      _row[_x*2]   = rgb565>>8;
+      _row[_x*2+1] = rgb565&0xff;
+      break;
+    case V4L2_PIX_FMT_RGB24:
+      _row[_x*3]   = r;
+      _row[_x*3+1] = g;
+      _row[_x*3+2] = b;
+      break;
+  }
+}
+
+// nearest neighbour, source scaled to fit with aspect ratio kept, matched pixels highlighted
+static size_t do_renderPreview(CodecEngineCpu* _cpu, const uint8_t* _src, uint8_t* _dst, size_t _dstSize,
+                               const TargetLocation* _targetLocation)
+{
+  const ImageDescription* srcDesc = &_cpu->m_srcImageDesc;
+  const ImageDescription* dstDesc = &_cpu->m_dstImageDesc;
+
+  size_t outW = dstDesc->m_width;
+  size_t outH = (srcDesc->m_height*outW)/srcDesc->m_width;
+  if (outH > dstDesc->m_height)
+  {
+    outH = dstDesc->m_height;
+    outW = (srcDesc->m_width*outH)/srcDesc->m_height;
+  }
+  if (outH*dstDesc->m_lineLength > _dstSize)
+    outH = _dstSize/dstDesc->m_lineLength;
+
+  size_t srcRowLast = (size_t)-1;
+  size_t dy, dx;
+  for (dy = 0; dy < outH; ++dy)
+  {
+    const size_t srcRow = (dy*srcDesc->m_height)/outH;
+    if (srcRow != srcRowLast)
+    {
+      do_rowKeys(_cpu, _src, srcRow, _cpu->m_rowKeys);
+      srcRowLast = srcRow;
+    }
+
+    uint8_t* dstRow = _dst + dy*dstDesc->m_lineLength;
+    for (dx = 0; dx < outW; ++dx)
+    {
+      const uint16_t key = _cpu->m_rowKeys[(dx*srcDesc->m_width)/outW];
+      do_putPixel(dstDesc, dstRow, dx, _cpu->m_keyMatch[key] ? CPU_HIGHLIGHT_RGB : _cpu->m_keyRgb[key]);
+    }
+  }
+
+  size_t targetIdx;
+  for (targetIdx = 0; targetIdx < MAX_OBJECTS_N; ++targetIdx)
+  {
+    const Target* target = &_targetLocation->target[targetIdx];
+    if (target->size == 0 || outW == 0 || outH == 0)
+      continue;
+
+    const int cx = do_clamp(((target->x + 100)*(int)outW)/200, 0, outW-1);
+    const int cy = do_clamp(((target->y + 100)*(int)outH)/200, 0, outH-1);
+    int d;
+    for (d = -CPU_TARGET_CROSS; d <= CPU_TARGET_CROSS; ++d)
+    {
+      if (cx+d >= 0 && cx+d < (int)outW)
+        do_putPixel(dstDesc, _dst + cy*dstDesc->m_lineLength, cx+d, CPU_TARGET_RGB);
+      if (cy+d >= 0 && cy+d < (int)outH)
+        do_putPixel(dstDesc, _dst + (cy+d)*dstDesc->m_lineLength, cx, CPU_TARGET_RGB);
+    }
+  }
+
+  return outH*dstDesc->m_lineLength;
+}
+
+
+
+
+int codecEngineCpuStart(CodecEngineCpu* _cpu,
+                        const ImageDescription* _srcImageDesc,
+                        const ImageDescription* _dstImageDesc)
+{
+  if (_cpu == NULL || _srcImageDesc == NULL || _dstImageDesc == NULL)
+    return EINVAL;
+
+  if (!do_formatSupported(_srcImageDesc->m_format) || _srcImageDesc->m_width == 0 || _srcImageDesc->m_height == 0)
+  {
+    fprintf(stderr, "CPU detector: unsupported source format %c%c%c%c@%zux%zu\n",
+            _srcImageDesc->m_format&0xff, (_srcImageDesc->m_format>>8)&0xff,
+            (_srcImageDesc->m_format>>16)&0xff, (_srcImageDesc->m_format>>24)&0xff,
+            _srcImageDesc->m_width, _srcImageDesc->m_height);
+    return EINVAL;
+  }
+  if (   _dstImageDesc->m_format != V4L2_PIX_FMT_RGB565
+      && _dstImageDesc->m_format != V4L2_PIX_FMT_RGB565X
+      && _dstImageDesc->m_format != V4L2_PIX_FMT_RGB24)
+    fprintf(stderr, "CPU detector: preview format %c%c%c%c not supported, preview disabled\n",
+            _dstImageDesc->m_format&0xff, (_dstImageDesc->m_format>>8)&0xff,
+            (_dstImageDesc->m_format>>16)&0xff, (_dstImageDesc->m_format>>24)&0xff);
+
+  _cpu->m_srcImageDesc = *_srcImageDesc;
+  _cpu->m_dstImageDesc = *_dstImageDesc;
+  _cpu->m_keyYuv = do_formatIsYuv(_srcImageDesc->m_format);
+  _cpu->m_rangeValid = false;
+  _cpu->m_frames = 0;
+  _cpu->m_processUs = 0;
+
+  _cpu->m_rowKeys  = malloc(_srcImageDesc->m_width*sizeof(*_cpu->m_rowKeys));
+  _cpu->m_keyRgb   = malloc(CPU_KEYS*sizeof(*_cpu->m_keyRgb));
+  _cpu->m_keyMatch = calloc(CPU_KEYS, sizeof(*_cpu->m_keyMatch));
+  if (_cpu->m_rowKeys == NULL || _cpu->m_keyRgb == NULL || _cpu->m_keyMatch == NULL)
+  {
+    codecEngineCpuStop(_cpu);
+    return ENOMEM;
+  }
+
+  uint32_t key;
+  for (key = 0; key < CPU_KEYS; ++key)
+    _cpu->m_keyRgb[key] = do_keyToRgb(_cpu->m_keyYuv, key);
+
+  return 0;
+}
+
+int codecEngineCpuStop(CodecEngineCpu* _cpu)
+{
+  if (_cpu == NULL)
+    return EINVAL;
+
+  free(_cpu->m_rowKeys);
+  free(_cpu->m_keyRgb);
+  free(_cpu->m_keyMatch);
+  _cpu->m_rowKeys  = NULL;
+  _cpu->m_keyRgb   = NULL;
+  _cpu->m_keyMatch = NULL;
+
+  return 0;
+}
+
+int codecEngineCpuProcess(CodecEngineCpu* _cpu,
+                          const void* _srcFramePtr, size_t _srcFrameSize,
+                          void* _dstFramePtr, size_t _dstFrameSize, size_t* _dstFrameUsed,
+                          bool _render,
+                          const TargetDetectParams* _targetDetectParams,
+                          const TargetDetectCommand* _targetDetectCommand,
+                          TargetLocation* _targetLocation,
+                          TargetDetectParams* _targetDetectParamsResult)
+{
+  if (   _cpu == NULL || _srcFramePtr == NULL || _dstFrameUsed == NULL
+      || _targetDetectParams == NULL || _targetDetectCommand == NULL
+      || _targetLocation == NULL || _targetDetectParamsResult == NULL)
+    return EINVAL;
+
+  if (_cpu->m_keyMatch == NULL)
+    return ENOTCONN;
+
+  if (_srcFrameSize < _cpu->m_srcImageDesc.m_imageSize)
+    return ENOSPC;
+
+  const long long startUs = do_cpuNowUs();
+
+  if (!_cpu->m_rangeValid || (_targetDetectParams->m_setHsvRange && !do_rangeEqual(_targetDetectParams, &_cpu->m_range)))
+    do_buildMatch(_cpu, _targetDetectParams);
+
+  *_targetDetectParamsResult = _cpu->m_range;
+  if (_targetDetectCommand->m_cmd)
+    do_autoDetectHsv(_cpu, _srcFramePtr, _targetDetectParamsResult);
+
+  do_detectTargets(_cpu, _srcFramePtr, 0, _cpu->m_srcImageDesc.m_height, _targetLocation);
+
+  *_dstFrameUsed = 0;
+  if (_render && _dstFramePtr != NULL && do_formatSupported(_cpu->m_dstImageDesc.m_format)
+      && !do_formatIsYuv(_cpu->m_dstImageDesc.m_format))
+    *_dstFrameUsed = do_renderPreview(_cpu, _srcFramePtr, _dstFramePtr, _dstFrameSize, _targetLocation);
+
+  ++_cpu->m_frames;
+  _cpu->m_processUs += do_cpuNowUs() - startUs;
+
+  return 0;
+}
+
+int codecEngineCpuDetectRows(CodecEngineCpu* _cpu,
+                             const void* _srcFramePtr, size_t _srcFrameSize,
+                             size_t _rowFirst, size_t _rows,
+                             const TargetDetectParams* _targetDetectParams,
+                             TargetLocation* _targetLocation)
+{
+  if (_cpu == NULL || _srcFramePtr == NULL || _targetDetectParams == NULL || _targetLocation == NULL)
+    return EINVAL;
+
+  if (_cpu->m_keyMatch == NULL)
+    return ENOTCONN;
+
+  if (_rows == 0 || _rowFirst+_rows > _cpu->m_srcImageDesc.m_height)
+    return ERANGE;
+  if (_srcFrameSize < _cpu->m_srcImageDesc.m_imageSize)
+    return ENOSPC;
+
+  const long long startUs = do_cpuNowUs();
+
+  if (!_cpu->m_rangeValid || (_targetDetectParams->m_setHsvRange && !do_rangeEqual(_targetDetectParams, &_cpu->m_range)))
+    do_buildMatch(_cpu, _targetDetectParams);
+
+  do_detectTargets(_cpu, _srcFramePtr, _rowFirst, _rows, _targetLocation);
+
+  ++_cpu->m_frames;
+  _cpu->m_processUs += do_cpuNowUs() - startUs;
+
+  return 0;
+}
+
+int codecEngineCpuReportLoad(CodecEngineCpu* _cpu, long long _ms, const char* _prefix)
+{
+  if (_cpu == NULL || _prefix == NULL)
+    return EINVAL;
+
+  if (_cpu->m_frames > 0 && _ms > 0)
+    fprintf(stderr, "%sCPU detector %lld us/frame, load %lld%%\n",
+            _prefix, _cpu->m_processUs/_cpu->m_frames, (_cpu->m_processUs/10)/_ms);
+
+  _cpu->m_frames = 0;
+  _cpu->m_processUs = 0;
+
+  return 0;
+}
@@ -10,21 +10,24 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
 
 #include <linux/videodev2.h> // pixel formats
 
 #include "internal/module_fb.h"
+#include "internal/module_fb_convert.h"
+#include "internal/blit.h"
 
 
 
-static int do_fbOutputOpen(FBOutput* _fb, const char* _path)
+static int do_fbOutputOpen(FBOutput* _fb, const char* _path, bool _sync)
 {
   int res;
 
   if (_fb == NULL || _path == NULL)
     return EINVAL;
 
-  _fb->m_fd = open(_path, O_RDWR|O_SYNC, 0);
+  _fb->m_fd = open(_path, O_RDWR|(_sync ? O_SYNC : 0), 0);
   if (_fb->m_fd < 0)
   {
     res = errno;
@@ -52,16 +55,10 @@ static int do_fbOutputClose(FBOutput* _fb)
   return 0;
 }
 
-static int do_fbOutputSetFormat(FBOutput* _fb)
+static int do_fbOutputGetInfo(FBOutput* _fb)
 {
   int res;
 
-  if (_fb == NULL)
-    return EINVAL;
-
-  memset(&_fb->m_fbFixInfo, 0, sizeof(_fb->m_fbFixInfo));
-  memset(&_fb->m_fbVarInfo, 0, sizeof(_fb->m_fbVarInfo));
-
   if (ioctl(_fb->m_fd, FBIOGET_FSCREENINFO, &_fb->m_fbFixInfo) != 0)
   {
     res = errno;
@@ -79,29 +76,223 @@ static int do_fbOutputSetFormat(FBOutput* _fb)
   return 0;
 }
 
+static int do_fbOutputRestoreVarInfo(FBOutput* _fb)
+{
+  int res;
+
+  if (ioctl(_fb->m_fd, FBIOPUT_VSCREENINFO, &_fb->m_fbVarInfoOrig) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "ioctl(FBIOPUT_VSCREENINFO) failed: %d\n", res);
+    return res;
+  }
+
+  return do_fbOutputGetInfo(_fb);
+}
+
+// not fatal, output stays single buffered when driver cannot provide or pan second page
+static int do_fbOutputSetupFlip(FBOutput* _fb)
+{
+  int res;
+
+  if (_fb->m_fbFixInfo.ypanstep == 0)
+  {
+    fprintf(stderr, "Framebuffer cannot pan, output is single buffered\n");
+    return ENOTSUP;
+  }
+
+  const __u32 yres = _fb->m_fbVarInfo.yres;
+  if (_fb->m_fbVarInfo.yres_virtual < 2*yres)
+  {
+    struct fb_var_screeninfo varInfo = _fb->m_fbVarInfo;
+    varInfo.yres_virtual = 2*yres;
+    varInfo.xoffset = 0;
+    varInfo.yoffset = 0;
+    if (ioctl(_fb->m_fd, FBIOPUT_VSCREENINFO, &varInfo) != 0)
+    {
+      res = errno;
+      fprintf(stderr, "ioctl(FBIOPUT_VSCREENINFO, yres_virtual %u) failed: %d, output is single buffered\n",
+              varInfo.yres_virtual, res);
+      return res;
+    }
+
+    if ((res = do_fbOutputGetInfo(_fb)) != 0)
+      return res;
+  }
+
+  const size_t pageSize = (size_t)_fb->m_fbFixInfo.line_length * yres;
+  if (_fb->m_fbVarInfo.yres_virtual < 2*yres || _fb->m_fbFixInfo.smem_len < 2*pageSize)
+  {
+    fprintf(stderr, "Framebuffer has no room for second page, output is single buffered\n");
+    res = ENOSPC;
+    goto exit_restore;
+  }
+
+  _fb->m_fbVarInfo.xoffset = 0;
+  _fb->m_fbVarInfo.yoffset = 0;
+  if (ioctl(_fb->m_fd, FBIOPAN_DISPLAY, &_fb->m_fbVarInfo) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "ioctl(FBIOPAN_DISPLAY) failed: %d, output is single buffered\n", res);
+    goto exit_restore;
+  }
+
+  _fb->m_fbPages    = 2;
+  _fb->m_fbPageSize = pageSize;
+  _fb->m_fbBackPage = 1;
+
+  return 0;
+
+
+ exit_restore:
+  do_fbOutputRestoreVarInfo(_fb);
+  return res;
+}
+
+static int do_fbOutputSetFormat(FBOutput* _fb, const FBConfig* _config)
+{
+  int res;
+
+  if (_fb == NULL || _config == NULL)
+    return EINVAL;
+
+  memset(&_fb->m_fbFixInfo, 0, sizeof(_fb->m_fbFixInfo));
+  memset(&_fb->m_fbVarInfo, 0, sizeof(_fb->m_fbVarInfo));
+
+  if ((res = do_fbOutputGetInfo(_fb)) != 0)
+    return res;
+
+  _fb->m_fbVarInfoOrig = _fb->m_fbVarInfo;
+  _fb->m_fbPages    = 1;
+  _fb->m_fbPageSize = _fb->m_fbFixInfo.smem_len;
+  _fb->m_fbBackPage = 0;
+  _fb->m_fbVsync    = _config->m_vsync;
+  _fb->m_overlay    = _config->m_overlay;
+  _fb->m_overlayActive = false;
+
+  if (_config->m_pageFlip)
+    do_fbOutputSetupFlip(_fb);
+
+  return 0;
+}
+
 static int do_fbOutputUnsetFormat(FBOutput* _fb)
 {
   if (_fb == NULL)
     return EINVAL;
 
+  if (_fb->m_fbPages > 1)
+    do_fbOutputRestoreVarInfo(_fb); // console expects original virtual screen and offset
+  _fb->m_fbPages = 1;
+
   memset(&_fb->m_fbFixInfo, 0, sizeof(_fb->m_fbFixInfo));
   memset(&_fb->m_fbVarInfo, 0, sizeof(_fb->m_fbVarInfo));
 
   return 0;
 }
 
+static bool do_fbOutputBitfields(const struct fb_var_screeninfo* _varInfo,
+                                 __u32 _redOffset, __u32 _greenOffset, __u32 _blueOffset,
+                                 __u32 _redLength, __u32 _greenLength, __u32 _blueLength)
+{
+  return _varInfo->red.offset   == _redOffset   && _varInfo->red.length   == _redLength
+      && _varInfo->green.offset == _greenOffset && _varInfo->green.length == _greenLength
+      && _varInfo->blue.offset  == _blueOffset  && _varInfo->blue.length  == _blueLength;
+}
+
+// packed pixel value is little endian, so bitfield offsets map to byte order
+static uint32_t do_fbOutputDetectFormat(const struct fb_var_screeninfo* _varInfo)
+{
+  if (_varInfo->nonstd != 0 || _varInfo->grayscale != 0)
+    return 0;
+
+  switch (_varInfo->bits_per_pixel)
+  {
+    case 16:
+      if (do_fbOutputBitfields(_varInfo, 11, 5, 0, 5, 6, 5))
+        return V4L2_PIX_FMT_RGB565;
+      break;
+    case 24:
+      if (do_fbOutputBitfields(_varInfo, 0, 8, 16, 8, 8, 8))
+        return V4L2_PIX_FMT_RGB24;
+      if (do_fbOutputBitfields(_varInfo, 16, 8, 0, 8, 8, 8))
+        return V4L2_PIX_FMT_BGR24;
+      break;
+    case 32:
+      if (do_fbOutputBitfields(_varInfo, 16, 8, 0, 8, 8, 8))
+        return V4L2_PIX_FMT_BGR32; // XRGB8888
+      break;
+  }
+
+  return 0;
+}
+
+static int do_fbOutputSetupRender(FBOutput* _fb)
+{
+  if (_fb == NULL)
+    return EINVAL;
+
+  const struct fb_var_screeninfo* varInfo = &_fb->m_fbVarInfo;
+
+  _fb->m_fbImageDesc.m_width      = varInfo->xres;
+  _fb->m_fbImageDesc.m_height     = varInfo->yres;
+  _fb->m_fbImageDesc.m_lineLength = _fb->m_fbFixInfo.line_length;
+  _fb->m_fbImageDesc.m_imageSize  = _fb->m_fbPageSize;
+  _fb->m_fbImageDesc.m_format     = do_fbOutputDetectFormat(varInfo);
+
+  _fb->m_renderImageDesc = _fb->m_fbImageDesc;
+  _fb->m_renderBuffer = NULL;
+
+  const uint32_t fbFormat = _fb->m_fbImageDesc.m_format;
+  if (fbFormat == V4L2_PIX_FMT_RGB565 || fbFormat == V4L2_PIX_FMT_RGB24)
+    return 0;
+
+  const uint32_t renderFormat = fbConvertRenderFormat(fbFormat);
+  if (renderFormat == 0 || !fbConvertSupported(renderFormat, fbFormat))
+  {
+    fprintf(stderr, "Unsupported framebuffer format %ubpp r%u/%u g%u/%u b%u/%u, assuming RGB565X\n",
+            varInfo->bits_per_pixel,
+            varInfo->red.offset, varInfo->red.length,
+            varInfo->green.offset, varInfo->green.length,
+            varInfo->blue.offset, varInfo->blue.length);
+    _fb->m_renderImageDesc.m_format = V4L2_PIX_FMT_RGB565X;
+    return 0;
+  }
+
+  // codec renders into intermediate frame, converted on ARM on put
+  _fb->m_renderImageDesc.m_format     = renderFormat;
+  _fb->m_renderImageDesc.m_lineLength = _fb->m_renderImageDesc.m_width*3;
+  _fb->m_renderImageDesc.m_imageSize  = _fb->m_renderImageDesc.m_lineLength*_fb->m_renderImageDesc.m_height;
+  if ((_fb->m_renderBuffer = calloc(1, _fb->m_renderImageDesc.m_imageSize)) == NULL)
+  {
+    fprintf(stderr, "calloc(%zu) failed\n", _fb->m_renderImageDesc.m_imageSize);
+    return ENOMEM;
+  }
+
+  fprintf(stderr, "Framebuffer %c%c%c%c output is converted from %c%c%c%c\n",
+          fbFormat&0xff, (fbFormat>>8)&0xff, (fbFormat>>16)&0xff, (fbFormat>>24)&0xff,
+          renderFormat&0xff, (renderFormat>>8)&0xff, (renderFormat>>16)&0xff, (renderFormat>>24)&0xff);
+
+  return 0;
+}
+
+static int do_fbOutputUnsetupRender(FBOutput* _fb)
+{
+  if (_fb == NULL)
+    return EINVAL;
+
+  free(_fb->m_renderBuffer);
+  _fb->m_renderBuffer = NULL;
+
+  return 0;
+}
+
 static int do_fbOutputGetFormat(FBOutput* _fb, ImageDescription* _imageDesc)
 {
   if (_fb == NULL || _imageDesc == NULL)
     return EINVAL;
 
-  _imageDesc->m_width      = _fb->m_fbVarInfo.xres;
-  _imageDesc->m_height     = _fb->m_fbVarInfo.yres;
-  _imageDesc->m_lineLength = _fb->m_fbFixInfo.line_length;
-  _imageDesc->m_imageSize  = _fb->m_fbFixInfo.smem_len;
-
-#warning TODO check and get framebuffer format!
-  _imageDesc->m_format = V4L2_PIX_FMT_RGB565X;
+  *_imageDesc = _fb->m_renderImageDesc;
 
   return 0;
 }
@@ -145,20 +336,455 @@ static int do_fbOutputMunmap(FBOutput* _fb)
   return res;
 }
 
+static int do_fbOutputRegisterContig(FBOutput* _fb)
+{
+  if (_fb == NULL)
+    return EINVAL;
+
+  _fb->m_fbContiguous = false;
+
+  if (_fb->m_fbFixInfo.smem_start == 0)
+  {
+    fprintf(stderr, "Framebuffer physical address is unknown, DSP output will be copied\n");
+    return ENXIO;
+  }
+
+  Memory_registerContigBuf((UInt32)_fb->m_fbPtr, _fb->m_fbSize, _fb->m_fbFixInfo.smem_start);
+
+  Bool contiguous = FALSE;
+  if (   Memory_getBufferPhysicalAddress(_fb->m_fbPtr, _fb->m_fbSize, &contiguous) != _fb->m_fbFixInfo.smem_start
+      || !contiguous)
+  {
+    fprintf(stderr, "Framebuffer memory %#lx is not accessible by DSP, DSP output will be copied\n",
+            _fb->m_fbFixInfo.smem_start);
+    Memory_unregisterContigBuf((UInt32)_fb->m_fbPtr, _fb->m_fbSize);
+    return ENXIO;
+  }
+
+  _fb->m_fbContiguous = true;
+
+  return 0;
+}
+
+static int do_fbOutputUnregisterContig(FBOutput* _fb)
+{
+  if (_fb == NULL)
+    return EINVAL;
+
+  if (_fb->m_fbContiguous)
+    Memory_unregisterContigBuf((UInt32)_fb->m_fbPtr, _fb->m_fbSize);
+  _fb->m_fbContiguous = false;
+
+  return 0;
+}
+
+#define FB_SHM_ALIGN(x) (((x)+63) & ~(size_t)63)
+
+static FBShmSlot* do_fbOutputShmSlot(FBOutput* _fb, size_t _slot)
+{
+  return (FBShmSlot*)((uint8_t*)_fb->m_shmHeader + _fb->m_shmHeader->m_slotOffset + _slot*_fb->m_shmHeader->m_slotSize);
+}
+
+// takes place of framebuffer device: fixed RGB565 geometry, single page, no direct DSP output
+static int do_fbOutputShmOpen(FBOutput* _fb, const FBConfig* _config)
+{
+  int res;
+
+  if (_config->m_shmSlots < 2 || _config->m_shmWidth == 0 || _config->m_shmHeight == 0)
+  {
+    fprintf(stderr, "Shared memory preview needs at least 2 slots and non-empty geometry\n");
+    return EINVAL;
+  }
+
+  const size_t lineLength  = _config->m_shmWidth*2;
+  const size_t frameSize   = lineLength*_config->m_shmHeight;
+  const size_t slotOffset  = FB_SHM_ALIGN(sizeof(FBShmHeader));
+  const size_t frameOffset = FB_SHM_ALIGN(sizeof(FBShmSlot));
+  const size_t slotSize    = FB_SHM_ALIGN(frameOffset + frameSize);
+  const size_t size        = slotOffset + _config->m_shmSlots*slotSize;
+
+  _fb->m_fd = open(_config->m_shmPath, O_RDWR|O_CREAT, 0644);
+  if (_fb->m_fd < 0)
+  {
+    res = errno;
+    fprintf(stderr, "open(%s) failed: %d\n", _config->m_shmPath, res);
+    _fb->m_fd = -1;
+    return res;
+  }
+
+  if (ftruncate(_fb->m_fd, size) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "ftruncate(%s, %zu) failed: %d\n", _config->m_shmPath, size, res);
+    goto exit_close;
+  }
+
+  _fb->m_fbSize = size;
+  _fb->m_fbPtr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, _fb->m_fd, 0);
+  if (_fb->m_fbPtr == MAP_FAILED)
+  {
+    res = errno;
+    fprintf(stderr, "mmap(%zu) failed: %d\n", size, res);
+    goto exit_close;
+  }
+
+  // readers may still hold old mapping, they see magic drop while layout changes
+  FBShmHeader* header = (FBShmHeader*)_fb->m_fbPtr;
+  header->m_magic = 0;
+  __sync_synchronize();
+  memset((uint8_t*)_fb->m_fbPtr + sizeof(header->m_magic), 0, slotOffset - sizeof(header->m_magic));
+  header->m_version     = FB_SHM_VERSION;
+  header->m_slots       = _config->m_shmSlots;
+  header->m_slotOffset  = slotOffset;
+  header->m_slotSize    = slotSize;
+  header->m_frameOffset = frameOffset;
+  header->m_width       = _config->m_shmWidth;
+  header->m_height      = _config->m_shmHeight;
+  header->m_lineLength  = lineLength;
+  header->m_format      = V4L2_PIX_FMT_RGB565;
+  header->m_latest      = FB_SHM_NO_SLOT;
+
+  _fb->m_shmHeader = header;
+  _fb->m_shmSlot   = 0;
+  _fb->m_shmFrames = 0;
+  size_t slot;
+  for (slot = 0; slot < _config->m_shmSlots; ++slot)
+    memset(do_fbOutputShmSlot(_fb, slot), 0, sizeof(FBShmSlot));
+
+  __sync_synchronize();
+  header->m_magic = FB_SHM_MAGIC;
+
+  memset(&_fb->m_fbFixInfo, 0, sizeof(_fb->m_fbFixInfo));
+  memset(&_fb->m_fbVarInfo, 0, sizeof(_fb->m_fbVarInfo));
+  _fb->m_fbPages    = 1;
+  _fb->m_fbPageSize = frameSize;
+  _fb->m_fbBackPage = 0;
+  _fb->m_fbVsync    = false;
+  _fb->m_fbContiguous = false;
+  _fb->m_overlay    = false;
+  _fb->m_overlayActive = false;
+  _fb->m_renderBuffer = NULL;
+
+  _fb->m_fbImageDesc.m_width      = _config->m_shmWidth;
+  _fb->m_fbImageDesc.m_height     = _config->m_shmHeight;
+  _fb->m_fbImageDesc.m_lineLength = lineLength;
+  _fb->m_fbImageDesc.m_imageSize  = frameSize;
+  _fb->m_fbImageDesc.m_format     = V4L2_PIX_FMT_RGB565;
+  _fb->m_renderImageDesc = _fb->m_fbImageDesc;
+
+  fprintf(stderr, "Preview is published to %s, %zu slots of %zux%zu RGB565\n",
+          _config->m_shmPath, _config->m_shmSlots, _config->m_shmWidth, _config->m_shmHeight);
+
+  return 0;
+
+
+ exit_close:
+  close(_fb->m_fd);
+  _fb->m_fd = -1;
+  return res;
+}
+
+static void do_fbOutputShmPublish(FBOutput* _fb)
+{
+  FBShmSlot* slot = do_fbOutputShmSlot(_fb, _fb->m_shmSlot);
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  slot->m_frameSize   = _fb->m_fbPageSize;
+  slot->m_timestampUs = (int64_t)now.tv_sec*1000000 + now.tv_nsec/1000;
+  slot->m_frameNumber = _fb->m_shmFrames++;
+  __sync_synchronize();
+  ++slot->m_sequence; // even, complete
+  __sync_synchronize();
+  _fb->m_shmHeader->m_latest = _fb->m_shmSlot;
+
+  _fb->m_shmSlot = (_fb->m_shmSlot + 1) % _fb->m_shmHeader->m_slots;
+}
+
 static int do_fbOutputGetFrame(FBOutput* _fb, void** _framePtr, size_t* _frameSize)
 {
   if (_fb == NULL || _framePtr == NULL || _frameSize == NULL)
     return EINVAL;
 
-  if (_fb->m_fbPtr == NULL)
+  if (_fb->m_fbPtr == MAP_FAILED)
     return ENOTCONN;
 
-  *_framePtr = _fb->m_fbPtr;
-  *_frameSize = _fb->m_fbSize;
+  if (_fb->m_shmHeader != NULL)
+  {
+    FBShmSlot* slot = do_fbOutputShmSlot(_fb, _fb->m_shmSlot);
+    if ((slot->m_sequence & 1) == 0)
+    {
+      ++slot->m_sequence; // readers of this slot see it change
+      __sync_synchronize();
+    }
+    *_framePtr = (uint8_t*)slot + _fb->m_shmHeader->m_frameOffset;
+    *_frameSize = _fb->m_fbPageSize;
+    return 0;
+  }
+
+  if (_fb->m_renderBuffer != NULL)
+  {
+    *_framePtr = _fb->m_renderBuffer;
+    *_frameSize = _fb->m_renderImageDesc.m_imageSize;
+    return 0;
+  }
+
+  *_framePtr = (char*)_fb->m_fbPtr + _fb->m_fbBackPage*_fb->m_fbPageSize;
+  *_frameSize = _fb->m_fbPages > 1 ? _fb->m_fbPageSize : _fb->m_fbSize;
+
+  return 0;
+}
+
+static int do_fbOutputPutFrame(FBOutput* _fb)
+{
+  int res;
+
+  if (_fb == NULL)
+    return EINVAL;
+
+  _fb->m_overlayActive = false; // whole page is redrawn
+
+  if (_fb->m_shmHeader != NULL)
+  {
+    do_fbOutputShmPublish(_fb);
+    return 0;
+  }
+
+  if (   _fb->m_renderBuffer != NULL
+      && (res = fbConvertFrame(&_fb->m_renderImageDesc, _fb->m_renderBuffer,
+                               &_fb->m_fbImageDesc, (char*)_fb->m_fbPtr + _fb->m_fbBackPage*_fb->m_fbPageSize)) != 0)
+  {
+    fprintf(stderr, "fbConvertFrame() failed: %d\n", res);
+    return res;
+  }
+
+  if (_fb->m_fbPages < 2)
+    return 0;
+
+  _fb->m_fbVarInfo.xoffset = 0;
+  _fb->m_fbVarInfo.yoffset = _fb->m_fbBackPage*_fb->m_fbVarInfo.yres;
+  if (ioctl(_fb->m_fd, FBIOPAN_DISPLAY, &_fb->m_fbVarInfo) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "ioctl(FBIOPAN_DISPLAY, yoffset %u) failed: %d\n", _fb->m_fbVarInfo.yoffset, res);
+    return res;
+  }
+
+  // without waiting, page just hidden may still be scanned out until vsync
+#ifdef FBIO_WAITFORVSYNC
+  if (_fb->m_fbVsync)
+  {
+    __u32 crtc = 0;
+    if (ioctl(_fb->m_fd, FBIO_WAITFORVSYNC, &crtc) != 0)
+    {
+      fprintf(stderr, "ioctl(FBIO_WAITFORVSYNC) failed: %d, not waiting for vsync\n", errno);
+      _fb->m_fbVsync = false;
+    }
+  }
+#endif
+
+  _fb->m_fbBackPage = 1 - _fb->m_fbBackPage;
+
+  return 0;
+}
+
+static size_t do_fbOutputPixelBytes(uint32_t _format, uint32_t _rgb, uint8_t* _pixel)
+{
+  const unsigned r = (_rgb>>16)&0xff;
+  const unsigned g = (_rgb>> 8)&0xff;
+  const unsigned b = (_rgb    )&0xff;
+  const unsigned rgb565 = ((r>>3)<<11) | ((g>>2)<<5) | (b>>3);
+
+  switch (_format)
+  {
+    case V4L2_PIX_FMT_RGB565:
+      _pixel[0] = rgb565&0xff;
+      _pixel[1] = rgb565>>8;
+      return 2;
+    case V4L2_PIX_FMT_RGB24:
+      _pixel[0] = r;
+      _pixel[1] = g;
+      _pixel[2] = b;
+      return 3;
+    case V4L2_PIX_FMT_BGR24:
+      _pixel[0] = b;
+      _pixel[1] = g;
+      _pixel[2] = r;
+      return 3;
+    case V4L2_PIX_FMT_BGR32:
+      _pixel[0] = b;
+      _pixel[1] = g;
+      _pixel[2] = r;
+      _pixel[3] = 0xff;
+      return 4;
+    case V4L2_PIX_FMT_RGB565X:
+    default:
+      _pixel[0] = rgb565>>8;
+      _pixel[1] = rgb565&0xff;
+      return 2;
+  }
+}
+
+// overlay is drawn into page currently on screen, nothing is flipped
+static uint8_t* do_fbOutputFrontPage(FBOutput* _fb)
+{
+  const size_t frontPage = _fb->m_fbPages > 1 ? 1 - _fb->m_fbBackPage : 0;
+  return (uint8_t*)_fb->m_fbPtr + frontPage*_fb->m_fbPageSize;
+}
+
+static void do_fbOutputFillRect(FBOutput* _fb, const FBOverlayRect* _rect, uint32_t _rgb)
+{
+  const ImageDescription* desc = &_fb->m_fbImageDesc;
+  uint8_t pixel[4];
+  const size_t pixelBytes = do_fbOutputPixelBytes(desc->m_format, _rgb, pixel); // unknown format taken as RGB565X
+  uint8_t* page = do_fbOutputFrontPage(_fb);
+  size_t x, y;
+
+  for (y = _rect->m_y; y < _rect->m_y + _rect->m_height; ++y)
+  {
+    uint8_t* row = page + y*desc->m_lineLength + _rect->m_x*pixelBytes;
+    for (x = 0; x < _rect->m_width; ++x)
+      memcpy(row + x*pixelBytes, pixel, pixelBytes);
+  }
+}
+
+// clipped to screen, empty rects are dropped
+static void do_fbOutputAddRect(FBOutput* _fb, long _x, long _y, long _width, long _height)
+{
+  const long screenWidth  = _fb->m_fbImageDesc.m_width;
+  const long screenHeight = _fb->m_fbImageDesc.m_height;
+
+  if (_x < 0) { _width  += _x; _x = 0; }
+  if (_y < 0) { _height += _y; _y = 0; }
+  if (_x + _width  > screenWidth)  _width  = screenWidth  - _x;
+  if (_y + _height > screenHeight) _height = screenHeight - _y;
+  if (_width <= 0 || _height <= 0 || _fb->m_overlayRectsN >= FB_OVERLAY_MAX_RECTS)
+    return;
+
+  FBOverlayRect* rect = &_fb->m_overlayRects[_fb->m_overlayRectsN++];
+  rect->m_x      = _x;
+  rect->m_y      = _y;
+  rect->m_width  = _width;
+  rect->m_height = _height;
+}
+
+static long do_fbOutputIsqrt(long _val)
+{
+  long root = 0;
+  while ((root+1)*(root+1) <= _val)
+    ++root;
+  return root;
+}
+
+static int do_fbOutputDrawTargets(FBOutput* _fb, const TargetLocation* _targetLocation)
+{
+  static const long s_cross = 6;
+  static const uint32_t s_targetRgb = 0x00ff0000u;
+  size_t rectIdx;
+
+  if (_fb == NULL || _targetLocation == NULL)
+    return EINVAL;
+
+  if (!_fb->m_overlay)
+    return ENOTSUP;
+
+  if (!_fb->m_overlayActive)
+  {
+    // once, when preview stops: leftovers of last full frame go away
+    memset(do_fbOutputFrontPage(_fb), 0, _fb->m_fbImageDesc.m_lineLength*_fb->m_fbImageDesc.m_height);
+    _fb->m_overlayRectsN = 0;
+    _fb->m_overlayActive = true;
+  }
+  else if (memcmp(&_fb->m_overlayTargets, _targetLocation, sizeof(*_targetLocation)) == 0)
+    return 0;
+
+  for (rectIdx = 0; rectIdx < _fb->m_overlayRectsN; ++rectIdx)
+    do_fbOutputFillRect(_fb, &_fb->m_overlayRects[rectIdx], 0);
+  _fb->m_overlayRectsN = 0;
+  _fb->m_overlayTargets = *_targetLocation;
+
+  const long width  = _fb->m_fbImageDesc.m_width;
+  const long height = _fb->m_fbImageDesc.m_height;
+  size_t targetIdx;
+  for (targetIdx = 0; targetIdx < MAX_OBJECTS_N; ++targetIdx)
+  {
+    const Target* target = &_targetLocation->target[targetIdx];
+    if (target->size == 0)
+      continue;
+
+    const long cx = ((target->x + 100)*width )/200;
+    const long cy = ((target->y + 100)*height)/200;
+    do_fbOutputAddRect(_fb, cx-s_cross, cy, 2*s_cross+1, 1);
+    do_fbOutputAddRect(_fb, cx, cy-s_cross, 1, 2*s_cross+1);
+
+    // size is percent of frame area, box keeps frame aspect
+    const long side = do_fbOutputIsqrt((long)target->size*100);
+    const long boxW = (width *side)/100;
+    const long boxH = (height*side)/100;
+    const long boxX = cx - boxW/2;
+    const long boxY = cy - boxH/2;
+    do_fbOutputAddRect(_fb, boxX,        boxY,        boxW, 1);
+    do_fbOutputAddRect(_fb, boxX,        boxY+boxH-1, boxW, 1);
+    do_fbOutputAddRect(_fb, boxX,        boxY,        1,    boxH);
+    do_fbOutputAddRect(_fb, boxX+boxW-1, boxY,        1,    boxH);
+  }
+
+  for (rectIdx = 0; rectIdx < _fb->m_overlayRectsN; ++rectIdx)
+    do_fbOutputFillRect(_fb, &_fb->m_overlayRects[rectIdx], s_targetRgb);
 
   return 0;
 }
 
+static long long do_fbOutputNowUs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec*1000000 + now.tv_nsec/1000;
+}
+
+// flat memcpy of codec sized frame versus blit of packed rows into framebuffer line length
+static void do_fbOutputBlitBenchmark(FBOutput* _fb, bool _sync)
+{
+  static const int s_iterations = 20;
+  const ImageDescription* desc = &_fb->m_fbImageDesc;
+  const size_t rowBytes = desc->m_width*(_fb->m_fbVarInfo.bits_per_pixel/8);
+  const size_t frameSize = desc->m_lineLength*desc->m_height;
+
+  if (rowBytes == 0 || rowBytes > desc->m_lineLength)
+    return;
+
+  uint8_t* frame = malloc(frameSize);
+  if (frame == NULL)
+    return;
+  memset(frame, 0, frameSize);
+
+  // hidden page while flipping, otherwise black frames flash on screen
+  uint8_t* page = (uint8_t*)_fb->m_fbPtr + _fb->m_fbBackPage*_fb->m_fbPageSize;
+  long long memcpyUs = 0;
+  long long blitUs = 0;
+  long long rowsUs = 0;
+  int iteration;
+  for (iteration = 0; iteration < s_iterations; ++iteration)
+  {
+    long long startUs = do_fbOutputNowUs();
+    memcpy(page, frame, frameSize);
+    memcpyUs += do_fbOutputNowUs() - startUs;
+
+    startUs = do_fbOutputNowUs();
+    blitCopy(page, frame, frameSize);
+    blitUs += do_fbOutputNowUs() - startUs;
+
+    startUs = do_fbOutputNowUs();
+    blitRows(page, desc->m_lineLength, frame, rowBytes, rowBytes, desc->m_height);
+    rowsUs += do_fbOutputNowUs() - startUs;
+  }
+
+  fprintf(stderr, "Blit benchmark%s: memcpy %lld us/frame, blit %lld us/frame, packed rows blit %lld us/frame\n",
+          _sync ? " (O_SYNC)" : "", memcpyUs/s_iterations, blitUs/s_iterations, rowsUs/s_iterations);
+
+  free(frame);
+}
+
 
 
 
@@ -182,11 +808,14 @@ int fbOutputOpen(FBOutput* _fb, const FBConfig* _config)
   if (_fb->m_fd != -1)
     return EALREADY;
 
-  res = do_fbOutputOpen(_fb, _config->m_path);
+  if (_config->m_shmPath != NULL)
+    return do_fbOutputShmOpen(_fb, _config);
+
+  res = do_fbOutputOpen(_fb, _config->m_path, _config->m_sync);
   if (res != 0)
     goto exit;
 
-  res = do_fbOutputSetFormat(_fb);
+  res = do_fbOutputSetFormat(_fb, _config);
   if (res != 0)
     goto exit_close;
 
@@ -194,9 +823,26 @@ int fbOutputOpen(FBOutput* _fb, const FBConfig* _config)
   if (res != 0)
     goto exit_unset_format;
 
+  res = do_fbOutputSetupRender(_fb);
+  if (res != 0)
+    goto exit_munmap;
+
+  _fb->m_fbContiguous = false;
+  if (_config->m_direct && _fb->m_renderBuffer == NULL)
+    do_fbOutputRegisterContig(_fb); // not fatal, output is copied otherwise
+
+  if (_config->m_blitBenchmark)
+    do_fbOutputBlitBenchmark(_fb, _config->m_sync);
+
+  if (_fb->m_fbPages > 1)
+    fprintf(stderr, "Framebuffer output is double buffered, %zu bytes per page%s\n",
+            _fb->m_fbPageSize, _fb->m_fbVsync ? ", flips wait for vsync" : "");
+
   return 0;
 
 
+ exit_munmap:
+  do_fbOutputMunmap(_fb);
  exit_unset_format:
   do_fbOutputUnsetFormat(_fb);
  exit_close:
@@ -212,7 +858,10 @@ int fbOutputClose(FBOutput* _fb)
   if (_fb->m_fd == -1)
     return EALREADY;
 
+  do_fbOutputUnregisterContig(_fb);
+  do_fbOutputUnsetupRender(_fb);
   do_fbOutputMunmap(_fb);
+  _fb->m_shmHeader = NULL;
   do_fbOutputUnsetFormat(_fb);
   do_fbOutputClose(_fb);
 
@@ -256,7 +905,17 @@ int fbOutputPutFrame(FBOutput* _fb)
   if (_fb->m_fd == -1)
     return ENOTCONN;
 
-  return 0;
+  return do_fbOutputPutFrame(_fb);
+}
+
+int fbOutputDrawTargets(FBOutput* _fb, const TargetLocation* _targetLocation)
+{
+  if (_fb == NULL)
+    return EINVAL;
+  if (_fb->m_fd == -1)
+    return ENOTCONN;
+
+  return do_fbOutputDrawTargets(_fb, _targetLocation);
 }
 
 int fbOutputGetFormat(FBOutput* _fb, ImageDescription* _imageDesc)
@@ -269,4 +928,19 @@ int fbOutputGetFormat(FBOutput* _fb, ImageDescription* _imageDesc)
   return do_fbOutputGetFormat(_fb, _imageDesc);
 }
 
+bool fbOutputFrameContiguous(const FBOutput* _fb)
+{
+  if (_fb == NULL || _fb->m_fd == -1)
+    return false;
+
+  return _fb->m_fbContiguous;
+}
+
+bool fbOutputPageFlipping(const FBOutput* _fb)
+{
+  if (_fb == NULL || _fb->m_fd == -1)
+    return false;
+
+  return _fb->m_fbPages > 1;
+}
 
@@ -0,0 +1,121 @@
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <linux/videodev2.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FB_CONVERT_NEON 1
+#endif
+
+#include "internal/module_fb_convert.h"
+
+
+typedef void (*FBConvertRow)(const uint8_t* restrict _src, uint8_t* restrict _dst, size_t _width);
+
+
+// R,G,B bytes to B,G,R,X bytes, i.e. XRGB8888 little endian word
+static void do_convertRowRgb24ToBgr32(const uint8_t* restrict _src, uint8_t* restrict _dst, size_t _width)
+{
+  size_t x = 0;
+
+#ifdef FB_CONVERT_NEON
+  const uint8x16_t alpha = vdupq_n_u8(0xff);
+  for (; x+16 <= _width; x += 16)
+  {
+    const uint8x16x3_t rgb = vld3q_u8(_src + x*3);
+    uint8x16x4_t bgrx;
+    bgrx.val[0] = rgb.val[2];
+    bgrx.val[1] = rgb.val[1];
+    bgrx.val[2] = rgb.val[0];
+    bgrx.val[3] = alpha;
+    vst4q_u8(_dst + x*4, bgrx);
+  }
+#endif
+
+  for (; x < _width; ++x)
+  {
+    _dst[x*4]   = _src[x*3+2];
+    _dst[x*4+1] = _src[x*3+1];
+    _dst[x*4+2] = _src[x*3];
+    _dst[x*4+3] = 0xff;
+  }
+}
+
+static void do_convertRowRgb24ToBgr24(const uint8_t* restrict _src, uint8_t* restrict _dst, size_t _width)
+{
+  size_t x = 0;
+
+#ifdef FB_CONVERT_NEON
+  for (; x+16 <= _width; x += 16)
+  {
+    uint8x16x3_t pix = vld3q_u8(_src + x*3);
+    const uint8x16_t r = pix.val[0];
+    pix.val[0] = pix.val[2];
+    pix.val[2] = r;
+    vst3q_u8(_dst + x*3, pix);
+  }
+#endif
+
+  for (; x < _width; ++x)
+  {
+    _dst[x*3]   = _src[x*3+2];
+    _dst[x*3+1] = _src[x*3+1];
+    _dst[x*3+2] = _src[x*3];
+  }
+}
+
+static FBConvertRow do_convertRowFunction(uint32_t _srcFormat, uint32_t _dstFormat)
+{
+  if (_srcFormat == V4L2_PIX_FMT_RGB24 && _dstFormat == V4L2_PIX_FMT_BGR32)
+    return &do_convertRowRgb24ToBgr32;
+  if (_srcFormat == V4L2_PIX_FMT_RGB24 && _dstFormat == V4L2_PIX_FMT_BGR24)
+    return &do_convertRowRgb24ToBgr24;
+
+  return NULL;
+}
+
+
+
+
+uint32_t fbConvertRenderFormat(uint32_t _fbFormat)
+{
+  switch (_fbFormat)
+  {
+    case V4L2_PIX_FMT_BGR32:
+    case V4L2_PIX_FMT_BGR24:
+      return V4L2_PIX_FMT_RGB24;
+    default:
+      return 0;
+  }
+}
+
+bool fbConvertSupported(uint32_t _srcFormat, uint32_t _dstFormat)
+{
+  return do_convertRowFunction(_srcFormat, _dstFormat) != NULL;
+}
+
+int fbConvertFrame(const ImageDescription* _srcImageDesc, const void* _srcFramePtr,
+                   const ImageDescription* _dstImageDesc, void* _dstFramePtr)
+{
+  if (_srcImageDesc == NULL || _srcFramePtr == NULL || _dstImageDesc == NULL || _dstFramePtr == NULL)
+    return EINVAL;
+
+  if (_srcImageDesc->m_width != _dstImageDesc->m_width || _srcImageDesc->m_height != _dstImageDesc->m_height)
+    return ERANGE;
+
+  const FBConvertRow convertRow = do_convertRowFunction(_srcImageDesc->m_format, _dstImageDesc->m_format);
+  if (convertRow == NULL)
+    return ENOTSUP;
+
+  const uint8_t* src = (const uint8_t*)_srcFramePtr;
+  uint8_t* dst = (uint8_t*)_dstFramePtr;
+  size_t row;
+  for (row = 0; row < _srcImageDesc->m_height; ++row)
+    convertRow(src + row*_srcImageDesc->m_lineLength, dst + row*_dstImageDesc->m_lineLength, _srcImageDesc->m_width);
+
+  return 0;
+}
+
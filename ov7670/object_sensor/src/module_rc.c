@@ -10,11 +10,14 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <time.h>
+#include <inttypes.h>
 #include <termios.h>
 #include <netdb.h>
 #include <linux/input.h>
 
 #include "internal/module_rc.h"
+#include "internal/module_v4l2.h"
 
 
 
@@ -120,19 +123,19 @@ static int do_reopenFifoInput(RCInput* _rc)
 }
 
 
-static int do_openFifoOutput(RCInput* _rc, const char* _fifoOutputName)
+static int do_openFifoOutput(int* _fifoOutputFd, char** _fifoOutputNameCopy, const char* _fifoOutputName)
 {
   int res;
-  if (_rc == NULL)
+  if (_fifoOutputFd == NULL || _fifoOutputNameCopy == NULL)
     return EINVAL;
 
-  if (_rc->m_fifoOutputName != NULL)
-    free(_rc->m_fifoOutputName);
-  _rc->m_fifoOutputName = NULL;
+  if (*_fifoOutputNameCopy != NULL)
+    free(*_fifoOutputNameCopy);
+  *_fifoOutputNameCopy = NULL;
 
   if (_fifoOutputName == NULL)
   {
-    _rc->m_fifoOutputFd = -1;
+    *_fifoOutputFd = -1;
     return 0;
   }
 
@@ -152,13 +155,13 @@ static int do_openFifoOutput(RCInput* _rc, const char* _fifoOutputName)
     return res;
   }
 
-  _rc->m_fifoOutputFd = open(_fifoOutputName, O_WRONLY|O_NONBLOCK);
-  if (_rc->m_fifoOutputFd < 0)
+  *_fifoOutputFd = open(_fifoOutputName, O_WRONLY|O_NONBLOCK);
+  if (*_fifoOutputFd < 0)
   {
     res = errno;
     fprintf(stderr, "open(%s, WR_ONLY side) failed: %d\n", _fifoOutputName, errno);
     close(fifoOutputRdFd);
-    _rc->m_fifoOutputFd = -1;
+    *_fifoOutputFd = -1;
     unlink(_fifoOutputName);
     return res;
   }
@@ -169,41 +172,41 @@ static int do_openFifoOutput(RCInput* _rc, const char* _fifoOutputName)
     fprintf(stderr, "close(RD_ONLY side) failed: %d\n", res);
   }
 
-  _rc->m_fifoOutputName = strdup(_fifoOutputName);
+  *_fifoOutputNameCopy = strdup(_fifoOutputName);
 
   return 0;
 }
 
-static int do_closeFifoOutput(RCInput* _rc)
+static int do_closeFifoOutput(int* _fifoOutputFd, char** _fifoOutputNameCopy)
 {
   int res;
   int exit_code = 0;
 
-  if (_rc == NULL)
+  if (_fifoOutputFd == NULL || _fifoOutputNameCopy == NULL)
     return EINVAL;
 
-  if (   _rc->m_fifoOutputFd != -1
-      && close(_rc->m_fifoOutputFd) != 0)
+  if (   *_fifoOutputFd != -1
+      && close(*_fifoOutputFd) != 0)
   {
     res = errno;
     fprintf(stderr, "close() failed: %d\n", res);
     exit_code = res;
   }
-  _rc->m_fifoOutputFd = -1;
+  *_fifoOutputFd = -1;
 
-  if (_rc->m_fifoOutputName != NULL)
+  if (*_fifoOutputNameCopy != NULL)
   {
-    if (unlink(_rc->m_fifoOutputName) != 0)
+    if (unlink(*_fifoOutputNameCopy) != 0)
     {
       res = errno;
       if (res != EBUSY)
       {
-        fprintf(stderr, "unlink(%s) failed: %d\n", _rc->m_fifoOutputName, res);
+        fprintf(stderr, "unlink(%s) failed: %d\n", *_fifoOutputNameCopy, res);
         exit_code = res;
       }
     }
-    free(_rc->m_fifoOutputName);
-    _rc->m_fifoOutputName = NULL;
+    free(*_fifoOutputNameCopy);
+    *_fifoOutputNameCopy = NULL;
   }
 
   return exit_code;
@@ -320,6 +323,38 @@ static int do_readFifoInput(RCInput* _rc)
         _rc->m_videoOutParamsUpdated = true;
       }
     }
+    else if (strncmp(parseAt, "v4l2 ", strlen("v4l2 ")) == 0)
+    {
+      unsigned width, height, camera = 0;
+      char formatName[16] = "auto";
+      uint32_t format;
+      parseAt += strlen("v4l2 ");
+
+      // v4l2 <width> <height> [format [camera]]
+      if (   sscanf(parseAt, "%u %u %15s %u", &width, &height, formatName, &camera) < 2
+          || width == 0 || height == 0)
+        fprintf(stderr, "Cannot parse v4l2 command, args '%s'\n", parseAt);
+      else if (!v4l2InputFormatByName(formatName, &format))
+        fprintf(stderr, "Unknown v4l2 format '%s' in v4l2 command\n", formatName);
+      else
+      {
+        _rc->m_videoFormatCommand.m_camera = camera;
+        _rc->m_videoFormatCommand.m_width  = width;
+        _rc->m_videoFormatCommand.m_height = height;
+        _rc->m_videoFormatCommand.m_format = format;
+        _rc->m_videoFormatCommandUpdated = true;
+      }
+    }
+    else if (strcmp(parseAt, "stats") == 0)
+    {
+      _rc->m_timingCommand = 1;
+      _rc->m_timingCommandUpdated = true;
+    }
+    else if (strcmp(parseAt, "stats reset") == 0)
+    {
+      _rc->m_timingCommand = 2;
+      _rc->m_timingCommandUpdated = true;
+    }
     else
       fprintf(stderr, "Unknown command '%s'\n", parseAt);
 
@@ -333,6 +368,37 @@ static int do_readFifoInput(RCInput* _rc)
 }
 
 
+static void do_formatTimestamp(RCInput* _rc, const FrameInfo* _frameInfo, char* _buf, size_t _bufSize)
+{
+  if (_rc->m_reportTimestamp && _frameInfo != NULL)
+    snprintf(_buf, _bufSize, " %lld", _frameInfo->m_timestampUs);
+  else
+    _buf[0] = '\0';
+}
+
+// camera 0 reports keep the single camera format
+static void do_formatCamera(const FrameInfo* _frameInfo, char* _buf, size_t _bufSize)
+{
+  if (_frameInfo != NULL && _frameInfo->m_camera != 0)
+    snprintf(_buf, _bufSize, "cam%"PRIu32" ", _frameInfo->m_camera);
+  else
+    _buf[0] = '\0';
+}
+
+static void do_accountLatency(RCInput* _rc, const FrameInfo* _frameInfo)
+{
+  struct timespec now;
+  if (_frameInfo == NULL || clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+    return;
+
+  const long long latencyUs = (long long)now.tv_sec*1000000 + now.tv_nsec/1000 - _frameInfo->m_timestampUs;
+  ++_rc->m_latencyCount;
+  _rc->m_latencySumUs += latencyUs;
+  if (_rc->m_latencyMaxUs < latencyUs)
+    _rc->m_latencyMaxUs = latencyUs;
+}
+
+
 int rcInputInit(bool _verbose)
 {
   (void)_verbose;
@@ -356,18 +422,34 @@ int rcInputOpen(RCInput* _rc, const RCConfig* _config)
   if ((res = do_openFifoInput(_rc, _config->m_fifoInput)) != 0)
     return res;
 
-  if ((res = do_openFifoOutput(_rc, _config->m_fifoOutput)) != 0)
+  if ((res = do_openFifoOutput(&_rc->m_fifoOutputFd, &_rc->m_fifoOutputName, _config->m_fifoOutput)) != 0)
   {
     do_closeFifoInput(_rc);
     return res;
   }
 
+  size_t algorithm;
+  for (algorithm = 0; algorithm < MAX_ALGORITHMS_N; ++algorithm)
+    if ((res = do_openFifoOutput(&_rc->m_fifoAlgorithmOutputFd[algorithm], &_rc->m_fifoAlgorithmOutputName[algorithm],
+                                 _config->m_fifoAlgorithmOutput[algorithm])) != 0)
+    {
+      while (algorithm-- > 0)
+        do_closeFifoOutput(&_rc->m_fifoAlgorithmOutputFd[algorithm], &_rc->m_fifoAlgorithmOutputName[algorithm]);
+      do_closeFifoOutput(&_rc->m_fifoOutputFd, &_rc->m_fifoOutputName);
+      do_closeFifoInput(_rc);
+      return res;
+    }
+
   _rc->m_fifoInputReadBufferSize = 1000;
   _rc->m_fifoInputReadBufferUsed = 0;
   _rc->m_fifoInputReadBuffer = malloc(_rc->m_fifoInputReadBufferSize);
 
   _rc->m_videoOutEnable = _config->m_videoOutEnable;
   _rc->m_objectsN = _config->m_objectsN < MAX_OBJECTS_N ? (_config->m_objectsN > 0 ? _config->m_objectsN : 1 ) : MAX_OBJECTS_N;
+  _rc->m_reportTimestamp = _config->m_reportTimestamp;
+  _rc->m_latencyCount = 0;
+  _rc->m_latencySumUs = 0;
+  _rc->m_latencyMaxUs = 0;
   return 0;
 }
 
@@ -383,7 +465,10 @@ int rcInputClose(RCInput* _rc)
   _rc->m_fifoInputReadBuffer = NULL;
   _rc->m_fifoInputReadBufferSize = 0;
 
-  do_closeFifoOutput(_rc);
+  size_t algorithm;
+  for (algorithm = 0; algorithm < MAX_ALGORITHMS_N; ++algorithm)
+    do_closeFifoOutput(&_rc->m_fifoAlgorithmOutputFd[algorithm], &_rc->m_fifoAlgorithmOutputName[algorithm]);
+  do_closeFifoOutput(&_rc->m_fifoOutputFd, &_rc->m_fifoOutputName);
   do_closeFifoInput(_rc);
 
   return 0;
@@ -477,36 +562,167 @@ int rcInputGetTargetDetectCommand(RCInput* _rc, TargetDetectCommand* _targetDete
   return 0;
 }
 
+int rcInputGetVideoFormatCommand(RCInput* _rc, VideoFormatCommand* _videoFormatCommand)
+{
+  if (_rc == NULL || _videoFormatCommand == NULL)
+    return EINVAL;
+
+  if (!_rc->m_videoFormatCommandUpdated)
+    return ENODATA;
+
+  _rc->m_videoFormatCommandUpdated = false;
+  *_videoFormatCommand = _rc->m_videoFormatCommand;
+
+  return 0;
+}
+
+int rcInputGetTimingCommand(RCInput* _rc, int* _timingCommand)
+{
+  if (_rc == NULL || _timingCommand == NULL)
+    return EINVAL;
+
+  if (!_rc->m_timingCommandUpdated)
+    return ENODATA;
+
+  _rc->m_timingCommandUpdated = false;
+  *_timingCommand = _rc->m_timingCommand;
+
+  return 0;
+}
+
 #warning TODO code below if unsafe since it is used from another thread; consider reworking
-int rcInputUnsafeReportTargetLocation(RCInput* _rc, const TargetLocation* _targetLocation)
+int rcInputUnsafeReportTargetLocation(RCInput* _rc, const TargetLocation* _targetLocation, const FrameInfo* _frameInfo)
 {
   if (_rc == NULL || _targetLocation == NULL)
     return EINVAL;
 
+  char timestamp[32];
+  char camera[16];
+  do_formatTimestamp(_rc, _frameInfo, timestamp, sizeof(timestamp));
+  do_formatCamera(_frameInfo, camera, sizeof(camera));
+
   if (!_rc->m_fifoOutputFd != -1)
     if(_rc->m_objectsN == 1)
-      dprintf(_rc->m_fifoOutputFd, "loc: %d %d %d\n", _targetLocation->target[0].x, _targetLocation->target[0].y, _targetLocation->target[0].size);
+      dprintf(_rc->m_fifoOutputFd, "%sloc: %d %d %d%s\n", camera, _targetLocation->target[0].x, _targetLocation->target[0].y, _targetLocation->target[0].size, timestamp);
     else {
       for(int i = 0; i < _rc->m_objectsN; ++i) {
-        dprintf(_rc->m_fifoOutputFd, "loc%d: %d %d %d\n", i, _targetLocation->target[i].x, _targetLocation->target[i].y, _targetLocation->target[i].size);
+        dprintf(_rc->m_fifoOutputFd, "%sloc%d: %d %d %d%s\n", camera, i, _targetLocation->target[i].x, _targetLocation->target[i].y, _targetLocation->target[i].size, timestamp);
       }
     }
 
+  do_accountLatency(_rc, _frameInfo);
+
+  return 0;
+}
+
+// own fifo of the algorithm if configured, otherwise main output with algorithm number, extra ones count from 1
+int rcInputUnsafeReportAlgorithmResult(RCInput* _rc, size_t _algorithm, const AlgorithmResult* _result, const FrameInfo* _frameInfo)
+{
+  if (_rc == NULL || _result == NULL || _algorithm >= MAX_ALGORITHMS_N)
+    return EINVAL;
+
+  char timestamp[32];
+  char camera[16];
+  char prefix[32];
+  do_formatTimestamp(_rc, _frameInfo, timestamp, sizeof(timestamp));
+  do_formatCamera(_frameInfo, camera, sizeof(camera));
+
+  int fd = _rc->m_fifoAlgorithmOutputFd[_algorithm];
+  if (fd != -1)
+    snprintf(prefix, sizeof(prefix), "%s", camera);
+  else
+  {
+    fd = _rc->m_fifoOutputFd;
+    snprintf(prefix, sizeof(prefix), "%salg%zu ", camera, _algorithm+1);
+  }
+  if (fd == -1)
+    return 0;
+
+  const TargetLocation* targetLocation = &_result->m_targetLocation;
+  const LineLocation* lineLocation = &_result->m_lineLocation;
+  switch (_result->m_type)
+  {
+    case ALGORITHM_RESULT_TARGETS:
+      if (_rc->m_objectsN == 1)
+        dprintf(fd, "%sloc: %d %d %d%s\n", prefix, targetLocation->target[0].x, targetLocation->target[0].y, targetLocation->target[0].size, timestamp);
+      else
+      {
+        int i;
+        for (i = 0; i < _rc->m_objectsN; ++i)
+          dprintf(fd, "%sloc%d: %d %d %d%s\n", prefix, i, targetLocation->target[i].x, targetLocation->target[i].y, targetLocation->target[i].size, timestamp);
+      }
+      break;
+
+    case ALGORITHM_RESULT_LINE:
+      dprintf(fd, "%sline: %d %d %d%s\n", prefix, lineLocation->m_lineX, lineLocation->m_lineY, lineLocation->m_lineSize, timestamp);
+      break;
+
+    default:
+      return EINVAL;
+  }
+
   return 0;
 }
 
 #warning TODO code below if unsafe since it is used from another thread; consider reworking
-int rcInputUnsafeReportTargetDetectParams(RCInput* _rc, const TargetDetectParams* _targetDetectParams)
+int rcInputUnsafeReportTargetDetectParams(RCInput* _rc, const TargetDetectParams* _targetDetectParams, const FrameInfo* _frameInfo)
 {
   if (_rc == NULL || _targetDetectParams == NULL)
     return EINVAL;
 
+  char timestamp[32];
+  char camera[16];
+  do_formatTimestamp(_rc, _frameInfo, timestamp, sizeof(timestamp));
+  do_formatCamera(_frameInfo, camera, sizeof(camera));
+
   if (!_rc->m_fifoOutputFd != -1)
-    dprintf(_rc->m_fifoOutputFd, "hsv: %d %d %d %d %d %d\n",
+    dprintf(_rc->m_fifoOutputFd, "%shsv: %d %d %d %d %d %d%s\n", camera,
             _targetDetectParams->m_detectHue, _targetDetectParams->m_detectHueTolerance,
             _targetDetectParams->m_detectSat, _targetDetectParams->m_detectSatTolerance,
-            _targetDetectParams->m_detectVal, _targetDetectParams->m_detectValTolerance);
+            _targetDetectParams->m_detectVal, _targetDetectParams->m_detectValTolerance,
+            timestamp);
+
+  do_accountLatency(_rc, _frameInfo);
 
   return 0;
 }
 
+// latency counters are updated by target reports, so this runs on video thread too
+int rcInputUnsafeReportLatency(RCInput* _rc, long long _ms)
+{
+  (void)_ms;
+
+  if (_rc == NULL)
+    return EINVAL;
+
+  if (_rc->m_latencyCount > 0)
+    fprintf(stderr, "Capture to report latency avg %lld.%03lld ms, max %lld.%03lld ms over %lld reports\n",
+            (_rc->m_latencySumUs/_rc->m_latencyCount)/1000, (_rc->m_latencySumUs/_rc->m_latencyCount)%1000,
+            _rc->m_latencyMaxUs/1000, _rc->m_latencyMaxUs%1000,
+            _rc->m_latencyCount);
+
+  _rc->m_latencyCount = 0;
+  _rc->m_latencySumUs = 0;
+  _rc->m_latencyMaxUs = 0;
+
+  return 0;
+}
+
+// stats: <stage> <count> <min> <mean> <p50> <p99> <max>, microseconds
+int rcInputUnsafeReportTiming(RCInput* _rc, uint32_t _camera, const char* _stage, const TimingSummary* _summary)
+{
+  if (_rc == NULL || _stage == NULL || _summary == NULL)
+    return EINVAL;
+
+  char camera[16];
+  const FrameInfo frameInfo = { .m_camera = _camera };
+  do_formatCamera(&frameInfo, camera, sizeof(camera));
+
+  char timing[96];
+  timingSummaryFormat(_summary, timing, sizeof(timing));
+
+  if (_rc->m_fifoOutputFd != -1)
+    dprintf(_rc->m_fifoOutputFd, "%sstats: %s %s\n", camera, _stage, timing);
+
+  return 0;
+}
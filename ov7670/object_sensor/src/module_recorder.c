@@ -0,0 +1,391 @@
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "internal/module_recorder.h"
+#include "internal/module_v4l2_replay.h"
+
+
+#define RECORDER_ALIGN         4096 // O_DIRECT and flash page friendly
+#define RECORDER_FRAME_OFFSET  64   // room for V4L2ReplayFrameHeader, keeps pixels cache line aligned
+
+static size_t do_recorderAlign(size_t _size)
+{
+  return (_size + RECORDER_ALIGN - 1) & ~(size_t)(RECORDER_ALIGN - 1);
+}
+
+static int do_recorderWrite(Recorder* _rec, const void* _ptr, size_t _size, off_t _offset)
+{
+  const uint8_t* ptr = _ptr;
+
+  while (_size > 0)
+  {
+    ssize_t written = pwrite(_rec->m_fd, ptr, _size, _offset);
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return errno;
+    }
+    if (written == 0)
+      return ENOSPC;
+
+    ptr     += written;
+    _size   -= written;
+    _offset += written;
+  }
+
+  return 0;
+}
+
+static int do_recorderOpenFile(Recorder* _rec, const char* _path)
+{
+  int res;
+
+  _rec->m_direct = true;
+  _rec->m_fd = open(_path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC|O_DIRECT, 0644);
+  if (_rec->m_fd < 0 && errno == EINVAL) // tmpfs
+  {
+    _rec->m_direct = false;
+    _rec->m_fd = open(_path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+  }
+
+  if (_rec->m_fd < 0)
+  {
+    res = errno;
+    fprintf(stderr, "open(%s) failed: %d\n", _path, res);
+    _rec->m_fd = -1;
+    return res;
+  }
+
+  // preallocate whole ring so that recording does not stall on block allocation
+  const off_t fileSize = _rec->m_fileHeaderSize + (off_t)_rec->m_fileFrames*_rec->m_frameStride;
+  if ((res = posix_fallocate(_rec->m_fd, 0, fileSize)) != 0)
+  {
+    if (ftruncate(_rec->m_fd, fileSize) != 0)
+    {
+      res = errno;
+      fprintf(stderr, "ftruncate(%s, %lld) failed: %d\n", _path, (long long)fileSize, res);
+      goto exit_close;
+    }
+  }
+
+  return 0;
+
+
+ exit_close:
+  close(_rec->m_fd);
+  _rec->m_fd = -1;
+  return res;
+}
+
+static int do_recorderWriteFileHeader(Recorder* _rec, const struct v4l2_format* _format)
+{
+  int res;
+  void* block;
+
+  if ((res = posix_memalign(&block, RECORDER_ALIGN, _rec->m_fileHeaderSize)) != 0)
+  {
+    fprintf(stderr, "posix_memalign(%zu) failed: %d\n", _rec->m_fileHeaderSize, res);
+    return res;
+  }
+  memset(block, 0, _rec->m_fileHeaderSize);
+
+  V4L2ReplayFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.m_magic, V4L2_REPLAY_MAGIC, sizeof(V4L2_REPLAY_MAGIC));
+  header.m_headerSize  = _rec->m_fileHeaderSize;
+  header.m_width       = _format->fmt.pix.width;
+  header.m_height      = _format->fmt.pix.height;
+  header.m_format      = _format->fmt.pix.pixelformat;
+  header.m_lineLength  = _format->fmt.pix.bytesperline;
+  header.m_frameSize   = _rec->m_frameSize;
+  header.m_frameOffset = _rec->m_frameOffset;
+  header.m_frameStride = _rec->m_frameStride;
+  memcpy(block, &header, sizeof(header));
+
+  if ((res = do_recorderWrite(_rec, block, _rec->m_fileHeaderSize, 0)) != 0)
+    fprintf(stderr, "Recorder header write failed: %d\n", res);
+
+  free(block);
+  return res;
+}
+
+static void do_recorderFreeQueue(Recorder* _rec)
+{
+  size_t slot;
+  for (slot = 0; slot < RECORDER_MAX_QUEUE; ++slot)
+  {
+    free(_rec->m_queue[slot]);
+    _rec->m_queue[slot] = NULL;
+  }
+}
+
+static int do_recorderAllocQueue(Recorder* _rec)
+{
+  int res;
+  size_t slot;
+
+  for (slot = 0; slot < _rec->m_queueFrames; ++slot)
+  {
+    if ((res = posix_memalign(&_rec->m_queue[slot], RECORDER_ALIGN, _rec->m_frameStride)) != 0)
+    {
+      fprintf(stderr, "posix_memalign(%zu) failed: %d\n", _rec->m_frameStride, res);
+      _rec->m_queue[slot] = NULL;
+      do_recorderFreeQueue(_rec);
+      return res;
+    }
+    memset(_rec->m_queue[slot], 0, _rec->m_frameStride);
+  }
+
+  return 0;
+}
+
+static void* do_recorderThread(void* _arg)
+{
+  int res;
+  Recorder* rec = (Recorder*)_arg;
+
+  pthread_mutex_lock(&rec->m_mutex);
+  while (true)
+  {
+    while (rec->m_queueTail == rec->m_queueHead && !rec->m_threadTerminate)
+      pthread_cond_wait(&rec->m_cond, &rec->m_mutex);
+
+    if (rec->m_queueTail == rec->m_queueHead) // terminating and drained
+      break;
+
+    const void* slot = rec->m_queue[rec->m_queueTail % rec->m_queueFrames];
+    const off_t offset = rec->m_fileHeaderSize + (off_t)(rec->m_fileFrameIndex % rec->m_fileFrames)*rec->m_frameStride;
+    const bool writeFailed = rec->m_writeError != 0;
+    pthread_mutex_unlock(&rec->m_mutex);
+
+    res = writeFailed ? 0 : do_recorderWrite(rec, slot, rec->m_frameStride, offset);
+
+    pthread_mutex_lock(&rec->m_mutex);
+    if (res != 0)
+    {
+      fprintf(stderr, "Recorder write at %lld failed, recording stopped: %d\n", (long long)offset, res);
+      rec->m_writeError = res;
+    }
+    else if (!writeFailed)
+    {
+      ++rec->m_fileFrameIndex;
+      ++rec->m_frameRecorded;
+    }
+    ++rec->m_queueTail;
+  }
+  pthread_mutex_unlock(&rec->m_mutex);
+
+  return NULL;
+}
+
+static int do_recorderPushFrame(Recorder* _rec, const void* _framePtr, size_t _frameSize, const FrameInfo* _frameInfo)
+{
+  pthread_mutex_lock(&_rec->m_mutex);
+  if (   !_rec->m_threadRunning
+      || _rec->m_writeError != 0
+      || _rec->m_queueHead - _rec->m_queueTail >= _rec->m_queueFrames)
+  {
+    ++_rec->m_frameDropped;
+    pthread_mutex_unlock(&_rec->m_mutex);
+    return 0;
+  }
+  uint8_t* slot = _rec->m_queue[_rec->m_queueHead % _rec->m_queueFrames];
+  pthread_mutex_unlock(&_rec->m_mutex);
+
+  // slot is owned by producer until head is advanced
+  if (_frameSize > _rec->m_frameSize)
+    _frameSize = _rec->m_frameSize;
+
+  V4L2ReplayFrameHeader frameHeader;
+  frameHeader.m_sequence    = _frameInfo->m_sequence;
+  frameHeader.m_frameSize   = _frameSize;
+  frameHeader.m_timestampUs = _frameInfo->m_timestampUs;
+  memcpy(slot + _rec->m_frameOffset - sizeof(frameHeader), &frameHeader, sizeof(frameHeader));
+  memcpy(slot + _rec->m_frameOffset, _framePtr, _frameSize);
+
+  pthread_mutex_lock(&_rec->m_mutex);
+  ++_rec->m_queueHead;
+  pthread_cond_signal(&_rec->m_cond);
+  pthread_mutex_unlock(&_rec->m_mutex);
+
+  return 0;
+}
+
+
+
+
+int recorderInit(bool _verbose)
+{
+  (void)_verbose;
+  return 0;
+}
+
+int recorderFini()
+{
+  return 0;
+}
+
+int recorderOpen(Recorder* _rec, const RecorderConfig* _config, const struct v4l2_format* _format)
+{
+  int res = 0;
+
+  if (_rec == NULL || _config == NULL || _config->m_path == NULL || _format == NULL)
+    return EINVAL;
+  if (_rec->m_fd != -1)
+    return EALREADY;
+
+  _rec->m_frameSize      = _format->fmt.pix.sizeimage;
+  _rec->m_frameOffset    = RECORDER_FRAME_OFFSET;
+  _rec->m_frameStride    = do_recorderAlign(_rec->m_frameOffset + _rec->m_frameSize);
+  _rec->m_fileHeaderSize = do_recorderAlign(sizeof(V4L2ReplayFileHeader));
+  _rec->m_fileFrames     = _config->m_fileFrames > 0 ? _config->m_fileFrames : 1;
+  _rec->m_fileFrameIndex = 0;
+
+  _rec->m_queueFrames = _config->m_queueFrames;
+  if (_rec->m_queueFrames < 1)
+    _rec->m_queueFrames = 1;
+  if (_rec->m_queueFrames > RECORDER_MAX_QUEUE)
+    _rec->m_queueFrames = RECORDER_MAX_QUEUE;
+
+  if ((res = do_recorderAllocQueue(_rec)) != 0)
+    goto exit;
+
+  if ((res = do_recorderOpenFile(_rec, _config->m_path)) != 0)
+    goto exit_free_queue;
+
+  if ((res = do_recorderWriteFileHeader(_rec, _format)) != 0)
+    goto exit_close_file;
+
+  pthread_mutex_init(&_rec->m_mutex, NULL);
+  pthread_cond_init(&_rec->m_cond, NULL);
+  _rec->m_threadRunning = false;
+
+  fprintf(stderr, "Recording to %s: %zu frames ring of %zu bytes, queue %zu%s\n",
+          _config->m_path, _rec->m_fileFrames, _rec->m_frameStride, _rec->m_queueFrames,
+          _rec->m_direct ? ", direct" : "");
+
+  return 0;
+
+
+ exit_close_file:
+  close(_rec->m_fd);
+  _rec->m_fd = -1;
+ exit_free_queue:
+  do_recorderFreeQueue(_rec);
+ exit:
+  return res;
+}
+
+int recorderClose(Recorder* _rec)
+{
+  if (_rec == NULL)
+    return EINVAL;
+  if (_rec->m_fd == -1)
+    return EALREADY;
+
+  // ring never wrapped, drop unused preallocated tail so replay sees only recorded frames
+  if (_rec->m_fileFrameIndex < _rec->m_fileFrames)
+  {
+    const off_t fileSize = _rec->m_fileHeaderSize + (off_t)_rec->m_fileFrameIndex*_rec->m_frameStride;
+    if (ftruncate(_rec->m_fd, fileSize) != 0)
+      fprintf(stderr, "ftruncate(%lld) failed: %d\n", (long long)fileSize, errno);
+  }
+
+  fprintf(stderr, "Recorded %zu frames\n", _rec->m_fileFrameIndex);
+
+  close(_rec->m_fd);
+  _rec->m_fd = -1;
+  do_recorderFreeQueue(_rec);
+  pthread_cond_destroy(&_rec->m_cond);
+  pthread_mutex_destroy(&_rec->m_mutex);
+
+  return 0;
+}
+
+int recorderStart(Recorder* _rec)
+{
+  int res;
+
+  if (_rec == NULL)
+    return EINVAL;
+  if (_rec->m_fd == -1)
+    return ENOTCONN;
+  if (_rec->m_threadRunning)
+    return EALREADY;
+
+  _rec->m_queueHead = 0;
+  _rec->m_queueTail = 0;
+  _rec->m_writeError = 0;
+  _rec->m_frameRecorded = 0;
+  _rec->m_frameDropped = 0;
+  _rec->m_threadTerminate = false;
+
+  if ((res = pthread_create(&_rec->m_thread, NULL, &do_recorderThread, _rec)) != 0)
+  {
+    fprintf(stderr, "pthread_create(recorder) failed: %d\n", res);
+    return res;
+  }
+  _rec->m_threadRunning = true;
+
+  return 0;
+}
+
+int recorderStop(Recorder* _rec)
+{
+  if (_rec == NULL)
+    return EINVAL;
+  if (_rec->m_fd == -1)
+    return ENOTCONN;
+  if (!_rec->m_threadRunning)
+    return 0;
+
+  pthread_mutex_lock(&_rec->m_mutex);
+  _rec->m_threadTerminate = true;
+  _rec->m_threadRunning = false;
+  pthread_cond_signal(&_rec->m_cond);
+  pthread_mutex_unlock(&_rec->m_mutex);
+
+  pthread_join(_rec->m_thread, NULL);
+
+  return 0;
+}
+
+int recorderPushFrame(Recorder* _rec, const void* _framePtr, size_t _frameSize, const FrameInfo* _frameInfo)
+{
+  if (_rec == NULL || _framePtr == NULL || _frameInfo == NULL)
+    return EINVAL;
+  if (_rec->m_fd == -1)
+    return ENOTCONN;
+
+  return do_recorderPushFrame(_rec, _framePtr, _frameSize, _frameInfo);
+}
+
+int recorderReportStats(Recorder* _rec, long long _ms)
+{
+  (void)_ms;
+
+  if (_rec == NULL)
+    return EINVAL;
+  if (_rec->m_fd == -1)
+    return ENOTCONN;
+
+  pthread_mutex_lock(&_rec->m_mutex);
+  size_t recorded = _rec->m_frameRecorded;
+  size_t dropped  = _rec->m_frameDropped;
+  _rec->m_frameRecorded = 0;
+  _rec->m_frameDropped = 0;
+  pthread_mutex_unlock(&_rec->m_mutex);
+
+  fprintf(stderr, "Recorder wrote %zu frames, dropped %zu\n", recorded, dropped);
+
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <assert.h>
 #include <inttypes.h>
 #include <sys/mman.h>
@@ -9,12 +10,15 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <errno.h>
+#include <time.h>
 
 #include <linux/videodev2.h>
 #include <libv4l2.h>
 
 #include "internal/module_v4l2.h"
+#include "internal/module_v4l2_replay.h"
 
 
 
@@ -118,6 +122,145 @@ static int do_v4l2InputSetFormat(V4L2Input* _v4l2, size_t _width, size_t _height
   return 0;
 }
 
+// formats codec accepts (see module_ce do_convertPixelFormat), cheapest to capture and convert first
+static const uint32_t s_v4l2InputFormatCost[] = {
+  V4L2_PIX_FMT_YUV422P,
+  V4L2_PIX_FMT_YUYV,
+  V4L2_PIX_FMT_RGB565,
+  V4L2_PIX_FMT_RGB565X,
+  V4L2_PIX_FMT_RGB24,
+  V4L2_PIX_FMT_YUV32,
+};
+
+static int do_v4l2InputSelectFormat(V4L2Input* _v4l2, uint32_t* _format)
+{
+  if (_v4l2 == NULL || _format == NULL)
+    return EINVAL;
+
+  static const size_t s_formatCount = sizeof(s_v4l2InputFormatCost)/sizeof(*s_v4l2InputFormatCost);
+  size_t best = s_formatCount;
+
+  // raw device, no libv4l2 conversion here, so every enumerated format is native
+  size_t fmtIdx;
+  for (fmtIdx = 0; ; ++fmtIdx)
+  {
+    struct v4l2_fmtdesc fmtDesc;
+    memset(&fmtDesc, 0, sizeof(fmtDesc));
+    fmtDesc.index = fmtIdx;
+    fmtDesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(_v4l2->m_fd, VIDIOC_ENUM_FMT, &fmtDesc) != 0)
+      break; // EINVAL past the last one
+
+    size_t costIdx;
+    for (costIdx = 0; costIdx < best; ++costIdx)
+      if (s_v4l2InputFormatCost[costIdx] == fmtDesc.pixelformat)
+        break;
+
+    best = costIdx;
+  }
+
+  if (best >= s_formatCount)
+  {
+    fprintf(stderr, "V4L2 device enumerates no format codec accepts\n");
+    return ENOTSUP;
+  }
+  *_format = s_v4l2InputFormatCost[best];
+
+  fprintf(stderr, "V4L2 selected format %c%c%c%c\n",
+          (*_format    ) & 0xff, (*_format>>8 ) & 0xff,
+          (*_format>>16) & 0xff, (*_format>>24) & 0xff);
+
+  return 0;
+}
+
+static int do_v4l2InputSetCrop(V4L2Input* _v4l2, struct v4l2_rect* _crop)
+{
+  int res;
+
+  if (_v4l2 == NULL || _crop == NULL)
+    return EINVAL;
+
+#ifdef V4L2_SEL_TGT_CROP
+  struct v4l2_selection selection;
+  memset(&selection, 0, sizeof(selection));
+  selection.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  selection.target = V4L2_SEL_TGT_CROP;
+  selection.r      = *_crop;
+
+  if (ioctl(_v4l2->m_fd, VIDIOC_S_SELECTION, &selection) == 0)
+  {
+    *_crop = selection.r;
+    return 0;
+  }
+  if (errno != ENOTTY && errno != EINVAL)
+  {
+    res = errno;
+    fprintf(stderr, "v4l2_ioctl(VIDIOC_S_SELECTION) failed: %d\n", res);
+    return res;
+  }
+#endif
+
+  // older drivers only know crop ioctls
+  struct v4l2_crop crop;
+  memset(&crop, 0, sizeof(crop));
+  crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  crop.c    = *_crop;
+
+  if (ioctl(_v4l2->m_fd, VIDIOC_S_CROP, &crop) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "v4l2_ioctl(VIDIOC_S_CROP) failed: %d\n", res);
+    return res;
+  }
+
+  // S_CROP is write-only, driver may have adjusted the window
+  if (ioctl(_v4l2->m_fd, VIDIOC_G_CROP, &crop) == 0)
+    *_crop = crop.c;
+
+  return 0;
+}
+
+static int do_v4l2InputSetFrameRate(V4L2Input* _v4l2, size_t _fps)
+{
+  int res;
+
+  if (_v4l2 == NULL || _fps == 0)
+    return EINVAL;
+
+  struct v4l2_streamparm streamParm;
+  memset(&streamParm, 0, sizeof(streamParm));
+  streamParm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+  if (ioctl(_v4l2->m_fd, VIDIOC_G_PARM, &streamParm) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "v4l2_ioctl(VIDIOC_G_PARM) failed: %d\n", res);
+    return res;
+  }
+
+  if (!(streamParm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME))
+  {
+    fprintf(stderr, "V4L2 device does not support frame rate selection\n");
+    return ENOTSUP;
+  }
+
+  streamParm.parm.capture.timeperframe.numerator   = 1;
+  streamParm.parm.capture.timeperframe.denominator = _fps;
+  if (ioctl(_v4l2->m_fd, VIDIOC_S_PARM, &streamParm) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "v4l2_ioctl(VIDIOC_S_PARM) failed: %d\n", res);
+    return res;
+  }
+
+  // on return, timeperframe contains actually used rate
+  const struct v4l2_fract* tpf = &streamParm.parm.capture.timeperframe;
+  if (tpf->numerator != 0)
+    fprintf(stderr, "V4L2 frame rate %"PRIu32"/%"PRIu32" fps\n", tpf->denominator, tpf->numerator);
+
+  return 0;
+}
+
 static int do_v4l2InputUnsetFormat(V4L2Input* _v4l2)
 {
   if (_v4l2 == NULL)
@@ -144,36 +287,35 @@ static int do_v4l2InputGetFormat(V4L2Input* _v4l2,
 }
 
 
-static int do_v4l2InputMmapBuffers(V4L2Input* _v4l2)
+static int do_v4l2InputRequestBuffers(V4L2Input* _v4l2, enum v4l2_memory _memory, size_t* _count)
 {
-  int res = 0;
+  int res;
 
-  assert(sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers) == sizeof(_v4l2->m_bufferSize)/sizeof(*_v4l2->m_bufferSize));
-  if (_v4l2 == NULL)
+  if (_v4l2 == NULL || _count == NULL)
     return EINVAL;
 
   struct v4l2_requestbuffers requestBuffers;
   memset(&requestBuffers, 0, sizeof(requestBuffers));
-  requestBuffers.count = sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers);
+  requestBuffers.count = _v4l2->m_bufferCount;
   requestBuffers.type = _v4l2->m_imageFormat.type;
-  requestBuffers.memory = V4L2_MEMORY_MMAP;
+  requestBuffers.memory = _memory;
 
   if (ioctl(_v4l2->m_fd, VIDIOC_REQBUFS, &requestBuffers) != 0)
   {
     res = errno;
-    fprintf(stderr, "v4l2_ioctl(VIDIOC_REQBUFS) failed: %d\n", res);
-    goto exit;
+    fprintf(stderr, "v4l2_ioctl(VIDIOC_REQBUFS, %s) failed: %d\n",
+            _memory == V4L2_MEMORY_USERPTR ? "userptr" : "mmap", res);
+    return res;
   }
 
   if (requestBuffers.count <= 0)
   {
-    res = ENOSPC;
     fprintf(stderr, "v4l2_ioctl(VIDIOC_REQBUFS) returned no buffers\n");
-    goto exit;
+    return ENOSPC;
   }
-  else if (requestBuffers.count < sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers))
+  else if (requestBuffers.count < _v4l2->m_bufferCount)
     fprintf(stderr, "v4l2_ioctl(VIDIOC_REQBUFS) returned only %"PRIu32" buffers of %zu requested\n",
-            requestBuffers.count, sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers));
+            requestBuffers.count, _v4l2->m_bufferCount);
   else if (requestBuffers.count > sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers))
   {
     fprintf(stderr, "v4l2_ioctl(VIDIOC_REQBUFS) returned %"PRIu32" buffers, used only %zu\n",
@@ -181,8 +323,26 @@ static int do_v4l2InputMmapBuffers(V4L2Input* _v4l2)
     requestBuffers.count = sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers);
   }
 
+  _v4l2->m_memory = _memory;
+  *_count = requestBuffers.count;
+
+  return 0;
+}
+
+static int do_v4l2InputMmapBuffers(V4L2Input* _v4l2)
+{
+  int res = 0;
+
+  assert(sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers) == sizeof(_v4l2->m_bufferSize)/sizeof(*_v4l2->m_bufferSize));
+  if (_v4l2 == NULL)
+    return EINVAL;
+
+  size_t bufferCount;
+  if ((res = do_v4l2InputRequestBuffers(_v4l2, V4L2_MEMORY_MMAP, &bufferCount)) != 0)
+    goto exit;
+
   size_t bufferIndex;
-  for (bufferIndex = 0; bufferIndex < requestBuffers.count; ++bufferIndex)
+  for (bufferIndex = 0; bufferIndex < bufferCount; ++bufferIndex)
   {
     struct v4l2_buffer buffer;
     memset(&buffer, 0, sizeof(buffer));
@@ -233,7 +393,7 @@ static int do_v4l2InputMmapBuffers(V4L2Input* _v4l2)
   return res;
 }
 
-static int do_v4l2InputMunmapBuffers(V4L2Input* _v4l2)
+static int do_v4l2InputAllocUserPtrBuffers(V4L2Input* _v4l2)
 {
   int res = 0;
 
@@ -241,15 +401,120 @@ static int do_v4l2InputMunmapBuffers(V4L2Input* _v4l2)
   if (_v4l2 == NULL)
     return EINVAL;
 
+  size_t bufferCount;
+  if ((res = do_v4l2InputRequestBuffers(_v4l2, V4L2_MEMORY_USERPTR, &bufferCount)) != 0)
+    goto exit;
+
+  // buffers come from the same pool as codec buffers, so DSP can read captured frame in place
+  const size_t pageSize = sysconf(_SC_PAGESIZE);
+  memset(&_v4l2->m_allocParams, 0, sizeof(_v4l2->m_allocParams));
+  _v4l2->m_allocParams.type = Memory_CONTIGPOOL;
+  _v4l2->m_allocParams.flags = Memory_CACHED;
+  _v4l2->m_allocParams.align = pageSize;
+  _v4l2->m_allocParams.seg = 0;
+
+  size_t bufferIndex;
+  for (bufferIndex = 0; bufferIndex < bufferCount; ++bufferIndex)
+  {
+    _v4l2->m_bufferSize[bufferIndex] = ((_v4l2->m_imageFormat.fmt.pix.sizeimage + pageSize - 1) / pageSize) * pageSize;
+    _v4l2->m_buffers[bufferIndex] = Memory_alloc(_v4l2->m_bufferSize[bufferIndex], &_v4l2->m_allocParams);
+    if (_v4l2->m_buffers[bufferIndex] == NULL)
+    {
+      res = ENOMEM;
+      fprintf(stderr, "Memory_alloc(index %zu, size %zu) failed\n",
+              bufferIndex, _v4l2->m_bufferSize[bufferIndex]);
+      goto exit_free;
+    }
+  }
+
+  for (/*bufferIndex*/; bufferIndex < sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers); ++bufferIndex)
+  { // fill unused buffers
+    _v4l2->m_buffers[bufferIndex] = MAP_FAILED;
+    _v4l2->m_bufferSize[bufferIndex] = 0;
+  }
+
+  return 0;
+
+
+  size_t idx;
+ exit_free:
+  for (idx = 0; idx < bufferIndex; ++idx)
+    Memory_free(_v4l2->m_buffers[idx], _v4l2->m_bufferSize[idx], &_v4l2->m_allocParams);
+
+ exit:
+  return res;
+}
+
+static int do_v4l2InputExportBuffers(V4L2Input* _v4l2)
+{
+  int res = 0;
+
+  assert(sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers) == sizeof(_v4l2->m_bufferFd)/sizeof(*_v4l2->m_bufferFd));
+  if (_v4l2 == NULL)
+    return EINVAL;
+
   size_t bufferIndex;
   for (bufferIndex = 0; bufferIndex < sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers); ++bufferIndex)
   {
-    if (   _v4l2->m_buffers[bufferIndex] != MAP_FAILED
-        && munmap(_v4l2->m_buffers[bufferIndex], _v4l2->m_bufferSize[bufferIndex]) != 0)
+    if (_v4l2->m_buffers[bufferIndex] == MAP_FAILED)
+      continue;
+
+    struct v4l2_exportbuffer exportBuffer;
+    memset(&exportBuffer, 0, sizeof(exportBuffer));
+    exportBuffer.type = _v4l2->m_imageFormat.type;
+    exportBuffer.index = bufferIndex;
+    exportBuffer.flags = O_CLOEXEC|O_RDONLY;
+
+    if (ioctl(_v4l2->m_fd, VIDIOC_EXPBUF, &exportBuffer) != 0)
     {
-      res = errno; // last error will be returned
-      fprintf(stderr, "v4l2_munmap(index %zu, ptr %p, size %zu) failed: %d\n",
-              bufferIndex, _v4l2->m_buffers[bufferIndex], _v4l2->m_bufferSize[bufferIndex], res);
+      res = errno;
+      fprintf(stderr, "v4l2_ioctl(VIDIOC_EXPBUF, index %zu) failed: %d\n", bufferIndex, res);
+      goto exit_close;
+    }
+
+    _v4l2->m_bufferFd[bufferIndex] = exportBuffer.fd;
+  }
+
+  return 0;
+
+
+  size_t idx;
+ exit_close:
+  for (idx = 0; idx < bufferIndex; ++idx)
+    if (_v4l2->m_bufferFd[idx] != -1)
+    {
+      close(_v4l2->m_bufferFd[idx]);
+      _v4l2->m_bufferFd[idx] = -1;
+    }
+
+  return res;
+}
+
+static int do_v4l2InputFreeBuffers(V4L2Input* _v4l2)
+{
+  int res = 0;
+
+  assert(sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers) == sizeof(_v4l2->m_bufferSize)/sizeof(*_v4l2->m_bufferSize));
+  if (_v4l2 == NULL)
+    return EINVAL;
+
+  size_t bufferIndex;
+  for (bufferIndex = 0; bufferIndex < sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers); ++bufferIndex)
+  {
+    if (_v4l2->m_bufferFd[bufferIndex] != -1)
+      close(_v4l2->m_bufferFd[bufferIndex]);
+    _v4l2->m_bufferFd[bufferIndex] = -1;
+
+    if (_v4l2->m_buffers[bufferIndex] != MAP_FAILED)
+    {
+      if (_v4l2->m_memory == V4L2_MEMORY_USERPTR)
+        Memory_free(_v4l2->m_buffers[bufferIndex], _v4l2->m_bufferSize[bufferIndex], &_v4l2->m_allocParams);
+      else if (munmap(_v4l2->m_buffers[bufferIndex], _v4l2->m_bufferSize[bufferIndex]) != 0)
+      {
+        res = errno; // last error will be returned
+        fprintf(stderr, "v4l2_munmap(index %zu, ptr %p, size %zu) failed: %d\n",
+                bufferIndex, _v4l2->m_buffers[bufferIndex], _v4l2->m_bufferSize[bufferIndex], res);
+      }
     }
     _v4l2->m_buffers[bufferIndex] = MAP_FAILED;
     _v4l2->m_bufferSize[bufferIndex] = 0;
@@ -258,6 +523,172 @@ static int do_v4l2InputMunmapBuffers(V4L2Input* _v4l2)
   return res;
 }
 
+static int do_v4l2InputMmapExportBuffers(V4L2Input* _v4l2)
+{
+  int res;
+
+  if ((res = do_v4l2InputMmapBuffers(_v4l2)) != 0)
+    return res;
+
+  if ((res = do_v4l2InputExportBuffers(_v4l2)) != 0)
+  {
+    do_v4l2InputFreeBuffers(_v4l2);
+    return res;
+  }
+
+  return 0;
+}
+
+static int do_v4l2InputAllocBuffers(V4L2Input* _v4l2, uint32_t _memory)
+{
+  int res;
+
+  if (_v4l2 == NULL)
+    return EINVAL;
+
+  size_t bufferIndex;
+  for (bufferIndex = 0; bufferIndex < sizeof(_v4l2->m_bufferFd)/sizeof(*_v4l2->m_bufferFd); ++bufferIndex)
+    _v4l2->m_bufferFd[bufferIndex] = -1;
+
+  switch (_memory)
+  {
+    case V4L2_MEMORY_MMAP:
+      return do_v4l2InputMmapBuffers(_v4l2);
+
+    case V4L2_MEMORY_USERPTR:
+      return do_v4l2InputAllocUserPtrBuffers(_v4l2);
+
+    case V4L2_MEMORY_DMABUF:
+      return do_v4l2InputMmapExportBuffers(_v4l2);
+
+    case 0:
+      if ((res = do_v4l2InputMmapExportBuffers(_v4l2)) == 0)
+        return 0;
+      fprintf(stderr, "V4L2 dmabuf export is not available, trying userptr: %d\n", res);
+      if ((res = do_v4l2InputAllocUserPtrBuffers(_v4l2)) == 0)
+        return 0;
+      fprintf(stderr, "V4L2 userptr capture is not available, falling back to mmap: %d\n", res);
+      return do_v4l2InputMmapBuffers(_v4l2);
+
+    default:
+      fprintf(stderr, "Unsupported V4L2 memory type %"PRIu32"\n", _memory);
+      return EINVAL;
+  }
+}
+
+static const char* do_v4l2InputPathName(const V4L2Input* _v4l2)
+{
+  if (_v4l2->m_bufferFd[0] != -1)
+    return "dmabuf";
+  else if (_v4l2->m_memory == V4L2_MEMORY_USERPTR)
+    return "userptr";
+  else
+    return "mmap+copy";
+}
+
+// driver refuses format change while it holds buffers
+static int do_v4l2InputReleaseBuffers(V4L2Input* _v4l2)
+{
+  int res;
+
+  struct v4l2_requestbuffers requestBuffers;
+  memset(&requestBuffers, 0, sizeof(requestBuffers));
+  requestBuffers.count = 0;
+  requestBuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  requestBuffers.memory = _v4l2->m_memory;
+
+  if (ioctl(_v4l2->m_fd, VIDIOC_REQBUFS, &requestBuffers) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "v4l2_ioctl(VIDIOC_REQBUFS, 0) failed: %d\n", res);
+    return res;
+  }
+
+  return 0;
+}
+
+static size_t do_v4l2InputBuffersAllocated(const V4L2Input* _v4l2)
+{
+  size_t bufferIndex;
+  for (bufferIndex = 0; bufferIndex < sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers); ++bufferIndex)
+    if (_v4l2->m_buffers[bufferIndex] == MAP_FAILED)
+      break;
+  return bufferIndex;
+}
+
+// device stays open; userptr buffers are kept when new frame fits, driver owned ones are remapped
+static int do_v4l2InputReformat(V4L2Input* _v4l2, size_t _width, size_t _height, uint32_t _format)
+{
+  int res;
+  const uint32_t memory = _v4l2->m_bufferFd[0] != -1 ? V4L2_MEMORY_DMABUF : _v4l2->m_memory;
+  const bool userPtr = _v4l2->m_memory == V4L2_MEMORY_USERPTR;
+  const size_t allocated = do_v4l2InputBuffersAllocated(_v4l2);
+
+  if (!userPtr)
+    do_v4l2InputFreeBuffers(_v4l2);
+  if ((res = do_v4l2InputReleaseBuffers(_v4l2)) != 0)
+    return res;
+
+  // drivers may reset selection and frame interval on S_FMT, so apply them the way open does
+  if (_v4l2->m_crop.width != 0 && _v4l2->m_crop.height != 0)
+  {
+    struct v4l2_rect crop = _v4l2->m_crop;
+    if ((res = do_v4l2InputSetCrop(_v4l2, &crop)) != 0)
+      return res;
+  }
+
+  if (_format == 0 && (res = do_v4l2InputSelectFormat(_v4l2, &_format)) != 0)
+    return res;
+  if ((res = do_v4l2InputSetFormat(_v4l2, _width, _height, _format)) != 0)
+    return res;
+
+  if (_v4l2->m_fps != 0)
+    do_v4l2InputSetFrameRate(_v4l2, _v4l2->m_fps);
+
+  if (userPtr)
+  {
+    size_t bufferCount;
+    if (   allocated > 0
+        && _v4l2->m_bufferSize[0] >= _v4l2->m_imageFormat.fmt.pix.sizeimage
+        && do_v4l2InputRequestBuffers(_v4l2, V4L2_MEMORY_USERPTR, &bufferCount) == 0
+        && bufferCount == allocated)
+      return 0;
+
+    do_v4l2InputFreeBuffers(_v4l2);
+    do_v4l2InputReleaseBuffers(_v4l2);
+  }
+
+  return do_v4l2InputAllocBuffers(_v4l2, memory);
+}
+
+static int do_v4l2InputQueueBuffer(V4L2Input* _v4l2, size_t _bufferIndex)
+{
+  int res;
+
+  if (_v4l2 == NULL)
+    return EINVAL;
+
+  struct v4l2_buffer buffer;
+  memset(&buffer, 0, sizeof(buffer));
+  buffer.index = _bufferIndex;
+  buffer.type = _v4l2->m_imageFormat.type;
+  buffer.memory = _v4l2->m_memory;
+  if (_v4l2->m_memory == V4L2_MEMORY_USERPTR)
+  {
+    buffer.m.userptr = (unsigned long)_v4l2->m_buffers[_bufferIndex];
+    buffer.length = _v4l2->m_bufferSize[_bufferIndex];
+  }
+
+  if (ioctl(_v4l2->m_fd, VIDIOC_QBUF, &buffer) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "v4l2_ioctl(VIDIOC_QBUF, index %zu) failed: %d\n", _bufferIndex, res);
+    return res;
+  }
+
+  return 0;
+}
+
 static int do_v4l2InputStart(V4L2Input* _v4l2)
 {
   int res = 0;
@@ -270,21 +701,14 @@ static int do_v4l2InputStart(V4L2Input* _v4l2)
   for (bufferIndex = 0; bufferIndex < sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers); ++bufferIndex)
     if (_v4l2->m_buffers[bufferIndex] != MAP_FAILED)
     {
-      struct v4l2_buffer buffer;
-      memset(&buffer, 0, sizeof(buffer));
-      buffer.index = bufferIndex;
-      buffer.type = _v4l2->m_imageFormat.type;
-      buffer.memory = V4L2_MEMORY_MMAP;
-
-      if (ioctl(_v4l2->m_fd, VIDIOC_QBUF, &buffer) != 0)
-      {
-        res = errno;
-        fprintf(stderr, "v4l2_ioctl(VIDIOC_QBUF, index %zu) failed: %d\n", bufferIndex, res);
+      if ((res = do_v4l2InputQueueBuffer(_v4l2, bufferIndex)) != 0)
         goto exit_stop;
-      }
     }
 
   _v4l2->m_frameCounter = 0;
+  _v4l2->m_frameSkipped = 0;
+  _v4l2->m_frameDropped = 0;
+  _v4l2->m_sequenceValid = false;
 
   enum v4l2_buf_type capture = _v4l2->m_imageFormat.type;
   if (ioctl(_v4l2->m_fd, VIDIOC_STREAMON, &capture) != 0)
@@ -328,47 +752,119 @@ static int do_v4l2InputStop(V4L2Input* _v4l2)
   return 0;
 }
 
-static int do_v4l2InputGetFrame(V4L2Input* _v4l2, const void** _framePtr, size_t* _frameSize, size_t* _frameIndex)
+// does not report EAGAIN, it is expected when draining non-blocking queue
+static int do_v4l2InputDequeueBuffer(V4L2Input* _v4l2, struct v4l2_buffer* _buffer)
+{
+  int res;
+
+  memset(_buffer, 0, sizeof(*_buffer));
+  _buffer->type = _v4l2->m_imageFormat.type;
+  _buffer->memory = _v4l2->m_memory;
+
+  if (ioctl(_v4l2->m_fd, VIDIOC_DQBUF, _buffer) != 0)
+  {
+    res = errno;
+    if (res != EAGAIN)
+      fprintf(stderr, "v4l2_ioctl(VIDIOC_DQBUF) failed: %d\n", res);
+    return res;
+  }
+
+  if (   _buffer->index >= sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers)
+      || _v4l2->m_buffers[_buffer->index] == MAP_FAILED)
+  {
+    res = ECHRNG;
+    fprintf(stderr, "v4l2_ioctl(VIDIOC_DQBUF) returned invalid buffer index %"PRIu32"\n", _buffer->index);
+    return res;
+  }
+
+  return 0;
+}
+
+static long long do_v4l2InputTimestampUs(const struct v4l2_buffer* _buffer)
+{
+  long long timestampUs = (long long)_buffer->timestamp.tv_sec*1000000 + _buffer->timestamp.tv_usec;
+
+#ifdef V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC
+  if ((_buffer->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+    return timestampUs;
+#endif
+
+  // older drivers stamp frames with wall clock, move it to monotonic clock
+  struct timespec monotonic;
+  struct timespec realtime;
+  clock_gettime(CLOCK_MONOTONIC, &monotonic);
+  clock_gettime(CLOCK_REALTIME, &realtime);
+
+  return timestampUs + ((long long)monotonic.tv_sec - realtime.tv_sec)*1000000
+                     + (monotonic.tv_nsec - realtime.tv_nsec)/1000;
+}
+
+static void do_v4l2InputTrackSequence(V4L2Input* _v4l2, const struct v4l2_buffer* _buffer)
+{
+  if (_v4l2->m_sequenceValid && _buffer->sequence != _v4l2->m_sequenceLast+1)
+  {
+    uint32_t gap = _buffer->sequence - _v4l2->m_sequenceLast - 1;
+    if (gap < 0x80000000u) // sequence restart is not a drop
+      _v4l2->m_frameDropped += gap;
+  }
+
+  _v4l2->m_sequenceLast = _buffer->sequence;
+  _v4l2->m_sequenceValid = true;
+}
+
+static int do_v4l2InputGetFrame(V4L2Input* _v4l2, const void** _framePtr, size_t* _frameSize, size_t* _frameIndex,
+                                FrameInfo* _frameInfo)
 {
   int res = 0;
 
   assert(sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers) == sizeof(_v4l2->m_bufferSize)/sizeof(*_v4l2->m_bufferSize));
-  if (_v4l2 == NULL || _framePtr == NULL || _frameSize == NULL || _frameIndex == NULL)
+  if (_v4l2 == NULL || _framePtr == NULL || _frameSize == NULL || _frameIndex == NULL || _frameInfo == NULL)
     return EINVAL;
 
   struct v4l2_buffer buffer;
-  memset(&buffer, 0, sizeof(buffer));
-  buffer.type = _v4l2->m_imageFormat.type;
-  buffer.memory = V4L2_MEMORY_MMAP;
-
-  if (ioctl(_v4l2->m_fd, VIDIOC_DQBUF, &buffer) != 0)
+  if ((res = do_v4l2InputDequeueBuffer(_v4l2, &buffer)) != 0)
   {
-    res = errno;
-    fprintf(stderr, "v4l2_ioctl(VIDIOC_DQBUF) failed: %d\n", res);
+    if (res == EAGAIN)
+      fprintf(stderr, "v4l2_ioctl(VIDIOC_DQBUF) failed: %d\n", res);
     return res;
   }
+  do_v4l2InputTrackSequence(_v4l2, &buffer);
 
-  if (   buffer.index >= sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers)
-      || _v4l2->m_buffers[buffer.index] == MAP_FAILED)
+  // drain queue, keep only the newest frame and give older ones back to driver
+  while (_v4l2->m_lowLatency)
   {
-    res = ECHRNG;
-    fprintf(stderr, "v4l2_ioctl(VIDIOC_DQBUF) returned invalid buffer index %"PRIu32"\n", buffer.index);
-    return res;
+    struct v4l2_buffer newerBuffer;
+    if ((res = do_v4l2InputDequeueBuffer(_v4l2, &newerBuffer)) != 0)
+      break; // no more ready frames, or error already reported
+    do_v4l2InputTrackSequence(_v4l2, &newerBuffer);
+
+    if ((res = do_v4l2InputQueueBuffer(_v4l2, buffer.index)) != 0)
+    {
+      do_v4l2InputQueueBuffer(_v4l2, newerBuffer.index);
+      return res;
+    }
+
+    ++_v4l2->m_frameSkipped;
+    buffer = newerBuffer;
   }
 
   ++_v4l2->m_frameCounter;
 
+  // userptr buffers are cached and filled by DMA; drop stale lines before ARM side (recorder, split rows, cpu detector) reads them
+  if (_v4l2->m_memory == V4L2_MEMORY_USERPTR && buffer.bytesused > 0)
+    Memory_cacheInv(_v4l2->m_buffers[buffer.index], buffer.bytesused);
+
   *_frameIndex = buffer.index;
   *_framePtr = _v4l2->m_buffers[buffer.index];
   *_frameSize = buffer.bytesused;
+  _frameInfo->m_sequence = buffer.sequence;
+  _frameInfo->m_timestampUs = do_v4l2InputTimestampUs(&buffer);
 
   return 0;
 }
 
 static int do_v4l2InputPutFrame(V4L2Input* _v4l2, size_t _frameIndex)
 {
-  int res = 0;
-
   assert(sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers) == sizeof(_v4l2->m_bufferSize)/sizeof(*_v4l2->m_bufferSize));
   if (_v4l2 == NULL)
     return EINVAL;
@@ -377,26 +873,17 @@ static int do_v4l2InputPutFrame(V4L2Input* _v4l2, size_t _frameIndex)
       || _v4l2->m_buffers[_frameIndex] == MAP_FAILED)
     return ECHRNG;
 
-  struct v4l2_buffer buffer;
-  memset(&buffer, 0, sizeof(buffer));
-  buffer.index = _frameIndex;
-  buffer.type = _v4l2->m_imageFormat.type;
-  buffer.memory = V4L2_MEMORY_MMAP;
-
-  if (ioctl(_v4l2->m_fd, VIDIOC_QBUF, &buffer) != 0)
-  {
-    res = errno;
-    fprintf(stderr, "v4l2_ioctl(VIDIOC_QBUF, index %zu) failed: %d\n", _frameIndex, res);
-    return res;
-  }
-
-  return 0;
+  return do_v4l2InputQueueBuffer(_v4l2, _frameIndex);
 }
 
 int do_v4l2InputReportFPS(V4L2Input* _v4l2, long long _ms)
 {
   long long frames = _v4l2->m_frameCounter;
+  long long skipped = _v4l2->m_frameSkipped;
+  long long dropped = _v4l2->m_frameDropped;
   _v4l2->m_frameCounter = 0;
+  _v4l2->m_frameSkipped = 0;
+  _v4l2->m_frameDropped = 0;
 
   if (_ms > 0)
   {
@@ -406,11 +893,34 @@ int do_v4l2InputReportFPS(V4L2Input* _v4l2, long long _ms)
   else
     fprintf(stderr, "V4L2 processed %llu frames\n", frames);
 
+  if (_v4l2->m_lowLatency)
+    fprintf(stderr, "V4L2 skipped %llu stale frames\n", skipped);
+  if (dropped > 0)
+    fprintf(stderr, "V4L2 dropped %llu frames\n", dropped);
+
   return 0;
 }
 
 
 
+bool v4l2InputFormatByName(const char* _name, uint32_t* _format)
+{
+  if (_name == NULL || _format == NULL)
+    return false;
+
+  if      (!strcasecmp(_name, "auto"))		*_format = 0;
+  else if (!strcasecmp(_name, "rgb888"))	*_format = V4L2_PIX_FMT_RGB24;
+  else if (!strcasecmp(_name, "rgb565"))	*_format = V4L2_PIX_FMT_RGB565;
+  else if (!strcasecmp(_name, "rgb565x"))	*_format = V4L2_PIX_FMT_RGB565X;
+  else if (!strcasecmp(_name, "yuv444"))	*_format = V4L2_PIX_FMT_YUV32;
+  else if (!strcasecmp(_name, "yuv422"))	*_format = V4L2_PIX_FMT_YUYV;
+  else if (!strcasecmp(_name, "yuv422p"))	*_format = V4L2_PIX_FMT_YUV422P;
+  else
+    return false;
+
+  return true;
+}
+
 int v4l2InputInit(bool _verbose)
 {
   if (_verbose)
@@ -432,18 +942,56 @@ int v4l2InputOpen(V4L2Input* _v4l2, const V4L2Config* _config)
   if (_v4l2->m_fd != -1)
     return EALREADY;
 
+  if (_config->m_replayPath != NULL)
+    return v4l2ReplayOpen(_v4l2, _config);
+
   ret = do_v4l2InputOpen(_v4l2, _config->m_path);
   if (ret != 0)
     goto exit;
 
-  ret = do_v4l2InputSetFormat(_v4l2, _config->m_width, _config->m_height, _config->m_format);
+  _v4l2->m_crop = _config->m_crop;
+  _v4l2->m_fps  = _config->m_fps;
+
+  size_t width  = _config->m_width;
+  size_t height = _config->m_height;
+  if (_config->m_crop.width != 0 && _config->m_crop.height != 0)
+  {
+    // sensor sends only the window, capture it unscaled
+    struct v4l2_rect crop = _config->m_crop;
+    ret = do_v4l2InputSetCrop(_v4l2, &crop);
+    if (ret != 0)
+      goto exit_close;
+
+    fprintf(stderr, "V4L2 crop %"PRId32",%"PRId32" %"PRIu32"x%"PRIu32"\n", crop.left, crop.top, crop.width, crop.height);
+    width  = crop.width;
+    height = crop.height;
+  }
+
+  uint32_t format = _config->m_format;
+  if (format == 0 && (ret = do_v4l2InputSelectFormat(_v4l2, &format)) != 0)
+    goto exit_close;
+
+  ret = do_v4l2InputSetFormat(_v4l2, width, height, format);
   if (ret != 0)
     goto exit_close;
 
-  ret = do_v4l2InputMmapBuffers(_v4l2);
+  // rate is a hint, keep going at whatever sensor delivers
+  if (_config->m_fps != 0)
+    do_v4l2InputSetFrameRate(_v4l2, _config->m_fps);
+
+  _v4l2->m_bufferCount = _config->m_buffers;
+  if (_v4l2->m_bufferCount < 1)
+    _v4l2->m_bufferCount = 1;
+  else if (_v4l2->m_bufferCount > V4L2_INPUT_MAX_BUFFERS)
+    _v4l2->m_bufferCount = V4L2_INPUT_MAX_BUFFERS;
+  _v4l2->m_lowLatency = _config->m_lowLatency;
+
+  ret = do_v4l2InputAllocBuffers(_v4l2, _config->m_memory);
   if (ret != 0)
     goto exit_unset_format;
 
+  fprintf(stderr, "V4L2 capture path: %s\n", do_v4l2InputPathName(_v4l2));
+
   return 0;
 
 
@@ -462,7 +1010,10 @@ int v4l2InputClose(V4L2Input* _v4l2)
   if (_v4l2->m_fd == -1)
     return EALREADY;
 
-  do_v4l2InputMunmapBuffers(_v4l2);
+  if (_v4l2->m_replay)
+    return v4l2ReplayClose(_v4l2);
+
+  do_v4l2InputFreeBuffers(_v4l2);
   do_v4l2InputUnsetFormat(_v4l2);
   do_v4l2InputClose(_v4l2);
 
@@ -476,6 +1027,9 @@ int v4l2InputStart(V4L2Input* _v4l2)
   if (_v4l2->m_fd == -1)
     return ENOTCONN;
 
+  if (_v4l2->m_replay)
+    return v4l2ReplayStart(_v4l2);
+
   return do_v4l2InputStart(_v4l2);
 }
 
@@ -486,17 +1040,24 @@ int v4l2InputStop(V4L2Input* _v4l2)
   if (_v4l2->m_fd == -1)
     return ENOTCONN;
 
+  if (_v4l2->m_replay)
+    return v4l2ReplayStop(_v4l2);
+
   return do_v4l2InputStop(_v4l2);
 }
 
-int v4l2InputGetFrame(V4L2Input* _v4l2, const void** _framePtr, size_t* _frameSize, size_t* _frameIndex)
+int v4l2InputGetFrame(V4L2Input* _v4l2, const void** _framePtr, size_t* _frameSize, size_t* _frameIndex,
+                      FrameInfo* _frameInfo)
 {
   if (_v4l2 == NULL)
     return EINVAL;
   if (_v4l2->m_fd == -1)
     return ENOTCONN;
 
-  return do_v4l2InputGetFrame(_v4l2, _framePtr, _frameSize, _frameIndex);
+  if (_v4l2->m_replay)
+    return v4l2ReplayGetFrame(_v4l2, _framePtr, _frameSize, _frameIndex, _frameInfo);
+
+  return do_v4l2InputGetFrame(_v4l2, _framePtr, _frameSize, _frameIndex, _frameInfo);
 }
 
 int v4l2InputPutFrame(V4L2Input* _v4l2, size_t _frameIndex)
@@ -506,6 +1067,9 @@ int v4l2InputPutFrame(V4L2Input* _v4l2, size_t _frameIndex)
   if (_v4l2->m_fd == -1)
     return ENOTCONN;
 
+  if (_v4l2->m_replay)
+    return v4l2ReplayPutFrame(_v4l2, _frameIndex);
+
   return do_v4l2InputPutFrame(_v4l2, _frameIndex);
 }
 
@@ -519,6 +1083,37 @@ int v4l2InputGetFormat(V4L2Input* _v4l2, ImageDescription* _imageDesc)
   return do_v4l2InputGetFormat(_v4l2, _imageDesc);
 }
 
+int v4l2InputSetFormat(V4L2Input* _v4l2, size_t _width, size_t _height, uint32_t _format)
+{
+  if (_v4l2 == NULL)
+    return EINVAL;
+  if (_v4l2->m_fd == -1)
+    return ENOTCONN;
+
+  if (_v4l2->m_replay)
+    return ENOTSUP; // recorded frames have fixed format
+
+  return do_v4l2InputReformat(_v4l2, _width, _height, _format);
+}
+
+bool v4l2InputFramesContiguous(const V4L2Input* _v4l2)
+{
+  if (_v4l2 == NULL || _v4l2->m_fd == -1)
+    return false;
+
+  return _v4l2->m_memory == V4L2_MEMORY_USERPTR;
+}
+
+int v4l2InputFrameFd(const V4L2Input* _v4l2, size_t _frameIndex)
+{
+  if (_v4l2 == NULL || _v4l2->m_fd == -1)
+    return -1;
+  if (_frameIndex >= sizeof(_v4l2->m_bufferFd)/sizeof(*_v4l2->m_bufferFd))
+    return -1;
+
+  return _v4l2->m_bufferFd[_frameIndex];
+}
+
 int v4l2InputReportFPS(V4L2Input* _v4l2, long long _ms)
 {
   if (_v4l2 == NULL)
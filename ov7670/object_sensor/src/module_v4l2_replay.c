@@ -0,0 +1,391 @@
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include <linux/videodev2.h>
+
+#include "internal/module_v4l2_replay.h"
+
+
+
+static int do_v4l2ReplayOpenFile(V4L2Input* _v4l2, const char* _path)
+{
+  int res;
+
+  if (_v4l2 == NULL || _path == NULL)
+    return EINVAL;
+
+  _v4l2->m_replayFileFd = open(_path, O_RDONLY, 0);
+  if (_v4l2->m_replayFileFd < 0)
+  {
+    res = errno;
+    fprintf(stderr, "open(%s) failed: %d\n", _path, res);
+    _v4l2->m_replayFileFd = -1;
+    return res;
+  }
+
+  struct stat fileStat;
+  if (fstat(_v4l2->m_replayFileFd, &fileStat) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "fstat(%s) failed: %d\n", _path, res);
+    goto exit_close;
+  }
+
+  _v4l2->m_replaySize = fileStat.st_size;
+  if (_v4l2->m_replaySize < sizeof(V4L2ReplayFileHeader))
+  {
+    res = EILSEQ;
+    fprintf(stderr, "Replay file %s is too short\n", _path);
+    goto exit_close;
+  }
+
+  _v4l2->m_replayPtr = mmap(NULL, _v4l2->m_replaySize, PROT_READ, MAP_SHARED, _v4l2->m_replayFileFd, 0);
+  if (_v4l2->m_replayPtr == MAP_FAILED)
+  {
+    res = errno;
+    fprintf(stderr, "mmap(%s, %zu) failed: %d\n", _path, _v4l2->m_replaySize, res);
+    goto exit_close;
+  }
+
+  return 0;
+
+
+ exit_close:
+  close(_v4l2->m_replayFileFd);
+  _v4l2->m_replayFileFd = -1;
+  _v4l2->m_replayPtr = MAP_FAILED;
+  _v4l2->m_replaySize = 0;
+  return res;
+}
+
+static int do_v4l2ReplayCloseFile(V4L2Input* _v4l2)
+{
+  int res = 0;
+
+  if (_v4l2 == NULL)
+    return EINVAL;
+
+  if (   _v4l2->m_replayPtr != MAP_FAILED
+      && munmap((void*)_v4l2->m_replayPtr, _v4l2->m_replaySize) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "munmap(%p, %zu) failed: %d\n", _v4l2->m_replayPtr, _v4l2->m_replaySize, res);
+  }
+  _v4l2->m_replayPtr = MAP_FAILED;
+  _v4l2->m_replaySize = 0;
+
+  if (_v4l2->m_replayFileFd != -1)
+    close(_v4l2->m_replayFileFd);
+  _v4l2->m_replayFileFd = -1;
+
+  return res;
+}
+
+static const V4L2ReplayFrameHeader* do_v4l2ReplayFrameHeader(const V4L2Input* _v4l2, size_t _frameIndex)
+{
+  const size_t frameHeaderOffset = _v4l2->m_replayFrameOffset - sizeof(V4L2ReplayFrameHeader);
+  return (const V4L2ReplayFrameHeader*)(_v4l2->m_replayPtr + frameHeaderOffset + _frameIndex*_v4l2->m_replayFrameStride);
+}
+
+// slots of a ring recording that were never written are not frames
+static bool do_v4l2ReplayFrameWritten(const V4L2Input* _v4l2, size_t _frameIndex)
+{
+  return !_v4l2->m_replayFrameHeaders || do_v4l2ReplayFrameHeader(_v4l2, _frameIndex)->m_frameSize != 0;
+}
+
+static size_t do_v4l2ReplayNextFrame(const V4L2Input* _v4l2, size_t _frameIndex)
+{
+  size_t step;
+  for (step = 0; step < _v4l2->m_replayFrameCount; ++step)
+  {
+    if (++_frameIndex >= _v4l2->m_replayFrameCount)
+      _frameIndex = 0;
+    if (do_v4l2ReplayFrameWritten(_v4l2, _frameIndex))
+      break;
+  }
+
+  return _frameIndex;
+}
+
+static int do_v4l2ReplaySetFormat(V4L2Input* _v4l2)
+{
+  V4L2ReplayFileHeader header;
+  memcpy(&header, _v4l2->m_replayPtr, sizeof(header));
+
+  if (memcmp(header.m_magic, V4L2_REPLAY_MAGIC, sizeof(V4L2_REPLAY_MAGIC)) != 0)
+  {
+    fprintf(stderr, "Replay file has no %s signature\n", V4L2_REPLAY_MAGIC);
+    return EILSEQ;
+  }
+
+  // fields checked one by one against stride, their sum may wrap
+  if (   header.m_frameStride == 0
+      || header.m_frameOffset > header.m_frameStride
+      || header.m_frameSize > header.m_frameStride - header.m_frameOffset
+      || header.m_frameSize < (uint64_t)header.m_lineLength*header.m_height
+      || header.m_headerSize < sizeof(header)
+      || header.m_headerSize > _v4l2->m_replaySize)
+  {
+    fprintf(stderr, "Replay file header is inconsistent\n");
+    return EILSEQ;
+  }
+
+  _v4l2->m_replayFrameOffset = header.m_headerSize + header.m_frameOffset;
+  _v4l2->m_replayFrameStride = header.m_frameStride;
+  _v4l2->m_replayFrameCount  = (_v4l2->m_replaySize - header.m_headerSize) / header.m_frameStride;
+  _v4l2->m_replayFrameIndex  = 0;
+  if (_v4l2->m_replayFrameCount == 0)
+  {
+    fprintf(stderr, "Replay file contains no frames\n");
+    return ENODATA;
+  }
+
+  // ring recordings wrap, start from the oldest frame to keep capture order
+  _v4l2->m_replayFrameFirst   = 0;
+  _v4l2->m_replayFrameHeaders = header.m_frameOffset >= sizeof(V4L2ReplayFrameHeader);
+  if (_v4l2->m_replayFrameHeaders)
+  {
+    size_t frameIndex;
+    uint32_t sequenceFirst = UINT32_MAX;
+    for (frameIndex = 0; frameIndex < _v4l2->m_replayFrameCount; ++frameIndex)
+    {
+      const V4L2ReplayFrameHeader* frameHeader = do_v4l2ReplayFrameHeader(_v4l2, frameIndex);
+      if (frameHeader->m_frameSize != 0 && frameHeader->m_sequence <= sequenceFirst)
+      {
+        sequenceFirst = frameHeader->m_sequence;
+        _v4l2->m_replayFrameFirst = frameIndex;
+      }
+    }
+
+    if (!do_v4l2ReplayFrameWritten(_v4l2, _v4l2->m_replayFrameFirst))
+    {
+      fprintf(stderr, "Replay file contains no recorded frames\n");
+      return ENODATA;
+    }
+  }
+
+  // replayed frames are described exactly as captured ones
+  memset(&_v4l2->m_imageFormat, 0, sizeof(_v4l2->m_imageFormat));
+  _v4l2->m_imageFormat.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  _v4l2->m_imageFormat.fmt.pix.width        = header.m_width;
+  _v4l2->m_imageFormat.fmt.pix.height       = header.m_height;
+  _v4l2->m_imageFormat.fmt.pix.pixelformat  = header.m_format;
+  _v4l2->m_imageFormat.fmt.pix.bytesperline = header.m_lineLength;
+  _v4l2->m_imageFormat.fmt.pix.sizeimage    = header.m_frameSize;
+  _v4l2->m_imageFormat.fmt.pix.field        = V4L2_FIELD_NONE;
+
+  fprintf(stderr, "Replaying %zu frames %c%c%c%c@%"PRIu32"x%"PRIu32"[%"PRIu32"]\n",
+          _v4l2->m_replayFrameCount,
+          (header.m_format    )&0xff, (header.m_format>> 8)&0xff,
+          (header.m_format>>16)&0xff, (header.m_format>>24)&0xff,
+          header.m_width, header.m_height, header.m_lineLength);
+
+  return 0;
+}
+
+// m_fd is what video thread selects on: periodic timer, or always readable event when not paced
+static int do_v4l2ReplayOpenPacer(V4L2Input* _v4l2)
+{
+  int res;
+
+  if (_v4l2->m_replayFps > 0)
+    _v4l2->m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+  else
+    _v4l2->m_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+
+  if (_v4l2->m_fd < 0)
+  {
+    res = errno;
+    fprintf(stderr, "%s() failed: %d\n", _v4l2->m_replayFps > 0 ? "timerfd_create" : "eventfd", res);
+    _v4l2->m_fd = -1;
+    return res;
+  }
+
+  return 0;
+}
+
+static int do_v4l2ReplayArmPacer(V4L2Input* _v4l2, bool _arm)
+{
+  int res;
+
+  if (_v4l2->m_replayFps == 0)
+  {
+    // counter is never consumed while armed, so event stays readable
+    uint64_t value = 1;
+    ssize_t ioRes = _arm ? write(_v4l2->m_fd, &value, sizeof(value))
+                         : read(_v4l2->m_fd, &value, sizeof(value));
+    if (ioRes != sizeof(value) && !(!_arm && errno == EAGAIN))
+    {
+      res = errno;
+      fprintf(stderr, "%s(eventfd) failed: %d\n", _arm ? "write" : "read", res);
+      return res;
+    }
+
+    return 0;
+  }
+
+  struct itimerspec timerSpec;
+  memset(&timerSpec, 0, sizeof(timerSpec));
+  if (_arm)
+  {
+    const long long periodNs = 1000000000LL / _v4l2->m_replayFps;
+    timerSpec.it_interval.tv_sec  = periodNs / 1000000000LL;
+    timerSpec.it_interval.tv_nsec = periodNs % 1000000000LL;
+    timerSpec.it_value = timerSpec.it_interval;
+  }
+
+  if (timerfd_settime(_v4l2->m_fd, 0, &timerSpec, NULL) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "timerfd_settime() failed: %d\n", res);
+    return res;
+  }
+
+  return 0;
+}
+
+
+
+
+int v4l2ReplayOpen(V4L2Input* _v4l2, const V4L2Config* _config)
+{
+  int res;
+
+  if (_v4l2 == NULL || _config == NULL || _config->m_replayPath == NULL)
+    return EINVAL;
+
+  size_t bufferIndex;
+  for (bufferIndex = 0; bufferIndex < sizeof(_v4l2->m_buffers)/sizeof(*_v4l2->m_buffers); ++bufferIndex)
+  {
+    _v4l2->m_buffers[bufferIndex] = MAP_FAILED;
+    _v4l2->m_bufferSize[bufferIndex] = 0;
+    _v4l2->m_bufferFd[bufferIndex] = -1;
+  }
+  _v4l2->m_memory = 0;
+  _v4l2->m_lowLatency = false;
+  _v4l2->m_replay = true;
+  _v4l2->m_replayFps = _config->m_replayFps;
+
+  if ((res = do_v4l2ReplayOpenFile(_v4l2, _config->m_replayPath)) != 0)
+    goto exit;
+
+  if ((res = do_v4l2ReplaySetFormat(_v4l2)) != 0)
+    goto exit_close_file;
+
+  if ((res = do_v4l2ReplayOpenPacer(_v4l2)) != 0)
+    goto exit_close_file;
+
+  fprintf(stderr, "V4L2 capture path: replay of %s at %zu fps\n", _config->m_replayPath, _v4l2->m_replayFps);
+
+  return 0;
+
+
+ exit_close_file:
+  do_v4l2ReplayCloseFile(_v4l2);
+ exit:
+  _v4l2->m_replay = false;
+  return res;
+}
+
+int v4l2ReplayClose(V4L2Input* _v4l2)
+{
+  if (_v4l2 == NULL)
+    return EINVAL;
+
+  close(_v4l2->m_fd);
+  _v4l2->m_fd = -1;
+  memset(&_v4l2->m_imageFormat, 0, sizeof(_v4l2->m_imageFormat));
+  do_v4l2ReplayCloseFile(_v4l2);
+  _v4l2->m_replay = false;
+
+  return 0;
+}
+
+int v4l2ReplayStart(V4L2Input* _v4l2)
+{
+  if (_v4l2 == NULL)
+    return EINVAL;
+
+  _v4l2->m_frameCounter = 0;
+  _v4l2->m_frameSkipped = 0;
+  _v4l2->m_frameDropped = 0;
+  _v4l2->m_replayFrameIndex = _v4l2->m_replayFrameFirst;
+  _v4l2->m_replaySequence = 0;
+
+  return do_v4l2ReplayArmPacer(_v4l2, true);
+}
+
+int v4l2ReplayStop(V4L2Input* _v4l2)
+{
+  if (_v4l2 == NULL)
+    return EINVAL;
+
+  _v4l2->m_frameCounter = 0;
+
+  return do_v4l2ReplayArmPacer(_v4l2, false);
+}
+
+int v4l2ReplayGetFrame(V4L2Input* _v4l2, const void** _framePtr, size_t* _frameSize, size_t* _frameIndex,
+                       FrameInfo* _frameInfo)
+{
+  int res;
+
+  if (_v4l2 == NULL || _framePtr == NULL || _frameSize == NULL || _frameIndex == NULL || _frameInfo == NULL)
+    return EINVAL;
+
+  if (_v4l2->m_replayFps > 0)
+  {
+    uint64_t expirations;
+    if (read(_v4l2->m_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+    {
+      res = errno;
+      if (res != EAGAIN)
+        fprintf(stderr, "read(timerfd) failed: %d\n", res);
+      return res;
+    }
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  const size_t frameIndex = _v4l2->m_replayFrameIndex;
+  *_frameIndex = frameIndex;
+  *_framePtr   = _v4l2->m_replayPtr + _v4l2->m_replayFrameOffset + frameIndex*_v4l2->m_replayFrameStride;
+  *_frameSize  = _v4l2->m_imageFormat.fmt.pix.sizeimage;
+  _frameInfo->m_sequence    = _v4l2->m_replaySequence++; // m_frameCounter is reset by fps report
+  _frameInfo->m_timestampUs = (long long)now.tv_sec*1000000 + now.tv_nsec/1000;
+
+  // report recorded sequence so results can be matched to footage; timestamp stays local for latency stats
+  if (_v4l2->m_replayFrameHeaders)
+    _frameInfo->m_sequence = do_v4l2ReplayFrameHeader(_v4l2, frameIndex)->m_sequence;
+
+  // loop over the file to keep pipeline busy for as long as needed
+  _v4l2->m_replayFrameIndex = do_v4l2ReplayNextFrame(_v4l2, frameIndex);
+  ++_v4l2->m_frameCounter;
+
+  return 0;
+}
+
+int v4l2ReplayPutFrame(V4L2Input* _v4l2, size_t _frameIndex)
+{
+  if (_v4l2 == NULL)
+    return EINVAL;
+
+  if (_frameIndex >= _v4l2->m_replayFrameCount)
+    return ECHRNG;
+
+  return 0;
+}
+
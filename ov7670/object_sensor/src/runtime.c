@@ -4,8 +4,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <inttypes.h>
 #include <errno.h>
 #include <getopt.h>
+#include <sys/mman.h>
 
 #include "internal/runtime.h"
 #include "internal/thread_input.h"
@@ -16,10 +18,15 @@
 
 static const RuntimeConfig s_runtimeConfig = {
   .m_verbose = false,
-  .m_codecEngineConfig = { "dsp_server.xe674", "vidtranscode_cv" },
-  .m_v4l2Config        = { "/dev/video0", 640, 480, V4L2_PIX_FMT_YUV422P },
-  .m_fbConfig          = { "/dev/fb0" },
-  .m_rcConfig          = { "/run/object-sensor.in.fifo", "/run/object-sensor.out.fifo", true  }
+  .m_codecEngineConfig = { "dsp_server.xe674", "vidtranscode_cv", 1, CODEC_ENGINE_CACHE_RANGE, CODEC_ENGINE_CACHE_RANGE, false, 0, 0, false, NULL },
+  .m_v4l2Config        = { { "/dev/video0", 640, 480, 0, 0, 3, false, NULL, 0 } },
+  .m_cameras           = 1,
+  .m_cameraSchedule    = RUNTIME_CAMERA_SCHEDULE_ROUND_ROBIN,
+  .m_previewCamera     = 0,
+  .m_latencyBoundMs    = 0,
+  .m_fbConfig          = { "/dev/fb0", true, true, false, false, true, false, NULL, 3, 320, 240 },
+  .m_rcConfig          = { "/run/object-sensor.in.fifo", "/run/object-sensor.out.fifo", true  },
+  .m_recorderConfig    = { NULL, 300, 4, 0 }
 };
 
 
@@ -33,12 +40,20 @@ void runtimeReset(Runtime* _runtime)
 
   memset(&_runtime->m_modules.m_codecEngine,  0, sizeof(_runtime->m_modules.m_codecEngine));
   memset(&_runtime->m_modules.m_v4l2Input,    0, sizeof(_runtime->m_modules.m_v4l2Input));
-  _runtime->m_modules.m_v4l2Input.m_fd = -1;
+  size_t camera;
+  for (camera = 0; camera < RUNTIME_MAX_CAMERAS; ++camera)
+    _runtime->m_modules.m_v4l2Input[camera].m_fd = -1;
   memset(&_runtime->m_modules.m_fbOutput,     0, sizeof(_runtime->m_modules.m_fbOutput));
   _runtime->m_modules.m_fbOutput.m_fd = -1;
+  _runtime->m_modules.m_fbOutput.m_fbPtr = MAP_FAILED;
   memset(&_runtime->m_modules.m_rcInput,      0, sizeof(_runtime->m_modules.m_rcInput));
   _runtime->m_modules.m_rcInput.m_fifoInputFd  = -1;
   _runtime->m_modules.m_rcInput.m_fifoOutputFd = -1;
+  size_t algorithm;
+  for (algorithm = 0; algorithm < MAX_ALGORITHMS_N; ++algorithm)
+    _runtime->m_modules.m_rcInput.m_fifoAlgorithmOutputFd[algorithm] = -1;
+  memset(&_runtime->m_modules.m_recorder,     0, sizeof(_runtime->m_modules.m_recorder));
+  _runtime->m_modules.m_recorder.m_fd = -1;
 
   memset(&_runtime->m_threads, 0, sizeof(_runtime->m_threads));
   _runtime->m_threads.m_terminate = true;
@@ -46,6 +61,8 @@ void runtimeReset(Runtime* _runtime)
   pthread_mutex_init(&_runtime->m_state.m_mutex, NULL);
   memset(&_runtime->m_state.m_targetDetectParams,  0, sizeof(_runtime->m_state.m_targetDetectParams));
   memset(&_runtime->m_state.m_targetDetectCommand, 0, sizeof(_runtime->m_state.m_targetDetectCommand));
+  memset(&_runtime->m_state.m_videoFormatCommand,  0, sizeof(_runtime->m_state.m_videoFormatCommand));
+  _runtime->m_state.m_timingCommand = 0;
 }
 
 
@@ -56,6 +73,7 @@ bool runtimeParseArgs(Runtime* _runtime, int _argc, char* const _argv[])
   int opt;
   int longopt;
   RuntimeConfig* cfg;
+  V4L2Config* v4l2Cfg;
 
   static const char* s_optstring = "vh";
   static const struct option s_longopts[] =
@@ -71,6 +89,43 @@ bool runtimeParseArgs(Runtime* _runtime, int _argc, char* const _argv[])
     { "rc-fifo-out",		1,	NULL,	0   },
     { "video-out",		1,	NULL,	0   },
     { "objects-n",		1,	NULL,	0   }, //10
+    { "v4l2-memory",		1,	NULL,	0   },
+    { "fb-direct",		1,	NULL,	0   },
+    { "v4l2-buffers",		1,	NULL,	0   },
+    { "v4l2-low-latency",	1,	NULL,	0   },
+    { "rc-timestamp",		1,	NULL,	0   },
+    { "v4l2-replay",		1,	NULL,	0   },
+    { "v4l2-replay-fps",	1,	NULL,	0   },
+    { "rec-path",		1,	NULL,	0   }, //18
+    { "rec-frames",		1,	NULL,	0   },
+    { "rec-queue",		1,	NULL,	0   },
+    { "v4l2-crop",		1,	NULL,	0   }, //21
+    { "v4l2-fps",		1,	NULL,	0   },
+    { "v4l2-camera",		1,	NULL,	0   }, //23
+    { "camera-schedule",	1,	NULL,	0   },
+    { "fb-camera",		1,	NULL,	0   },
+    { "ce-pipeline",		1,	NULL,	0   }, //26
+    { "ce-cache-src",		1,	NULL,	0   },
+    { "ce-cache-dst",		1,	NULL,	0   },
+    { "ce-cache-bench",		1,	NULL,	0   },
+    { "ce-split",		1,	NULL,	0   }, //30
+    { "ce-pool",		1,	NULL,	0   },
+    { "ce-timing",		1,	NULL,	0   }, //32
+    { "ce-timing-file",		1,	NULL,	0   },
+    { "ce-algorithm",		1,	NULL,	0   }, //34
+    { "ce-algorithm-fifo",	1,	NULL,	0   },
+    { "latency-bound",		1,	NULL,	0   }, //36
+    { "fb-page-flip",		1,	NULL,	0   },
+    { "fb-vsync",		1,	NULL,	0   },
+    { "fb-overlay",		1,	NULL,	0   }, //39
+    { "fb-sync",		1,	NULL,	0   },
+    { "fb-blit-bench",		1,	NULL,	0   },
+    { "fb-shm",			1,	NULL,	0   }, //42
+    { "fb-shm-slots",		1,	NULL,	0   },
+    { "fb-shm-width",		1,	NULL,	0   },
+    { "fb-shm-height",		1,	NULL,	0   },
+    { "ce-cpu-fallback",	1,	NULL,	0   }, //46
+    { "rec-camera",		1,	NULL,	0   },
     { "verbose",		0,	NULL,	'v' },
     { "help",			0,	NULL,	'h' },
     { NULL,			0,	NULL,	0   }
@@ -80,6 +135,7 @@ bool runtimeParseArgs(Runtime* _runtime, int _argc, char* const _argv[])
     return false;
 
   cfg = &_runtime->m_config;
+  v4l2Cfg = &cfg->m_v4l2Config[0]; // v4l2 options apply to camera selected by last --v4l2-camera
 
 
   while ((opt = getopt_long(_argc, _argv, s_optstring, s_longopts, &longopt)) != -1)
@@ -94,20 +150,14 @@ bool runtimeParseArgs(Runtime* _runtime, int _argc, char* const _argv[])
           case 0: cfg->m_codecEngineConfig.m_serverPath = optarg;	break;
           case 1: cfg->m_codecEngineConfig.m_codecName = optarg;	break;
 
-          case 2: cfg->m_v4l2Config.m_path = optarg;			break;
-          case 3: cfg->m_v4l2Config.m_width = atoi(optarg);		break;
-          case 4: cfg->m_v4l2Config.m_height = atoi(optarg);		break;
+          case 2: v4l2Cfg->m_path = optarg;			break;
+          case 3: v4l2Cfg->m_width = atoi(optarg);		break;
+          case 4: v4l2Cfg->m_height = atoi(optarg);		break;
           case 5:
-            if      (!strcasecmp(optarg, "rgb888"))	cfg->m_v4l2Config.m_format = V4L2_PIX_FMT_RGB24;
-            else if (!strcasecmp(optarg, "rgb565"))	cfg->m_v4l2Config.m_format = V4L2_PIX_FMT_RGB565;
-            else if (!strcasecmp(optarg, "rgb565x"))	cfg->m_v4l2Config.m_format = V4L2_PIX_FMT_RGB565X;
-            else if (!strcasecmp(optarg, "yuv444"))	cfg->m_v4l2Config.m_format = V4L2_PIX_FMT_YUV32;
-            else if (!strcasecmp(optarg, "yuv422"))	cfg->m_v4l2Config.m_format = V4L2_PIX_FMT_YUYV;
-            else if (!strcasecmp(optarg, "yuv422p"))	cfg->m_v4l2Config.m_format = V4L2_PIX_FMT_YUV422P;
-            else
+            if (!v4l2InputFormatByName(optarg, &v4l2Cfg->m_format))
             {
               fprintf(stderr, "Unknown v4l2 format '%s'\n"
-                              "Known formats: rgb888, rgb565, rgb565x, yuv444, yuv422, yuv422p\n",
+                              "Known formats: auto, rgb888, rgb565, rgb565x, yuv444, yuv422, yuv422p\n",
                       optarg);
               return false;
             }
@@ -118,6 +168,130 @@ bool runtimeParseArgs(Runtime* _runtime, int _argc, char* const _argv[])
           case 8: cfg->m_rcConfig.m_fifoOutput = optarg;					break;
           case 9: cfg->m_rcConfig.m_videoOutEnable = atoi(optarg); break;
           case 10: cfg->m_rcConfig.m_objectsN = atoi(optarg); break;
+          case 11:
+            if      (!strcasecmp(optarg, "auto"))	v4l2Cfg->m_memory = 0;
+            else if (!strcasecmp(optarg, "userptr"))	v4l2Cfg->m_memory = V4L2_MEMORY_USERPTR;
+            else if (!strcasecmp(optarg, "mmap"))	v4l2Cfg->m_memory = V4L2_MEMORY_MMAP;
+            else if (!strcasecmp(optarg, "dmabuf"))	v4l2Cfg->m_memory = V4L2_MEMORY_DMABUF;
+            else
+            {
+              fprintf(stderr, "Unknown v4l2 memory '%s'\n"
+                              "Known memory types: auto, dmabuf, userptr, mmap\n",
+                      optarg);
+              return false;
+            }
+            break;
+          case 12: cfg->m_fbConfig.m_direct = atoi(optarg); break;
+          case 13: v4l2Cfg->m_buffers = atoi(optarg); break;
+          case 14: v4l2Cfg->m_lowLatency = atoi(optarg); break;
+          case 15: cfg->m_rcConfig.m_reportTimestamp = atoi(optarg); break;
+          case 16: v4l2Cfg->m_replayPath = optarg; break;
+          case 17: v4l2Cfg->m_replayFps = atoi(optarg); break;
+          case 18: cfg->m_recorderConfig.m_path = optarg; break;
+          case 19: cfg->m_recorderConfig.m_fileFrames = atoi(optarg); break;
+          case 20: cfg->m_recorderConfig.m_queueFrames = atoi(optarg); break;
+          case 21:
+          {
+            struct v4l2_rect* crop = &v4l2Cfg->m_crop;
+            if (sscanf(optarg, "%"SCNd32",%"SCNd32",%"SCNu32",%"SCNu32, &crop->left, &crop->top, &crop->width, &crop->height) != 4)
+            {
+              fprintf(stderr, "Invalid v4l2 crop '%s', expected x,y,w,h\n", optarg);
+              return false;
+            }
+            break;
+          }
+          case 22: v4l2Cfg->m_fps = atoi(optarg); break;
+          case 23:
+          {
+            static const char* s_cameraPaths[RUNTIME_MAX_CAMERAS] = { "/dev/video0", "/dev/video1", "/dev/video2", "/dev/video3" };
+            const int camera = atoi(optarg);
+            if (camera < 0 || camera >= RUNTIME_MAX_CAMERAS)
+            {
+              fprintf(stderr, "Invalid camera %s, expected 0-%d\n", optarg, RUNTIME_MAX_CAMERAS-1);
+              return false;
+            }
+            // new cameras inherit camera 0 settings given so far
+            for (; cfg->m_cameras <= (size_t)camera; ++cfg->m_cameras)
+            {
+              cfg->m_v4l2Config[cfg->m_cameras] = cfg->m_v4l2Config[0];
+              cfg->m_v4l2Config[cfg->m_cameras].m_path = s_cameraPaths[cfg->m_cameras];
+              cfg->m_v4l2Config[cfg->m_cameras].m_replayPath = NULL;
+            }
+            v4l2Cfg = &cfg->m_v4l2Config[camera];
+            break;
+          }
+          case 24:
+            if      (!strcasecmp(optarg, "round-robin"))	cfg->m_cameraSchedule = RUNTIME_CAMERA_SCHEDULE_ROUND_ROBIN;
+            else if (!strcasecmp(optarg, "priority"))	cfg->m_cameraSchedule = RUNTIME_CAMERA_SCHEDULE_PRIORITY;
+            else
+            {
+              fprintf(stderr, "Unknown camera schedule '%s'\n"
+                              "Known schedules: round-robin, priority\n",
+                      optarg);
+              return false;
+            }
+            break;
+          case 25: cfg->m_previewCamera = atoi(optarg); break;
+          case 26: cfg->m_codecEngineConfig.m_pipelineDepth = atoi(optarg); break;
+          case 27:
+          case 28:
+          {
+            CodecEngineCacheMode* mode = longopt == 27 ? &cfg->m_codecEngineConfig.m_srcCacheMode
+                                                       : &cfg->m_codecEngineConfig.m_dstCacheMode;
+            if      (!strcasecmp(optarg, "range"))	*mode = CODEC_ENGINE_CACHE_RANGE;
+            else if (!strcasecmp(optarg, "whole"))	*mode = CODEC_ENGINE_CACHE_WHOLE;
+            else if (!strcasecmp(optarg, "none"))	*mode = CODEC_ENGINE_CACHE_NONE;
+            else
+            {
+              fprintf(stderr, "Unknown cache mode '%s'\n"
+                              "Known cache modes: range, whole, none\n",
+                      optarg);
+              return false;
+            }
+            break;
+          }
+          case 29: cfg->m_codecEngineConfig.m_cacheBenchmark = atoi(optarg); break;
+          case 30: cfg->m_codecEngineConfig.m_splitArmPercent = atoi(optarg); break;
+          case 31: cfg->m_codecEngineConfig.m_poolSize = (size_t)atoi(optarg)*1024*1024; break;
+          case 32: cfg->m_codecEngineConfig.m_timingReport = atoi(optarg); break;
+          case 33: cfg->m_codecEngineConfig.m_timingFile = optarg; break;
+          case 34:
+            if (cfg->m_codecEngineConfig.m_algorithms >= MAX_ALGORITHMS_N)
+            {
+              fprintf(stderr, "Too many algorithms, at most %d besides main codec\n", MAX_ALGORITHMS_N);
+              return false;
+            }
+            if (codecEngineAdapterFind(optarg) == NULL)
+            {
+              size_t adapter;
+              fprintf(stderr, "Unknown args layout of algorithm codec %s, supported:", optarg);
+              for (adapter = 0; adapter < codecEngineAdapters(); ++adapter)
+                fprintf(stderr, " %s", codecEngineAdapter(adapter)->m_codecName);
+              fprintf(stderr, "\n");
+              return false;
+            }
+            cfg->m_codecEngineConfig.m_algorithmCodec[cfg->m_codecEngineConfig.m_algorithms++] = optarg;
+            break;
+          case 35:
+            if (cfg->m_codecEngineConfig.m_algorithms == 0)
+            {
+              fprintf(stderr, "--ce-algorithm-fifo must follow --ce-algorithm\n");
+              return false;
+            }
+            cfg->m_rcConfig.m_fifoAlgorithmOutput[cfg->m_codecEngineConfig.m_algorithms-1] = optarg;
+            break;
+          case 36: cfg->m_latencyBoundMs = atoi(optarg); break;
+          case 37: cfg->m_fbConfig.m_pageFlip = atoi(optarg); break;
+          case 38: cfg->m_fbConfig.m_vsync = atoi(optarg); break;
+          case 39: cfg->m_fbConfig.m_overlay = atoi(optarg); break;
+          case 40: cfg->m_fbConfig.m_sync = atoi(optarg); break;
+          case 41: cfg->m_fbConfig.m_blitBenchmark = atoi(optarg); break;
+          case 42: cfg->m_fbConfig.m_shmPath = optarg; break;
+          case 43: cfg->m_fbConfig.m_shmSlots = atoi(optarg); break;
+          case 44: cfg->m_fbConfig.m_shmWidth = atoi(optarg); break;
+          case 45: cfg->m_fbConfig.m_shmHeight = atoi(optarg); break;
+          case 46: cfg->m_codecEngineConfig.m_cpuFallback = atoi(optarg); break;
+          case 47: cfg->m_recorderConfig.m_camera = atoi(optarg); break;
           default:
             return false;
         }
@@ -129,6 +303,18 @@ bool runtimeParseArgs(Runtime* _runtime, int _argc, char* const _argv[])
     }
   }
 
+  // camera count is known only once all --v4l2-camera options are seen
+  if (cfg->m_previewCamera >= cfg->m_cameras)
+  {
+    fprintf(stderr, "Invalid --fb-camera %zu, expected 0-%zu\n", cfg->m_previewCamera, cfg->m_cameras-1);
+    return false;
+  }
+  if (cfg->m_recorderConfig.m_camera >= cfg->m_cameras)
+  {
+    fprintf(stderr, "Invalid --rec-camera %zu, expected 0-%zu\n", cfg->m_recorderConfig.m_camera, cfg->m_cameras-1);
+    return false;
+  }
+
   return true;
 }
 
@@ -144,7 +330,7 @@ void runtimeArgsHelpMessage(Runtime* _runtime, const char* _arg0)
                   "    %s <opts>\n"
                   " where opts are:\n"
                   "   --ce-server    <dsp-server-name>\n"
-                  "   --ce-codec     <dsp-codec-name>\n"
+                  "   --ce-codec     <dsp-codec-name|cpu>\n"
                   "   --v4l2-path    <input-device-path>\n"
                   "   --v4l2-width   <input-width>\n"
                   "   --v4l2-height  <input-height>\n"
@@ -154,6 +340,44 @@ void runtimeArgsHelpMessage(Runtime* _runtime, const char* _arg0)
                   "   --rc-fifo-out           <remote-control-fifo-output>\n"
                   "   --video-out             <enable-video-output>\n"
                   "   --objects-n             <set objects amount to trace (1-8)>\n"
+                  "   --v4l2-memory           <auto|dmabuf|userptr|mmap capture buffers>\n"
+                  "   --fb-direct             <let DSP render into framebuffer>\n"
+                  "   --v4l2-buffers          <capture queue depth (1-8)>\n"
+                  "   --v4l2-low-latency      <process only the freshest captured frame>\n"
+                  "   --rc-timestamp          <append frame capture timestamp (us) to reports>\n"
+                  "   --v4l2-replay           <recorded-frames-file used instead of v4l2 device>\n"
+                  "   --v4l2-replay-fps       <replay rate, 0 for as fast as possible>\n"
+                  "   --v4l2-crop             <x,y,w,h sensor window, sets capture size>\n"
+                  "   --v4l2-fps              <sensor frame rate>\n"
+                  "   --v4l2-camera           <camera id (0-3) following --v4l2-* options apply to>\n"
+                  "   --camera-schedule       <round-robin|priority DSP time between cameras>\n"
+                  "   --fb-camera             <camera id shown on video output>\n"
+                  "   --ce-pipeline           <frames in flight on DSP (1-4), results are reported depth-1 frames late>\n"
+                  "   --ce-cache-src          <range|whole|none cache maintenance of codec input buffer>\n"
+                  "   --ce-cache-dst          <range|whole|none cache maintenance of codec output buffer>\n"
+                  "   --ce-cache-bench        <benchmark cache strategies on start and report per frame cost>\n"
+                  "   --ce-split              <initial ARM share of frame rows in split DSP/ARM mode, percent (0 disables)>\n"
+                  "   --ce-pool               <MiB of CMEM reserved for codec buffers at startup (0 allocates per buffer)>\n"
+                  "   --ce-timing             <print per frame copy/cache/process timing histograms with load report>\n"
+                  "   --ce-timing-file        <file rewritten with timing histograms on every load report>\n"
+                  "   --ce-algorithm          <dsp-codec-name run on every frame besides main codec, repeatable:\n"
+                  "                            vidtranscode_cv reports 'loc', vidtranscode_line reports 'line'>\n"
+                  "   --ce-algorithm-fifo     <output fifo of preceding --ce-algorithm (default: main fifo, 'algN' prefixed)>\n"
+                  "   --latency-bound         <capture to result ms, frames are decimated or skipped to keep it (0 disables)>\n"
+                  "   --fb-page-flip          <render into hidden page and pan to it, falls back to single buffer>\n"
+                  "   --fb-vsync              <wait for vertical sync after each page flip>\n"
+                  "   --fb-overlay            <draw only target markers on screen while video out is disabled>\n"
+                  "   --fb-sync               <open framebuffer with O_SYNC (default 1)>\n"
+                  "   --fb-blit-bench         <benchmark memcpy against blit into framebuffer on start>\n"
+                  "   --fb-shm                <file on tmpfs (e.g. /dev/shm/object-sensor.preview) to publish preview ring into instead of framebuffer>\n"
+                  "   --fb-shm-slots          <preview ring slots (2 or more, default 3)>\n"
+                  "   --fb-shm-width          <preview width published into shared memory>\n"
+                  "   --fb-shm-height         <preview height published into shared memory>\n"
+                  "   --ce-cpu-fallback       <run CPU detector when DSP engine cannot be opened>\n"
+                  "   --rec-path              <ring-file-to-record-captured-frames of one camera, see --rec-camera>\n"
+                  "   --rec-frames            <ring file length in frames>\n"
+                  "   --rec-queue             <frames buffered for writer (1-16), dropped when full>\n"
+                  "   --rec-camera            <camera id recorded (default 0), other cameras are not recorded>\n"
                   "   --verbose\n"
                   "   --help\n",
           _arg0);
@@ -197,6 +421,12 @@ int runtimeInit(Runtime* _runtime)
     exit_code = res;
   }
 
+  if ((res = recorderInit(verbose)) != 0)
+  {
+    fprintf(stderr, "recorderInit() failed: %d\n", res);
+    exit_code = res;
+  }
+
   return exit_code;
 }
 
@@ -210,6 +440,9 @@ int runtimeFini(Runtime* _runtime)
   if (_runtime == NULL)
     return EINVAL;
 
+  if ((res = recorderFini()) != 0)
+    fprintf(stderr, "recorderFini() failed: %d\n", res);
+
   if ((res = rcInputFini()) != 0)
     fprintf(stderr, "rcInputFini() failed: %d\n", res);
 
@@ -310,12 +543,44 @@ const CodecEngineConfig* runtimeCfgCodecEngine(const Runtime* _runtime)
   return &_runtime->m_config.m_codecEngineConfig;
 }
 
-const V4L2Config* runtimeCfgV4L2Input(const Runtime* _runtime)
+const V4L2Config* runtimeCfgV4L2Input(const Runtime* _runtime, size_t _camera)
 {
-  if (_runtime == NULL)
+  if (_runtime == NULL || _camera >= _runtime->m_config.m_cameras)
     return NULL;
 
-  return &_runtime->m_config.m_v4l2Config;
+  return &_runtime->m_config.m_v4l2Config[_camera];
+}
+
+size_t runtimeCfgCameras(const Runtime* _runtime)
+{
+  if (_runtime == NULL)
+    return 0;
+
+  return _runtime->m_config.m_cameras;
+}
+
+RuntimeCameraSchedule runtimeCfgCameraSchedule(const Runtime* _runtime)
+{
+  if (_runtime == NULL)
+    return RUNTIME_CAMERA_SCHEDULE_ROUND_ROBIN;
+
+  return _runtime->m_config.m_cameraSchedule;
+}
+
+size_t runtimeCfgPreviewCamera(const Runtime* _runtime)
+{
+  if (_runtime == NULL)
+    return 0;
+
+  return _runtime->m_config.m_previewCamera;
+}
+
+size_t runtimeCfgLatencyBoundMs(const Runtime* _runtime)
+{
+  if (_runtime == NULL)
+    return 0;
+
+  return _runtime->m_config.m_latencyBoundMs;
 }
 
 const FBConfig* runtimeCfgFBOutput(const Runtime* _runtime)
@@ -334,23 +599,31 @@ const RCConfig* runtimeCfgRCInput(const Runtime* _runtime)
   return &_runtime->m_config.m_rcConfig;
 }
 
+const RecorderConfig* runtimeCfgRecorder(const Runtime* _runtime)
+{
+  if (_runtime == NULL)
+    return NULL;
 
+  return &_runtime->m_config.m_recorderConfig;
+}
 
 
-CodecEngine* runtimeModCodecEngine(Runtime* _runtime)
+
+
+CodecEngine* runtimeModCodecEngine(Runtime* _runtime, size_t _camera)
 {
-  if (_runtime == NULL)
+  if (_runtime == NULL || _camera >= _runtime->m_config.m_cameras)
     return NULL;
 
-  return &_runtime->m_modules.m_codecEngine;
+  return &_runtime->m_modules.m_codecEngine[_camera];
 }
 
-V4L2Input* runtimeModV4L2Input(Runtime* _runtime)
+V4L2Input* runtimeModV4L2Input(Runtime* _runtime, size_t _camera)
 {
-  if (_runtime == NULL)
+  if (_runtime == NULL || _camera >= _runtime->m_config.m_cameras)
     return NULL;
 
-  return &_runtime->m_modules.m_v4l2Input;
+  return &_runtime->m_modules.m_v4l2Input[_camera];
 }
 
 FBOutput* runtimeModFBOutput(Runtime* _runtime)
@@ -369,6 +642,14 @@ RCInput* runtimeModRCInput(Runtime* _runtime)
   return &_runtime->m_modules.m_rcInput;
 }
 
+Recorder* runtimeModRecorder(Runtime* _runtime)
+{
+  if (_runtime == NULL)
+    return NULL;
+
+  return &_runtime->m_modules.m_recorder;
+}
+
 
 
 
@@ -456,26 +737,176 @@ int runtimeSetTargetDetectCommand(Runtime* _runtime, const TargetDetectCommand*
   return 0;
 }
 
-int runtimeReportTargetLocation(Runtime* _runtime, const TargetLocation* _targetLocation)
+int runtimeFetchVideoFormatCommand(Runtime* _runtime, VideoFormatCommand* _videoFormatCommand)
+{
+  if (_runtime == NULL || _videoFormatCommand == NULL)
+    return EINVAL;
+
+  pthread_mutex_lock(&_runtime->m_state.m_mutex);
+  *_videoFormatCommand = _runtime->m_state.m_videoFormatCommand;
+  _runtime->m_state.m_videoFormatCommand.m_width = 0;
+  pthread_mutex_unlock(&_runtime->m_state.m_mutex);
+  return 0;
+}
+
+int runtimeSetVideoFormatCommand(Runtime* _runtime, const VideoFormatCommand* _videoFormatCommand)
+{
+  if (_runtime == NULL || _videoFormatCommand == NULL)
+    return EINVAL;
+
+  pthread_mutex_lock(&_runtime->m_state.m_mutex);
+  _runtime->m_state.m_videoFormatCommand = *_videoFormatCommand;
+  pthread_mutex_unlock(&_runtime->m_state.m_mutex);
+  return 0;
+}
+
+int runtimeFetchTimingCommand(Runtime* _runtime, int* _timingCommand)
+{
+  if (_runtime == NULL || _timingCommand == NULL)
+    return EINVAL;
+
+  pthread_mutex_lock(&_runtime->m_state.m_mutex);
+  *_timingCommand = _runtime->m_state.m_timingCommand;
+  _runtime->m_state.m_timingCommand = 0;
+  pthread_mutex_unlock(&_runtime->m_state.m_mutex);
+  return 0;
+}
+
+int runtimeSetTimingCommand(Runtime* _runtime, const int* _timingCommand)
+{
+  if (_runtime == NULL || _timingCommand == NULL)
+    return EINVAL;
+
+  pthread_mutex_lock(&_runtime->m_state.m_mutex);
+  _runtime->m_state.m_timingCommand = *_timingCommand;
+  pthread_mutex_unlock(&_runtime->m_state.m_mutex);
+  return 0;
+}
+
+int runtimeReportTargetLocation(Runtime* _runtime, const TargetLocation* _targetLocation, const FrameInfo* _frameInfo)
 {
   if (_runtime == NULL || _targetLocation == NULL)
     return EINVAL;
 
 #warning Unsafe
-  rcInputUnsafeReportTargetLocation(&_runtime->m_modules.m_rcInput, _targetLocation);
+  rcInputUnsafeReportTargetLocation(&_runtime->m_modules.m_rcInput, _targetLocation, _frameInfo);
 
   return 0;
 }
 
-int runtimeReportTargetDetectParams(Runtime* _runtime, const TargetDetectParams* _targetDetectParams)
+int runtimeReportTargetDetectParams(Runtime* _runtime, const TargetDetectParams* _targetDetectParams, const FrameInfo* _frameInfo)
 {
   if (_runtime == NULL || _targetDetectParams == NULL)
     return EINVAL;
 
 #warning Unsafe
-  rcInputUnsafeReportTargetDetectParams(&_runtime->m_modules.m_rcInput, _targetDetectParams);
+  rcInputUnsafeReportTargetDetectParams(&_runtime->m_modules.m_rcInput, _targetDetectParams, _frameInfo);
+
+  return 0;
+}
+
+int runtimeReportAlgorithmResult(Runtime* _runtime, size_t _algorithm, const AlgorithmResult* _result, const FrameInfo* _frameInfo)
+{
+  if (_runtime == NULL || _result == NULL)
+    return EINVAL;
+
+  return rcInputUnsafeReportAlgorithmResult(&_runtime->m_modules.m_rcInput, _algorithm, _result, _frameInfo);
+}
+
+int runtimeReportLatency(Runtime* _runtime, long long _ms)
+{
+  if (_runtime == NULL)
+    return EINVAL;
+
+  return rcInputUnsafeReportLatency(&_runtime->m_modules.m_rcInput, _ms);
+}
+
+int runtimeReportTiming(Runtime* _runtime)
+{
+  if (_runtime == NULL)
+    return EINVAL;
+
+  size_t camera;
+  for (camera = 0; camera < runtimeCfgCameras(_runtime); ++camera)
+  {
+    size_t stage;
+    for (stage = 0; stage < CODEC_ENGINE_TIMING_STAGES; ++stage)
+    {
+      TimingSummary summary;
+      codecEngineGetTiming(&_runtime->m_modules.m_codecEngine[camera], stage, &summary);
+      rcInputUnsafeReportTiming(&_runtime->m_modules.m_rcInput, camera, codecEngineTimingStageName(stage), &summary);
+    }
+  }
 
   return 0;
 }
 
+int runtimeResetTiming(Runtime* _runtime)
+{
+  if (_runtime == NULL)
+    return EINVAL;
+
+  size_t camera;
+  for (camera = 0; camera < runtimeCfgCameras(_runtime); ++camera)
+    codecEngineResetTiming(&_runtime->m_modules.m_codecEngine[camera]);
+
+  return 0;
+}
+
+// same lines as stats report to output fifo; replaced by rename, so readers never see it half written
+int runtimeWriteTimingFile(Runtime* _runtime)
+{
+  int res;
 
+  if (_runtime == NULL)
+    return EINVAL;
+
+  const char* path = _runtime->m_config.m_codecEngineConfig.m_timingFile;
+  if (path == NULL)
+    return 0;
+
+  char tmpPath[256];
+  snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+  FILE* file = fopen(tmpPath, "w");
+  if (file == NULL)
+  {
+    res = errno;
+    fprintf(stderr, "fopen(%s) failed: %d\n", tmpPath, res);
+    return res;
+  }
+
+  size_t camera;
+  for (camera = 0; camera < runtimeCfgCameras(_runtime); ++camera)
+  {
+    size_t stage;
+    for (stage = 0; stage < CODEC_ENGINE_TIMING_STAGES; ++stage)
+    {
+      TimingSummary summary;
+      char timing[96];
+      codecEngineGetTiming(&_runtime->m_modules.m_codecEngine[camera], stage, &summary);
+      timingSummaryFormat(&summary, timing, sizeof(timing));
+      if (camera != 0)
+        fprintf(file, "cam%zu ", camera);
+      fprintf(file, "stats: %s %s\n", codecEngineTimingStageName(stage), timing);
+    }
+  }
+
+  if (fclose(file) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "fclose(%s) failed: %d\n", tmpPath, res);
+    unlink(tmpPath);
+    return res;
+  }
+
+  if (rename(tmpPath, path) != 0)
+  {
+    res = errno;
+    fprintf(stderr, "rename(%s, %s) failed: %d\n", tmpPath, path, res);
+    unlink(tmpPath);
+    return res;
+  }
+
+  return 0;
+}
@@ -88,6 +88,45 @@ static int threadInputSelectLoop(Runtime* _runtime, RCInput* _rc)
   }
 
 
+  VideoFormatCommand videoFormatCommand;
+  if ((res = rcInputGetVideoFormatCommand(_rc, &videoFormatCommand)) != 0)
+  {
+    if (res != ENODATA)
+    {
+      fprintf(stderr, "rcInputGetVideoFormatCommand() failed: %d\n", res);
+      return res;
+    }
+  }
+  else
+  {
+    if ((res = runtimeSetVideoFormatCommand(_runtime, &videoFormatCommand)) != 0)
+    {
+      fprintf(stderr, "runtimeSetVideoFormatCommand() failed: %d\n", res);
+      return res;
+    }
+  }
+
+
+  int timingCommand;
+  if ((res = rcInputGetTimingCommand(_rc, &timingCommand)) != 0)
+  {
+    if (res != ENODATA)
+    {
+      fprintf(stderr, "rcInputGetTimingCommand() failed: %d\n", res);
+      return res;
+    }
+  }
+  else
+  {
+    // video thread owns rc output, it runs the command
+    if ((res = runtimeSetTimingCommand(_runtime, &timingCommand)) != 0)
+    {
+      fprintf(stderr, "runtimeSetTimingCommand() failed: %d\n", res);
+      return res;
+    }
+  }
+
+
   TargetDetectCommand targetDetectCommand;
   if ((res = rcInputGetTargetDetectCommand(_rc, &targetDetectCommand)) != 0)
   {
@@ -13,45 +13,251 @@
 #include "internal/module_ce.h"
 #include "internal/module_fb.h"
 #include "internal/module_v4l2.h"
+#include "internal/module_recorder.h"
 
 
-static int threadVideoSelectLoop(Runtime* _runtime, CodecEngine* _ce, V4L2Input* _v4l2, FBOutput* _fb)
+#define VIDEO_GOVERNOR_MAX_DECIMATION 8
+#define VIDEO_GOVERNOR_MAX_STALE_RUN  8
+#define VIDEO_GOVERNOR_WINDOW_US      1000000
+
+// keeps capture to result latency under configured bound when DSP cannot keep up with capture rate
+typedef struct VideoGovernor
 {
-  int res;
-  int maxFd = 0;
-  fd_set fdsIn;
-  static const struct timespec s_selectTimeout = { .tv_sec=1, .tv_nsec=0 };
+  long long m_boundUs;            // 0 - governor disabled
+  size_t    m_decimation;         // process every Nth frame
+  size_t    m_frameCounter;
+  size_t    m_staleRun;           // frames skipped in a row by deadline, bounded so results keep coming
 
-  if (_runtime == NULL || _ce == NULL || _v4l2 == NULL || _fb == NULL)
-    return EINVAL;
+  long long m_processUsAvg;       // running average, 1/8 weight for new sample
+  long long m_windowStartUs;
+  long long m_windowBusyUs;
+  long long m_windowLatencyMaxUs;
 
-  FD_ZERO(&fdsIn);
+  long long m_processed;          // since last report
+  long long m_decimated;
+  long long m_stale;
+} VideoGovernor;
 
-  FD_SET(_v4l2->m_fd, &fdsIn);
-  if (maxFd < _v4l2->m_fd)
-    maxFd = _v4l2->m_fd;
 
-  if ((res = pselect(maxFd+1, &fdsIn, NULL, NULL, &s_selectTimeout, NULL)) < 0)
+static long long threadVideoNowUs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec*1000000 + now.tv_nsec/1000;
+}
+
+static void threadVideoGovernorReset(VideoGovernor* _governor, size_t _boundMs)
+{
+  memset(_governor, 0, sizeof(*_governor));
+  _governor->m_boundUs = (long long)_boundMs*1000;
+  _governor->m_decimation = 1;
+  _governor->m_windowStartUs = threadVideoNowUs();
+}
+
+// decided before anything is copied, skipped frame goes straight back to driver
+static bool threadVideoGovernorSkip(VideoGovernor* _governor, const FrameInfo* _frameInfo)
+{
+  if (_governor->m_boundUs == 0)
+    return false;
+
+  const long long ageUs = threadVideoNowUs() - _frameInfo->m_timestampUs;
+  if (   ageUs + _governor->m_processUsAvg > _governor->m_boundUs
+      && _governor->m_processUsAvg < _governor->m_boundUs
+      && _governor->m_staleRun < VIDEO_GOVERNOR_MAX_STALE_RUN)
   {
-    res = errno;
-    fprintf(stderr, "pselect() failed: %d\n", res);
-    return res;
+    ++_governor->m_staleRun;
+    ++_governor->m_stale;
+    return true;
   }
+  _governor->m_staleRun = 0;
 
-  if (!FD_ISSET(_v4l2->m_fd, &fdsIn))
+  if (++_governor->m_frameCounter < _governor->m_decimation)
   {
-    fprintf(stderr, "pselect() did not select V4L2\n");
-    return EBUSY;
+    ++_governor->m_decimated;
+    return true;
+  }
+  _governor->m_frameCounter = 0;
+
+  return false;
+}
+
+static void threadVideoGovernorAdapt(Runtime* _runtime, VideoGovernor* _governor, size_t _camera, long long _nowUs)
+{
+  const long long windowUs = _nowUs - _governor->m_windowStartUs;
+  const size_t decimation = _governor->m_decimation;
+
+  // single DSP server, load is shared by all cameras
+  int loadPercent = -1;
+  if (codecEngineGetLoad(runtimeModCodecEngine(_runtime, 0), &loadPercent) != 0)
+    loadPercent = -1;
+
+  const long long busyPercent = _governor->m_windowBusyUs*100/windowUs;
+  const bool saturated = _governor->m_windowLatencyMaxUs > _governor->m_boundUs
+                      || loadPercent >= 95
+                      || busyPercent >= 90;
+  // going back to N-1 raises busy share by N/(N-1)
+  const bool relaxed = _governor->m_windowLatencyMaxUs < _governor->m_boundUs/2
+                    && loadPercent < 80
+                    && decimation > 1
+                    && busyPercent*decimation/(decimation-1) < 70;
+
+  if (saturated && decimation < VIDEO_GOVERNOR_MAX_DECIMATION)
+    ++_governor->m_decimation;
+  else if (!saturated && relaxed)
+    --_governor->m_decimation;
+
+  if (_governor->m_decimation != decimation)
+    fprintf(stderr, "Camera %zu processes every %zu frame(s): latency %lld us, busy %lld%%, DSP load %d%%\n",
+            _camera, _governor->m_decimation, _governor->m_windowLatencyMaxUs, busyPercent, loadPercent);
+
+  _governor->m_windowStartUs = _nowUs;
+  _governor->m_windowBusyUs = 0;
+  _governor->m_windowLatencyMaxUs = 0;
+}
+
+// _frameInfo describes frame whose result was just reported, NULL while pipeline fills up
+static void threadVideoGovernorDone(Runtime* _runtime, VideoGovernor* _governor, size_t _camera,
+                                    long long _startUs, const FrameInfo* _frameInfo)
+{
+  if (_governor->m_boundUs == 0)
+    return;
+
+  const long long nowUs = threadVideoNowUs();
+  const long long processUs = nowUs - _startUs;
+
+  _governor->m_processUsAvg += (processUs - _governor->m_processUsAvg)/8;
+  _governor->m_windowBusyUs += processUs;
+  ++_governor->m_processed;
+
+  if (_frameInfo != NULL && nowUs - _frameInfo->m_timestampUs > _governor->m_windowLatencyMaxUs)
+    _governor->m_windowLatencyMaxUs = nowUs - _frameInfo->m_timestampUs;
+
+  if (nowUs - _governor->m_windowStartUs >= VIDEO_GOVERNOR_WINDOW_US)
+    threadVideoGovernorAdapt(_runtime, _governor, _camera, nowUs);
+}
+
+static void threadVideoGovernorReport(VideoGovernor* _governor)
+{
+  if (_governor->m_boundUs == 0)
+    return;
+
+  fprintf(stderr, "Governor: every %zu frame(s), %lld processed, %lld decimated, %lld stale, avg %lld us\n",
+          _governor->m_decimation, _governor->m_processed, _governor->m_decimated, _governor->m_stale,
+          _governor->m_processUsAvg);
+
+  _governor->m_processed = 0;
+  _governor->m_decimated = 0;
+  _governor->m_stale = 0;
+}
+
+
+static int threadVideoReportFrame(Runtime* _runtime,
+                                  const TargetDetectCommand* _targetDetectCommand,
+                                  const TargetLocation* _targetLocation,
+                                  const TargetDetectParams* _targetDetectParamsResult,
+                                  const FrameInfo* _frameInfo)
+{
+  int res;
+
+  switch (_targetDetectCommand->m_cmd)
+  {
+    case 1:
+      if ((res = runtimeReportTargetDetectParams(_runtime, _targetDetectParamsResult, _frameInfo)) != 0)
+      {
+        fprintf(stderr, "runtimeReportTargetDetectParams() failed: %d\n", res);
+        return res;
+      }
+      break;
+
+    case 0:
+    default:
+      if ((res = runtimeReportTargetLocation(_runtime, _targetLocation, _frameInfo)) != 0)
+      {
+        fprintf(stderr, "runtimeReportTargetLocation() failed: %d\n", res);
+        return res;
+      }
+      break;
   }
 
+  return 0;
+}
+
+// markers only, instead of full preview frame
+static void threadVideoDrawOverlay(Runtime* _runtime, size_t _camera, FBOutput* _fb, const CodecEngine* _ce,
+                                   const TargetDetectCommand* _targetDetectCommand,
+                                   const TargetLocation* _targetLocation)
+{
+  int res;
+
+  if (   _ce->m_videoOutEnable
+      || _camera != runtimeCfgPreviewCamera(_runtime)
+      || _targetDetectCommand->m_cmd != 0
+      || !_fb->m_overlay)
+    return;
+
+  if ((res = fbOutputDrawTargets(_fb, _targetLocation)) != 0)
+    fprintf(stderr, "fbOutputDrawTargets() failed: %d\n", res);
+}
+
+static int threadVideoReportAlgorithms(Runtime* _runtime, const CodecEngine* _ce, const FrameInfo* _frameInfo)
+{
+  int res;
+  size_t algorithm;
+
+  for (algorithm = 0; algorithm < codecEngineAlgorithms(_ce); ++algorithm)
+  {
+    AlgorithmResult result;
+    if (codecEngineGetAlgorithmResult(_ce, algorithm, &result) != 0)
+      continue; // reported on stderr when it failed
+
+    if ((res = runtimeReportAlgorithmResult(_runtime, algorithm, &result, _frameInfo)) != 0)
+    {
+      fprintf(stderr, "runtimeReportAlgorithmResult(%s) failed: %d\n", codecEngineAlgorithmName(_ce, algorithm), res);
+      return res;
+    }
+  }
+
+  return 0;
+}
+
+static int threadVideoProcessFrame(Runtime* _runtime, size_t _camera, FBOutput* _fb, Recorder* _rec,
+                                   VideoGovernor* _governor)
+{
+  int res;
+  CodecEngine* ce;
+  V4L2Input* v4l2;
+
+  if (   (ce   = runtimeModCodecEngine(_runtime, _camera)) == NULL
+      || (v4l2 = runtimeModV4L2Input(_runtime, _camera))   == NULL)
+    return EINVAL;
+
   const void* frameSrcPtr;
   size_t frameSrcSize;
   size_t frameSrcIndex;
-  if ((res = v4l2InputGetFrame(_v4l2, &frameSrcPtr, &frameSrcSize, &frameSrcIndex)) != 0)
+  FrameInfo frameSrcInfo;
+  if ((res = v4l2InputGetFrame(v4l2, &frameSrcPtr, &frameSrcSize, &frameSrcIndex, &frameSrcInfo)) != 0)
   {
-    fprintf(stderr, "v4l2InputGetFrame() failed: %d\n", res);
+    fprintf(stderr, "v4l2InputGetFrame(%zu) failed: %d\n", _camera, res);
     return res;
   }
+  frameSrcInfo.m_camera = _camera;
+
+  if (threadVideoGovernorSkip(_governor, &frameSrcInfo))
+  {
+    if ((res = v4l2InputPutFrame(v4l2, frameSrcIndex)) != 0)
+    {
+      fprintf(stderr, "v4l2InputPutFrame(%zu) failed: %d\n", _camera, res);
+      return res;
+    }
+    return 0;
+  }
+  const long long startUs = threadVideoNowUs();
+
+  // copied into writer queue or dropped, never waits for storage
+  if (   _camera == runtimeCfgRecorder(_runtime)->m_camera
+      && _rec->m_fd != -1
+      && (res = recorderPushFrame(_rec, frameSrcPtr, frameSrcSize, &frameSrcInfo)) != 0)
+    fprintf(stderr, "recorderPushFrame() failed: %d\n", res);
 
   void* frameDstPtr;
   size_t frameDstSize;
@@ -79,17 +285,74 @@ static int threadVideoSelectLoop(Runtime* _runtime, CodecEngine* _ce, V4L2Input*
     return res;
   }
 
-  if ((res = runtimeGetVideoOutParams(_runtime, &(_ce->m_videoOutEnable))) != 0)
+  if ((res = runtimeGetVideoOutParams(_runtime, &(ce->m_videoOutEnable))) != 0)
   {
     fprintf(stderr, "runtimeGetVideoOutParams() failed: %d\n", res);
     return res;
   }
+  if (_camera != runtimeCfgPreviewCamera(_runtime))
+    ce->m_videoOutEnable = false;
 
 
   size_t frameDstUsed = frameDstSize;
-  if ((res = codecEngineTranscodeFrame(_ce,
+  if (codecEnginePipelined(ce))
+  {
+    // source is copied on submit, so capture buffer goes back to driver right away
+    // direct output would land in a page that is on screen by the time frame is collected
+    res = codecEngineSubmitFrame(ce,
+                                 frameSrcPtr, frameSrcSize,
+                                 frameDstPtr, frameDstSize,
+                                 fbOutputFrameContiguous(_fb) && !fbOutputPageFlipping(_fb),
+                                 &targetDetectParams,
+                                 &targetDetectCommand,
+                                 &frameSrcInfo);
+    if (res != 0)
+    {
+      fprintf(stderr, "codecEngineSubmitFrame(%p[%zu]) failed: %d\n", frameSrcPtr, frameSrcSize, res);
+      return res;
+    }
+
+    if ((res = v4l2InputPutFrame(v4l2, frameSrcIndex)) != 0)
+    {
+      fprintf(stderr, "v4l2InputPutFrame(%zu) failed: %d\n", _camera, res);
+      return res;
+    }
+
+    // results below belong to an earlier frame, as described by collected frame info
+    res = codecEngineCollectFrame(ce,
+                                  frameDstPtr, frameDstSize, &frameDstUsed,
+                                  &targetDetectCommand,
+                                  &targetLocation,
+                                  &targetDetectParamsResult,
+                                  &frameSrcInfo);
+    if (res == EAGAIN) // pipeline still filling up, nothing new to show
+    {
+      threadVideoGovernorDone(_runtime, _governor, _camera, startUs, NULL);
+      return 0;
+    }
+    if (res != 0)
+    {
+      fprintf(stderr, "codecEngineCollectFrame() failed: %d\n", res);
+      return res;
+    }
+
+    // flipping to a page nothing was rendered into would bring back an old frame
+    if (ce->m_videoOutEnable && (res = fbOutputPutFrame(_fb)) != 0)
+    {
+      fprintf(stderr, "fbOutputPutFrame() failed: %d\n", res);
+      return res;
+    }
+
+    threadVideoGovernorDone(_runtime, _governor, _camera, startUs, &frameSrcInfo);
+    threadVideoDrawOverlay(_runtime, _camera, _fb, ce, &targetDetectCommand, &targetLocation);
+    return threadVideoReportFrame(_runtime, &targetDetectCommand, &targetLocation, &targetDetectParamsResult, &frameSrcInfo);
+  }
+
+  if ((res = codecEngineTranscodeFrame(ce,
                                        frameSrcPtr, frameSrcSize,
+                                       v4l2InputFramesContiguous(v4l2), v4l2InputFrameFd(v4l2, frameSrcIndex),
                                        frameDstPtr, frameDstSize, &frameDstUsed,
+                                       fbOutputFrameContiguous(_fb),
                                        &targetDetectParams,
                                        &targetDetectCommand,
                                        &targetLocation,
@@ -101,39 +364,247 @@ static int threadVideoSelectLoop(Runtime* _runtime, CodecEngine* _ce, V4L2Input*
   }
 
 
-  if ((res = fbOutputPutFrame(_fb)) != 0)
+  if (ce->m_videoOutEnable && (res = fbOutputPutFrame(_fb)) != 0)
   {
     fprintf(stderr, "fbOutputPutFrame() failed: %d\n", res);
     return res;
   }
 
-  if ((res = v4l2InputPutFrame(_v4l2, frameSrcIndex)) != 0)
+  if ((res = v4l2InputPutFrame(v4l2, frameSrcIndex)) != 0)
   {
-    fprintf(stderr, "v4l2InputPutFrame() failed: %d\n", res);
+    fprintf(stderr, "v4l2InputPutFrame(%zu) failed: %d\n", _camera, res);
     return res;
   }
 
+  threadVideoGovernorDone(_runtime, _governor, _camera, startUs, &frameSrcInfo);
+  threadVideoDrawOverlay(_runtime, _camera, _fb, ce, &targetDetectCommand, &targetLocation);
+  if ((res = threadVideoReportFrame(_runtime, &targetDetectCommand, &targetLocation, &targetDetectParamsResult, &frameSrcInfo)) != 0)
+    return res;
+
+  return threadVideoReportAlgorithms(_runtime, ce, &frameSrcInfo);
+}
 
-  switch (targetDetectCommand.m_cmd)
+static int threadVideoSelectLoop(Runtime* _runtime, FBOutput* _fb, Recorder* _rec, VideoGovernor* _governors,
+                                 size_t* _cameraLast)
+{
+  int res;
+  int maxFd = 0;
+  fd_set fdsIn;
+  static const struct timespec s_selectTimeout = { .tv_sec=1, .tv_nsec=0 };
+
+  if (_runtime == NULL || _fb == NULL || _rec == NULL || _governors == NULL || _cameraLast == NULL)
+    return EINVAL;
+
+  const size_t cameras = runtimeCfgCameras(_runtime);
+  size_t camera;
+
+  FD_ZERO(&fdsIn);
+
+  for (camera = 0; camera < cameras; ++camera)
   {
-    case 1:
-      if ((res = runtimeReportTargetDetectParams(_runtime, &targetDetectParamsResult)) != 0)
-      {
-        fprintf(stderr, "runtimeReportTargetDetectParams() failed: %d\n", res);
-        return res;
-      }
-      break;
+    const V4L2Input* v4l2 = runtimeModV4L2Input(_runtime, camera);
+    FD_SET(v4l2->m_fd, &fdsIn);
+    if (maxFd < v4l2->m_fd)
+      maxFd = v4l2->m_fd;
+  }
 
-    case 0:
-    default:
-      if ((res = runtimeReportTargetLocation(_runtime, &targetLocation)) != 0)
-      {
-        fprintf(stderr, "runtimeReportTargetLocation() failed: %d\n", res);
-        return res;
-      }
+  if ((res = pselect(maxFd+1, &fdsIn, NULL, NULL, &s_selectTimeout, NULL)) < 0)
+  {
+    res = errno;
+    fprintf(stderr, "pselect() failed: %d\n", res);
+    return res;
+  }
+
+  // one frame per iteration, so schedule decides who gets next DSP slot
+  const size_t cameraFirst = runtimeCfgCameraSchedule(_runtime) == RUNTIME_CAMERA_SCHEDULE_ROUND_ROBIN
+                           ? (*_cameraLast + 1) % cameras
+                           : 0;
+  size_t cameraIdx;
+  for (cameraIdx = 0; cameraIdx < cameras; ++cameraIdx)
+  {
+    camera = (cameraFirst + cameraIdx) % cameras;
+    if (FD_ISSET(runtimeModV4L2Input(_runtime, camera)->m_fd, &fdsIn))
       break;
   }
 
+  if (cameraIdx == cameras)
+  {
+    fprintf(stderr, "pselect() did not select V4L2\n");
+    return EBUSY;
+  }
+
+  *_cameraLast = camera;
+  return threadVideoProcessFrame(_runtime, camera, _fb, _rec, &_governors[camera]);
+}
+
+static void threadVideoCloseCamera(Runtime* _runtime, size_t _camera)
+{
+  int res;
+  CodecEngine* ce = runtimeModCodecEngine(_runtime, _camera);
+  V4L2Input* v4l2 = runtimeModV4L2Input(_runtime, _camera);
+
+  if ((res = v4l2InputStop(v4l2)) != 0)
+    fprintf(stderr, "v4l2InputStop(%zu) failed: %d\n", _camera, res);
+
+  if ((res = codecEngineStop(ce)) != 0)
+    fprintf(stderr, "codecEngineStop(%zu) failed: %d\n", _camera, res);
+
+  if ((res = v4l2InputClose(v4l2)) != 0)
+    fprintf(stderr, "v4l2InputClose(%zu) failed: %d\n", _camera, res);
+
+  if ((res = codecEngineClose(ce)) != 0)
+    fprintf(stderr, "codecEngineClose(%zu) failed: %d\n", _camera, res);
+}
+
+static int threadVideoOpenCamera(Runtime* _runtime, size_t _camera, const ImageDescription* _dstImageDesc)
+{
+  int res;
+  CodecEngine* ce = runtimeModCodecEngine(_runtime, _camera);
+  V4L2Input* v4l2 = runtimeModV4L2Input(_runtime, _camera);
+
+  if (ce == NULL || v4l2 == NULL)
+    return EINVAL;
+
+  if ((res = codecEngineOpen(ce, runtimeCfgCodecEngine(_runtime))) != 0)
+  {
+    fprintf(stderr, "codecEngineOpen(%zu) failed: %d\n", _camera, res);
+    return res;
+  }
+
+  if ((res = v4l2InputOpen(v4l2, runtimeCfgV4L2Input(_runtime, _camera))) != 0)
+  {
+    fprintf(stderr, "v4l2InputOpen(%zu) failed: %d\n", _camera, res);
+    goto exit_ce_close;
+  }
+
+  ImageDescription srcImageDesc;
+  if ((res = v4l2InputGetFormat(v4l2, &srcImageDesc)) != 0)
+  {
+    fprintf(stderr, "v4l2InputGetFormat(%zu) failed: %d\n", _camera, res);
+    goto exit_v4l2_close;
+  }
+  if ((res = codecEngineStart(ce, runtimeCfgCodecEngine(_runtime), &srcImageDesc, _dstImageDesc)) != 0)
+  {
+    fprintf(stderr, "codecEngineStart(%zu) failed: %d\n", _camera, res);
+    goto exit_v4l2_close;
+  }
+
+  if ((res = v4l2InputStart(v4l2)) != 0)
+  {
+    fprintf(stderr, "v4l2InputStart(%zu) failed: %d\n", _camera, res);
+    goto exit_ce_stop;
+  }
+
+  return 0;
+
+
+ exit_ce_stop:
+  codecEngineStop(ce);
+ exit_v4l2_close:
+  v4l2InputClose(v4l2);
+ exit_ce_close:
+  codecEngineClose(ce);
+  return res;
+}
+
+// capture format switch on the fly: device stays open, codec engine keeps its instance and buffers where they fit
+static int threadVideoReformatCamera(Runtime* _runtime, const VideoFormatCommand* _videoFormatCommand,
+                                     const ImageDescription* _dstImageDesc, Recorder* _rec)
+{
+  int res;
+  const size_t camera = _videoFormatCommand->m_camera;
+
+  if (camera >= runtimeCfgCameras(_runtime))
+  {
+    fprintf(stderr, "Format change for unknown camera %zu ignored\n", camera);
+    return 0;
+  }
+
+  CodecEngine* ce = runtimeModCodecEngine(_runtime, camera);
+  V4L2Input* v4l2 = runtimeModV4L2Input(_runtime, camera);
+  if (v4l2->m_replay)
+  {
+    fprintf(stderr, "Camera %zu replays recorded frames, format change ignored\n", camera);
+    return 0;
+  }
+
+  struct timespec startTime;
+  clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+  ImageDescription srcImageDescOld;
+  if ((res = v4l2InputGetFormat(v4l2, &srcImageDescOld)) != 0)
+  {
+    fprintf(stderr, "v4l2InputGetFormat(%zu) failed: %d\n", camera, res);
+    return res;
+  }
+
+  if ((res = v4l2InputStop(v4l2)) != 0)
+  {
+    fprintf(stderr, "v4l2InputStop(%zu) failed: %d\n", camera, res);
+    return res;
+  }
+
+  if ((res = v4l2InputSetFormat(v4l2, _videoFormatCommand->m_width, _videoFormatCommand->m_height,
+                                _videoFormatCommand->m_format)) != 0)
+  {
+    fprintf(stderr, "v4l2InputSetFormat(%zu, %zux%zu) failed: %d, restoring previous format\n",
+            camera, _videoFormatCommand->m_width, _videoFormatCommand->m_height, res);
+    if ((res = v4l2InputSetFormat(v4l2, srcImageDescOld.m_width, srcImageDescOld.m_height,
+                                  srcImageDescOld.m_format)) != 0)
+    {
+      fprintf(stderr, "v4l2InputSetFormat(%zu) failed: %d\n", camera, res);
+      return res;
+    }
+  }
+
+  ImageDescription srcImageDesc;
+  if ((res = v4l2InputGetFormat(v4l2, &srcImageDesc)) != 0)
+  {
+    fprintf(stderr, "v4l2InputGetFormat(%zu) failed: %d\n", camera, res);
+    return res;
+  }
+
+  if ((res = codecEngineReconfigure(ce, runtimeCfgCodecEngine(_runtime), &srcImageDesc, _dstImageDesc)) != 0)
+  {
+    // codec engine kept previous format, bring capture back to it and keep running
+    fprintf(stderr, "codecEngineReconfigure(%zu) failed: %d, restoring previous format\n", camera, res);
+    if ((res = v4l2InputSetFormat(v4l2, srcImageDescOld.m_width, srcImageDescOld.m_height,
+                                  srcImageDescOld.m_format)) != 0)
+    {
+      fprintf(stderr, "v4l2InputSetFormat(%zu) failed: %d\n", camera, res);
+      return res;
+    }
+    if ((res = v4l2InputStart(v4l2)) != 0)
+    {
+      fprintf(stderr, "v4l2InputStart(%zu) failed: %d\n", camera, res);
+      return res;
+    }
+    return 0;
+  }
+
+  // ring file has fixed frame layout
+  if (   camera == runtimeCfgRecorder(_runtime)->m_camera && _rec->m_fd != -1
+      && (srcImageDesc.m_format != srcImageDescOld.m_format || srcImageDesc.m_imageSize != srcImageDescOld.m_imageSize))
+  {
+    fprintf(stderr, "Capture format changed, recording stopped\n");
+    recorderStop(_rec);
+    recorderClose(_rec);
+  }
+
+  if ((res = v4l2InputStart(v4l2)) != 0)
+  {
+    fprintf(stderr, "v4l2InputStart(%zu) failed: %d\n", camera, res);
+    return res;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  fprintf(stderr, "Camera %zu switched to %c%c%c%c@%zux%zu in %lld ms\n", camera,
+          (srcImageDesc.m_format    )&0xff, (srcImageDesc.m_format>> 8)&0xff,
+          (srcImageDesc.m_format>>16)&0xff, (srcImageDesc.m_format>>24)&0xff,
+          srcImageDesc.m_width, srcImageDesc.m_height,
+          (long long)(now.tv_sec - startTime.tv_sec)*1000 + (now.tv_nsec - startTime.tv_nsec)/1000000);
+
   return 0;
 }
 
@@ -145,9 +616,14 @@ void* threadVideo(void* _arg)
   int res = 0;
   intptr_t exit_code = 0;
   Runtime* runtime = (Runtime*)_arg;
-  CodecEngine* ce;
-  V4L2Input* v4l2;
   FBOutput* fb;
+  Recorder* rec;
+  const RecorderConfig* recConfig;
+  size_t cameras;
+  size_t camera;
+  size_t camerasOpen = 0;
+  size_t cameraLast;
+  VideoGovernor governors[RUNTIME_MAX_CAMERAS];
   struct timespec last_fps_report_time;
 
   if (runtime == NULL)
@@ -156,64 +632,60 @@ void* threadVideo(void* _arg)
     goto exit;
   }
 
-  if (   (ce   = runtimeModCodecEngine(runtime)) == NULL
-      || (v4l2 = runtimeModV4L2Input(runtime))   == NULL
-      || (fb   = runtimeModFBOutput(runtime))    == NULL)
+  if (   (fb   = runtimeModFBOutput(runtime))    == NULL
+      || (rec  = runtimeModRecorder(runtime))    == NULL
+      || (recConfig = runtimeCfgRecorder(runtime)) == NULL
+      || (cameras = runtimeCfgCameras(runtime)) == 0)
   {
     exit_code = EINVAL;
     goto exit;
   }
 
 
-  if ((res = codecEngineOpen(ce, runtimeCfgCodecEngine(runtime))) != 0)
-  {
-    fprintf(stderr, "codecEngineOpen() failed: %d\n", res);
-    exit_code = res;
-    goto exit;
-  }
-
-
-  if ((res = v4l2InputOpen(v4l2, runtimeCfgV4L2Input(runtime))) != 0)
-  {
-    fprintf(stderr, "v4l2InputOpen() failed: %d\n", res);
-    exit_code = res;
-    goto exit_ce_close;
-  }
-
   if ((res = fbOutputOpen(fb, runtimeCfgFBOutput(runtime))) != 0)
   {
     fprintf(stderr, "fbOutputOpen() failed: %d\n", res);
     exit_code = res;
-    goto exit_v4l2_close;
+    goto exit;
   }
 
-
-  ImageDescription srcImageDesc;
   ImageDescription dstImageDesc;
-  if ((res = v4l2InputGetFormat(v4l2, &srcImageDesc)) != 0)
-  {
-    fprintf(stderr, "v4l2InputGetFormat() failed: %d\n", res);
-    exit_code = res;
-    goto exit_fb_close;
-  }
   if ((res = fbOutputGetFormat(fb, &dstImageDesc)) != 0)
   {
     fprintf(stderr, "fbOutputGetFormat() failed: %d\n", res);
     exit_code = res;
     goto exit_fb_close;
   }
-  if ((res = codecEngineStart(ce, runtimeCfgCodecEngine(runtime), &srcImageDesc, &dstImageDesc)) != 0)
+
+
+  for (camerasOpen = 0; camerasOpen < cameras; ++camerasOpen)
   {
-    fprintf(stderr, "codecEngineStart() failed: %d\n", res);
-    exit_code = res;
-    goto exit_fb_close;
+    if ((res = threadVideoOpenCamera(runtime, camerasOpen, &dstImageDesc)) != 0)
+    {
+      exit_code = res;
+      goto exit_cameras_close;
+    }
   }
+  cameraLast = cameras-1;
 
-  if ((res = v4l2InputStart(v4l2)) != 0)
+  for (camera = 0; camera < cameras; ++camera)
+    threadVideoGovernorReset(&governors[camera], runtimeCfgLatencyBoundMs(runtime));
+
+
+  if (recConfig->m_path != NULL)
   {
-    fprintf(stderr, "v4l2InputStart() failed: %d\n", res);
-    exit_code = res;
-    goto exit_ce_stop;
+    if ((res = recorderOpen(rec, recConfig, &runtimeModV4L2Input(runtime, recConfig->m_camera)->m_imageFormat)) != 0)
+    {
+      fprintf(stderr, "recorderOpen() failed: %d\n", res);
+      exit_code = res;
+      goto exit_cameras_close;
+    }
+    if ((res = recorderStart(rec)) != 0)
+    {
+      fprintf(stderr, "recorderStart() failed: %d\n", res);
+      exit_code = res;
+      goto exit_rec_close;
+    }
   }
 
 
@@ -221,7 +693,7 @@ void* threadVideo(void* _arg)
   {
     fprintf(stderr, "fbOutputStart() failed: %d\n", res);
     exit_code = res;
-    goto exit_v4l2_stop;
+    goto exit_rec_stop;
   }
 
 
@@ -252,15 +724,57 @@ void* threadVideo(void* _arg)
     {
       last_fps_report_time.tv_sec += 10;
 
-      if ((res = codecEngineReportLoad(ce, last_fps_report_elapsed_ms)) != 0)
-        fprintf(stderr, "codecEngineReportLoad() failed: %d\n", res);
+      // single DSP server, load is shared by all cameras
+      if ((res = codecEngineReportServerLoad(runtimeModCodecEngine(runtime, 0), last_fps_report_elapsed_ms)) != 0)
+        fprintf(stderr, "codecEngineReportServerLoad() failed: %d\n", res);
+
+      for (camera = 0; camera < cameras; ++camera)
+      {
+        char prefix[16] = "";
+        if (cameras > 1)
+        {
+          snprintf(prefix, sizeof(prefix), "cam%zu ", camera);
+          fprintf(stderr, "Camera %zu:\n", camera);
+        }
+        if ((res = codecEngineReportLoad(runtimeModCodecEngine(runtime, camera), last_fps_report_elapsed_ms, prefix)) != 0)
+          fprintf(stderr, "codecEngineReportLoad(%zu) failed: %d\n", camera, res);
+        if ((res = v4l2InputReportFPS(runtimeModV4L2Input(runtime, camera), last_fps_report_elapsed_ms)) != 0)
+          fprintf(stderr, "v4l2InputReportFPS() failed: %d\n", res);
+        threadVideoGovernorReport(&governors[camera]);
+      }
+
+      if ((res = runtimeReportLatency(runtime, last_fps_report_elapsed_ms)) != 0)
+        fprintf(stderr, "runtimeReportLatency() failed: %d\n", res);
+
+      if ((res = runtimeWriteTimingFile(runtime)) != 0)
+        fprintf(stderr, "runtimeWriteTimingFile() failed: %d\n", res);
 
-      if ((res = v4l2InputReportFPS(v4l2, last_fps_report_elapsed_ms)) != 0)
-        fprintf(stderr, "v4l2InputReportFPS() failed: %d\n", res);
+      if (   rec->m_fd != -1
+          && (res = recorderReportStats(rec, last_fps_report_elapsed_ms)) != 0)
+        fprintf(stderr, "recorderReportStats() failed: %d\n", res);
     }
 
 
-    if ((res = threadVideoSelectLoop(runtime, ce, v4l2, fb)) != 0)
+    VideoFormatCommand videoFormatCommand;
+    if ((res = runtimeFetchVideoFormatCommand(runtime, &videoFormatCommand)) != 0)
+      fprintf(stderr, "runtimeFetchVideoFormatCommand() failed: %d\n", res);
+    else if (   videoFormatCommand.m_width != 0
+             && (res = threadVideoReformatCamera(runtime, &videoFormatCommand, &dstImageDesc, rec)) != 0)
+    {
+      fprintf(stderr, "threadVideoReformatCamera() failed: %d\n", res);
+      exit_code = res;
+      goto exit_fb_stop;
+    }
+
+    int timingCommand;
+    if ((res = runtimeFetchTimingCommand(runtime, &timingCommand)) != 0)
+      fprintf(stderr, "runtimeFetchTimingCommand() failed: %d\n", res);
+    else if (timingCommand == 2 && (res = runtimeResetTiming(runtime)) != 0)
+      fprintf(stderr, "runtimeResetTiming() failed: %d\n", res);
+    else if (timingCommand == 1 && (res = runtimeReportTiming(runtime)) != 0)
+      fprintf(stderr, "runtimeReportTiming() failed: %d\n", res);
+
+    if ((res = threadVideoSelectLoop(runtime, fb, rec, governors, &cameraLast)) != 0)
     {
       fprintf(stderr, "threadVideoSelectLoop() failed: %d\n", res);
       exit_code = res;
@@ -274,33 +788,24 @@ void* threadVideo(void* _arg)
   if ((res = fbOutputStop(fb)) != 0)
     fprintf(stderr, "fbOutputStop() failed: %d\n", res);
 
- exit_v4l2_stop:
-  if ((res = v4l2InputStop(v4l2)) != 0)
-    fprintf(stderr, "v4l2InputStop() failed: %d\n", res);
+ exit_rec_stop:
+  if (rec->m_fd != -1 && (res = recorderStop(rec)) != 0)
+    fprintf(stderr, "recorderStop() failed: %d\n", res);
 
- exit_ce_stop:
-  if ((res = codecEngineStop(ce)) != 0)
-    fprintf(stderr, "codecEngineStop() failed: %d\n", res);
+ exit_rec_close:
+  if (rec->m_fd != -1 && (res = recorderClose(rec)) != 0)
+    fprintf(stderr, "recorderClose() failed: %d\n", res);
 
+ exit_cameras_close:
+  while (camerasOpen-- > 0)
+    threadVideoCloseCamera(runtime, camerasOpen);
 
  exit_fb_close:
   if ((res = fbOutputClose(fb)) != 0)
     fprintf(stderr, "fbOutputClose() failed: %d\n", res);
 
- exit_v4l2_close:
-  if ((res = v4l2InputClose(v4l2)) != 0)
-    fprintf(stderr, "v4l2InputClose() failed: %d\n", res);
-
- exit_ce_close:
-  if ((res = codecEngineClose(ce)) != 0)
-    fprintf(stderr, "codecEngineClose() failed: %d\n", res);
-
 
  exit:
   runtimeSetTerminate(runtime);
   return (void*)exit_code;
 }
-
-
-
-
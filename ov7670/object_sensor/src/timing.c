@@ -0,0 +1,129 @@
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "internal/timing.h"
+
+
+
+
+static size_t do_bucketIndex(uint32_t _us)
+{
+  if (_us < TIMING_HISTOGRAM_SUB_BUCKETS)
+    return _us;
+
+  const unsigned msb = 31 - __builtin_clz(_us); // >= 3
+  const size_t sub = (_us >> (msb-3)) & (TIMING_HISTOGRAM_SUB_BUCKETS-1);
+  return (msb-2)*TIMING_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+// middle of bucket range
+static uint32_t do_bucketValue(size_t _index)
+{
+  if (_index < TIMING_HISTOGRAM_SUB_BUCKETS)
+    return _index;
+
+  const unsigned msb = _index/TIMING_HISTOGRAM_SUB_BUCKETS + 2;
+  const uint32_t sub = _index%TIMING_HISTOGRAM_SUB_BUCKETS;
+  const uint32_t low = (TIMING_HISTOGRAM_SUB_BUCKETS+sub) << (msb-3);
+  return low + ((1u << (msb-3)) >> 1);
+}
+
+static uint32_t do_percentile(const uint32_t* _buckets, uint64_t _total, unsigned _percent)
+{
+  const uint64_t rank = (_total*_percent + 99)/100; // 1-based, rounded up
+  uint64_t seen = 0;
+  size_t idx;
+  for (idx = 0; idx < TIMING_HISTOGRAM_BUCKETS; ++idx)
+  {
+    seen += _buckets[idx];
+    if (seen >= rank && seen > 0)
+      return do_bucketValue(idx);
+  }
+
+  return 0;
+}
+
+
+
+
+void timingHistogramReset(TimingHistogram* _histogram)
+{
+  if (_histogram == NULL)
+    return;
+
+  size_t idx;
+  for (idx = 0; idx < TIMING_HISTOGRAM_BUCKETS; ++idx)
+    _histogram->m_buckets[idx] = 0;
+  _histogram->m_minUs = UINT32_MAX;
+  _histogram->m_maxUs = 0;
+  __sync_synchronize();
+  __sync_lock_test_and_set(&_histogram->m_sumUs, 0);
+  __sync_lock_test_and_set(&_histogram->m_count, 0);
+}
+
+void timingHistogramAdd(TimingHistogram* _histogram, long long _us)
+{
+  if (_histogram == NULL)
+    return;
+
+  const uint32_t us = _us < 0 ? 0 : (_us > UINT32_MAX ? UINT32_MAX : (uint32_t)_us);
+
+  __sync_fetch_and_add(&_histogram->m_buckets[do_bucketIndex(us)], 1);
+  __sync_fetch_and_add(&_histogram->m_sumUs, us);
+  __sync_fetch_and_add(&_histogram->m_count, 1);
+
+  uint32_t seen;
+  while (us < (seen = _histogram->m_minUs))
+    if (__sync_bool_compare_and_swap(&_histogram->m_minUs, seen, us))
+      break;
+  while (us > (seen = _histogram->m_maxUs))
+    if (__sync_bool_compare_and_swap(&_histogram->m_maxUs, seen, us))
+      break;
+}
+
+void timingHistogramSummary(const TimingHistogram* _histogram, TimingSummary* _summary)
+{
+  if (_histogram == NULL || _summary == NULL)
+    return;
+
+  memset(_summary, 0, sizeof(*_summary));
+
+  // percentiles come from bucket snapshot, so they are consistent with each other if not with count
+  uint32_t buckets[TIMING_HISTOGRAM_BUCKETS];
+  uint64_t total = 0;
+  size_t idx;
+  for (idx = 0; idx < TIMING_HISTOGRAM_BUCKETS; ++idx)
+  {
+    buckets[idx] = _histogram->m_buckets[idx];
+    total += buckets[idx];
+  }
+  if (total == 0)
+    return;
+
+  const uint64_t count = __sync_fetch_and_add((volatile uint64_t*)&_histogram->m_count, 0);
+  const uint64_t sumUs = __sync_fetch_and_add((volatile uint64_t*)&_histogram->m_sumUs, 0);
+
+  _summary->m_count  = count;
+  _summary->m_minUs  = _histogram->m_minUs;
+  _summary->m_maxUs  = _histogram->m_maxUs;
+  _summary->m_meanUs = count > 0 ? sumUs/count : 0;
+  _summary->m_p50Us  = do_percentile(buckets, total, 50);
+  _summary->m_p99Us  = do_percentile(buckets, total, 99);
+
+  // bucket middle may fall outside of what was actually seen
+  if (_summary->m_p50Us < _summary->m_minUs) _summary->m_p50Us = _summary->m_minUs;
+  if (_summary->m_p99Us < _summary->m_minUs) _summary->m_p99Us = _summary->m_minUs;
+  if (_summary->m_p50Us > _summary->m_maxUs) _summary->m_p50Us = _summary->m_maxUs;
+  if (_summary->m_p99Us > _summary->m_maxUs) _summary->m_p99Us = _summary->m_maxUs;
+}
+
+int timingSummaryFormat(const TimingSummary* _summary, char* _buf, size_t _bufSize)
+{
+  if (_summary == NULL || _buf == NULL)
+    return -1;
+
+  return snprintf(_buf, _bufSize, "%"PRIu64" %"PRIu32" %"PRIu32" %"PRIu32" %"PRIu32" %"PRIu32,
+                  _summary->m_count, _summary->m_minUs, _summary->m_meanUs,
+                  _summary->m_p50Us, _summary->m_p99Us, _summary->m_maxUs);
+}
@@ -105,6 +105,69 @@ static int do_v4l2InputSetFormat(V4L2Input* _v4l2, size_t _width, size_t _height
   return 0;
 }
 
+// formats codec accepts (see module_ce do_convertPixelFormat), cheapest to capture and convert first
+static const uint32_t s_v4l2InputFormatCost[] = {
+  V4L2_PIX_FMT_YUYV,
+  V4L2_PIX_FMT_RGB565,
+  V4L2_PIX_FMT_RGB565X,
+  V4L2_PIX_FMT_RGB24,
+  V4L2_PIX_FMT_YUV32,
+};
+
+static int do_v4l2InputSelectFormat(V4L2Input* _v4l2, uint32_t* _format)
+{
+  if (_v4l2 == NULL || _format == NULL)
+    return EINVAL;
+
+  static const size_t s_formatCount = sizeof(s_v4l2InputFormatCost)/sizeof(*s_v4l2InputFormatCost);
+  size_t bestNative   = s_formatCount;
+  size_t bestEmulated = s_formatCount;
+
+  // libv4l2 lists its software conversions too, prefer what the camera delivers itself
+  size_t fmtIdx;
+  for (fmtIdx = 0; ; ++fmtIdx)
+  {
+    struct v4l2_fmtdesc fmtDesc;
+    memset(&fmtDesc, 0, sizeof(fmtDesc));
+    fmtDesc.index = fmtIdx;
+    fmtDesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (v4l2_ioctl(_v4l2->m_fd, VIDIOC_ENUM_FMT, &fmtDesc) != 0)
+      break; // EINVAL past the last one
+
+    size_t costIdx;
+    for (costIdx = 0; costIdx < s_formatCount; ++costIdx)
+      if (s_v4l2InputFormatCost[costIdx] == fmtDesc.pixelformat)
+        break;
+
+    if (fmtDesc.flags & V4L2_FMT_FLAG_EMULATED)
+    {
+      if (costIdx < bestEmulated)
+        bestEmulated = costIdx;
+    }
+    else if (costIdx < bestNative)
+      bestNative = costIdx;
+  }
+
+  if (bestNative < s_formatCount)
+    *_format = s_v4l2InputFormatCost[bestNative];
+  else if (bestEmulated < s_formatCount)
+  {
+    *_format = s_v4l2InputFormatCost[bestEmulated];
+    fprintf(stderr, "V4L2 device has no native format codec accepts, using emulated one\n");
+  }
+  else
+  {
+    fprintf(stderr, "V4L2 device enumerates no format codec accepts\n");
+    return ENOTSUP;
+  }
+
+  fprintf(stderr, "V4L2 selected format %c%c%c%c\n",
+          (*_format    ) & 0xff, (*_format>>8 ) & 0xff,
+          (*_format>>16) & 0xff, (*_format>>24) & 0xff);
+
+  return 0;
+}
+
 static int do_v4l2InputUnsetFormat(V4L2Input* _v4l2)
 {
   if (_v4l2 == NULL)
@@ -424,7 +487,15 @@ int v4l2InputOpen(V4L2Input* _v4l2, const V4L2Config* _config)
     goto exit;
   }
  
-  ret = do_v4l2InputSetFormat(_v4l2, _config->m_width, _config->m_height, _config->m_format);
+  uint32_t format = _config->m_format;
+  if (format == 0) {
+    ret = do_v4l2InputSelectFormat(_v4l2, &format);
+    if (ret != 0) {
+      goto exit_close;
+    }
+  }
+
+  ret = do_v4l2InputSetFormat(_v4l2, _config->m_width, _config->m_height, format);
   if (ret != 0) {
     goto exit_close;
   }
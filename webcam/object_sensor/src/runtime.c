@@ -17,7 +17,7 @@
 static const RuntimeConfig s_runtimeConfig = {
   .m_verbose = false,
   .m_codecEngineConfig = { "dsp_server.xe674", "vidtranscode_cv" },
-  .m_v4l2Config        = { "/dev/video0", 320, 240, V4L2_PIX_FMT_YUYV },
+  .m_v4l2Config        = { "/dev/video0", 320, 240, 0 },
   .m_fbConfig          = { "/dev/fb0" },
   .m_rcConfig          = { "/run/object-sensor.in.fifo", "/run/object-sensor.out.fifo", true },
   .m_reopenVideoTries  = 3
@@ -102,7 +102,8 @@ bool runtimeParseArgs(Runtime* _runtime, int _argc, char* const _argv[])
           case 3: cfg->m_v4l2Config.m_width = atoi(optarg);		break;
           case 4: cfg->m_v4l2Config.m_height = atoi(optarg);		break;
           case 5:
-            if      (!strcasecmp(optarg, "rgb888"))	cfg->m_v4l2Config.m_format = V4L2_PIX_FMT_RGB24;
+            if      (!strcasecmp(optarg, "auto"))	cfg->m_v4l2Config.m_format = 0;
+            else if (!strcasecmp(optarg, "rgb888"))	cfg->m_v4l2Config.m_format = V4L2_PIX_FMT_RGB24;
             else if (!strcasecmp(optarg, "rgb565"))	cfg->m_v4l2Config.m_format = V4L2_PIX_FMT_RGB565;
             else if (!strcasecmp(optarg, "rgb565x"))	cfg->m_v4l2Config.m_format = V4L2_PIX_FMT_RGB565X;
             else if (!strcasecmp(optarg, "yuv444"))	cfg->m_v4l2Config.m_format = V4L2_PIX_FMT_YUV32;
@@ -110,7 +111,7 @@ bool runtimeParseArgs(Runtime* _runtime, int _argc, char* const _argv[])
             else
             {
               fprintf(stderr, "Unknown v4l2 format '%s'\n"
-                              "Known formats: rgb888, rgb565, rgb565x, yuv444, yuv422\n",
+                              "Known formats: auto, rgb888, rgb565, rgb565x, yuv444, yuv422\n",
                       optarg);
               return false;
             }
@@ -139,6 +139,97 @@ static int threadVideoSelectLoop(Runtime* _runtime, CodecEngine* _ce, V4L2Input*
 }
 
 
+static bool threadVideoSameFormat(const ImageDescription* _a, const ImageDescription* _b)
+{
+  return _a->m_width      == _b->m_width
+      && _a->m_height     == _b->m_height
+      && _a->m_lineLength == _b->m_lineLength
+      && _a->m_imageSize  == _b->m_imageSize
+      && _a->m_format     == _b->m_format;
+}
+
+// Reopen V4L2 only; DSP engine, codec instance and its buffers are kept unless format changed
+static int threadVideoRecoverCapture(Runtime* _runtime, CodecEngine* _ce, V4L2Input* _v4l2,
+                                     ImageDescription* _srcImageDesc,
+                                     const ImageDescription* _dstImageDesc)
+{
+  int res;
+  struct timespec recoverStart;
+  struct timespec recoverDone;
+
+  if (_runtime == NULL || _ce == NULL || _v4l2 == NULL || _srcImageDesc == NULL || _dstImageDesc == NULL)
+    return EINVAL;
+
+  clock_gettime(CLOCK_MONOTONIC, &recoverStart);
+
+  if ((res = v4l2InputStop(_v4l2)) != 0)
+    fprintf(stderr, "v4l2InputStop() failed: %d\n", res);
+  if ((res = v4l2InputClose(_v4l2)) != 0)
+    fprintf(stderr, "v4l2InputClose() failed: %d\n", res);
+
+  _runtime->m_state.m_reopenVideoFlag = true;
+  _runtime->m_state.m_reopenVideoCnt = 0;
+  while (_runtime->m_state.m_reopenVideoCnt < _runtime->m_config.m_reopenVideoTries)
+  {
+    ImageDescription srcImageDesc;
+
+    _runtime->m_state.m_reopenVideoCnt++;
+    sleep(1);
+    if (runtimeGetTerminate(_runtime))
+      return ECANCELED;
+    fprintf(stderr, "Reopen video input: %d\n", _runtime->m_state.m_reopenVideoCnt);
+
+    if ((res = v4l2InputOpen(_v4l2, runtimeCfgV4L2Input(_runtime))) != 0)
+    {
+      fprintf(stderr, "v4l2InputOpen() failed: %d\n", res);
+      continue;
+    }
+
+    if ((res = v4l2InputGetFormat(_v4l2, &srcImageDesc)) != 0)
+    {
+      fprintf(stderr, "v4l2InputGetFormat() failed: %d\n", res);
+      goto retry_v4l2_close;
+    }
+
+    if (!threadVideoSameFormat(&srcImageDesc, _srcImageDesc))
+    {
+      fprintf(stderr, "Video input format changed, restarting codec\n");
+      if ((res = codecEngineStop(_ce)) != 0)
+        fprintf(stderr, "codecEngineStop() failed: %d\n", res);
+      if ((res = codecEngineStart(_ce, runtimeCfgCodecEngine(_runtime), &srcImageDesc, _dstImageDesc)) != 0)
+      {
+        fprintf(stderr, "codecEngineStart() failed: %d\n", res);
+        v4l2InputClose(_v4l2);
+        return res; // codec is stopped, no point to retry
+      }
+      *_srcImageDesc = srcImageDesc;
+    }
+
+    if ((res = v4l2InputStart(_v4l2)) != 0)
+    {
+      fprintf(stderr, "v4l2InputStart() failed: %d\n", res);
+      goto retry_v4l2_close;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &recoverDone);
+    fprintf(stderr, "Video input recovered after %d tries in %lld ms\n",
+            _runtime->m_state.m_reopenVideoCnt,
+            (long long)(recoverDone.tv_sec  - recoverStart.tv_sec )*1000
+                     + (recoverDone.tv_nsec - recoverStart.tv_nsec)/1000000);
+
+    _runtime->m_state.m_reopenVideoFlag = false;
+    _runtime->m_state.m_reopenVideoCnt = 0;
+    return 0;
+
+   retry_v4l2_close:
+    v4l2InputClose(_v4l2);
+  }
+
+  fprintf(stderr, "Video input not recovered after %d tries\n", _runtime->m_state.m_reopenVideoCnt);
+  return ENODEV;
+}
+
+
 void* threadVideo(void* _arg)
 {
   int res = 0;
@@ -148,6 +239,7 @@ void* threadVideo(void* _arg)
   V4L2Input* v4l2;
   FBOutput* fb;
   struct timespec last_fps_report_time;
+  bool captureLost = false;
 
   if (runtime == NULL)
   {
@@ -171,7 +263,6 @@ void* threadVideo(void* _arg)
     goto exit;
   }
 
-  reopen_threadVideo:
   if ((res = codecEngineOpen(ce, runtimeCfgCodecEngine(runtime))) != 0)
   {
     fprintf(stderr, "codecEngineOpen() failed: %d\n", res);
@@ -180,18 +271,18 @@ void* threadVideo(void* _arg)
   }
 
 
-  if ((res = v4l2InputOpen(v4l2, runtimeCfgV4L2Input(runtime))) != 0)
+  if ((res = fbOutputOpen(fb, runtimeCfgFBOutput(runtime))) != 0)
   {
-    fprintf(stderr, "v4l2InputOpen() failed: %d\n", res);
+    fprintf(stderr, "fbOutputOpen() failed: %d\n", res);
     exit_code = res;
     goto exit_ce_close;
   }
 
-  if ((res = fbOutputOpen(fb, runtimeCfgFBOutput(runtime))) != 0)
+  if ((res = v4l2InputOpen(v4l2, runtimeCfgV4L2Input(runtime))) != 0)
   {
-    fprintf(stderr, "fbOutputOpen() failed: %d\n", res);
+    fprintf(stderr, "v4l2InputOpen() failed: %d\n", res);
     exit_code = res;
-    goto exit_v4l2_close;
+    goto exit_fb_close;
   }
 
 
@@ -201,19 +292,19 @@ void* threadVideo(void* _arg)
   {
     fprintf(stderr, "v4l2InputGetFormat() failed: %d\n", res);
     exit_code = res;
-    goto exit_fb_close;
+    goto exit_v4l2_close;
   }
   if ((res = fbOutputGetFormat(fb, &dstImageDesc)) != 0)
   {
     fprintf(stderr, "fbOutputGetFormat() failed: %d\n", res);
     exit_code = res;
-    goto exit_fb_close;
+    goto exit_v4l2_close;
   }
   if ((res = codecEngineStart(ce, runtimeCfgCodecEngine(runtime), &srcImageDesc, &dstImageDesc)) != 0)
   {
     fprintf(stderr, "codecEngineStart() failed: %d\n", res);
     exit_code = res;
-    goto exit_fb_close;
+    goto exit_v4l2_close;
   }
 
   if ((res = v4l2InputStart(v4l2)) != 0)
@@ -273,10 +364,12 @@ void* threadVideo(void* _arg)
     if ((res = threadVideoSelectLoop(runtime, ce, v4l2, fb)) != 0)
     {
       fprintf(stderr, "threadVideoSelectLoop() failed: %d\n", res);
-      exit_code = res;
-      runtime->m_state.m_reopenVideoCnt = 0;
-      runtime->m_state.m_reopenVideoFlag  = true;
-      goto exit_fb_stop;
+      if ((res = threadVideoRecoverCapture(runtime, ce, v4l2, &srcImageDesc, &dstImageDesc)) != 0)
+      {
+        exit_code = res;
+        captureLost = true;
+        goto exit_fb_stop;
+      }
     }
   }
   printf("Left video thread loop\n");
@@ -287,7 +380,7 @@ void* threadVideo(void* _arg)
     fprintf(stderr, "fbOutputStop() failed: %d\n", res);
 
  exit_v4l2_stop:
-  if ((res = v4l2InputStop(v4l2)) != 0)
+  if (!captureLost && (res = v4l2InputStop(v4l2)) != 0)
     fprintf(stderr, "v4l2InputStop() failed: %d\n", res);
 
  exit_ce_stop:
@@ -295,27 +388,19 @@ void* threadVideo(void* _arg)
     fprintf(stderr, "codecEngineStop() failed: %d\n", res);
 
 
+ exit_v4l2_close:
+  if (!captureLost && (res = v4l2InputClose(v4l2)) != 0)
+    fprintf(stderr, "v4l2InputClose() failed: %d\n", res);
+
  exit_fb_close:
   if ((res = fbOutputClose(fb)) != 0)
     fprintf(stderr, "fbOutputClose() failed: %d\n", res);
 
- exit_v4l2_close:
-  if ((res = v4l2InputClose(v4l2)) != 0)
-    fprintf(stderr, "v4l2InputClose() failed: %d\n", res);
-
  exit_ce_close:
   if ((res = codecEngineClose(ce)) != 0)
     fprintf(stderr, "codecEngineClose() failed: %d\n", res);
 
  exit:
-   if(runtime->m_state.m_reopenVideoFlag && 
-      runtime->m_state.m_reopenVideoCnt < runtime->m_config.m_reopenVideoTries) {
-    runtime->m_state.m_reopenVideoCnt++;
-    sleep(1); 
-    fprintf(stderr, "Reopen video thread: %d\n", runtime->m_state.m_reopenVideoCnt);
-    goto reopen_threadVideo;    
-  }
- 
   runtimeSetTerminate(runtime);
   return (void*)exit_code;
 }